@@ -1,13 +1,23 @@
 #include "improc.h"
 
+#include <fcntl.h>
 #include <float.h>
 #include <limits.h>
 #include <math.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // 1D: Fast Fourier Transform (FFT)
 #define PI 3.1415926535897932384626433832795L
@@ -92,6 +102,24 @@ static double **allocDoubleMatrix(int width, int height) {
   return matrix;
 }
 
+static float **allocFloatMatrix(int width, int height) {
+  float **matrix = safeMalloc(height * sizeof(float *) + width * height * sizeof(float));
+  float *p = (float *)(matrix + height);
+  for (int y = 0; y < height; y++) {
+    matrix[y] = p + width * y;
+  }
+  return matrix;
+}
+
+static float complex **allocComplexFloatMatrix(int width, int height) {
+  float complex **matrix = safeMalloc(height * sizeof(float complex *) + width * height * sizeof(float complex));
+  float complex *p = (float complex *)(matrix + height);
+  for (int y = 0; y < height; y++) {
+    matrix[y] = p + width * y;
+  }
+  return matrix;
+}
+
 static double complex **allocComplexMatrix(int width, int height) {
   double complex **matrix = safeMalloc(height * sizeof(double complex *) + width * height * sizeof(double complex));
   double complex *p = (double complex *)(matrix + height);
@@ -106,6 +134,52 @@ static char *getFileNameExtension(const char *path) {
   return (extension == NULL ? NULL : extension + 1);
 }
 
+typedef struct ParallelChunk {
+  void (*body)(void *arg, int begin, int end);
+  void *arg;
+  int begin, end;
+} ParallelChunk;
+
+static void *runParallelChunk(void *chunkPtr) {
+  ParallelChunk *chunk = chunkPtr;
+  chunk->body(chunk->arg, chunk->begin, chunk->end);
+  return NULL;
+}
+
+/**
+ * Calls body(arg, begin, end) for consecutive chunks of [0..n) on up to one thread per CPU, and returns once all chunks
+ * are done. Chunks contain at least minChunk items, so small loops simply run on the calling thread.
+ */
+static void parallelFor(int n, int minChunk, void (*body)(void *arg, int begin, int end), void *arg) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int numThreads = n / (minChunk > 0 ? minChunk : 1);
+  numThreads = (cpus > 0 && numThreads > cpus ? cpus : numThreads);
+  if (numThreads <= 1) {
+    body(arg, 0, n);
+    return;
+  }
+  ParallelChunk *chunks = safeMalloc(numThreads * sizeof(ParallelChunk));
+  pthread_t *threads = safeMalloc(numThreads * sizeof(pthread_t));
+  for (int t = 0; t < numThreads; t++) {
+    chunks[t].body = body;
+    chunks[t].arg = arg;
+    chunks[t].begin = (int)((long)n * t / numThreads);
+    chunks[t].end = (int)((long)n * (t + 1) / numThreads);
+  }
+  // the calling thread takes the first chunk itself
+  for (int t = 1; t < numThreads; t++) {
+    if (pthread_create(&threads[t], NULL, runParallelChunk, &chunks[t]) != 0) {
+      fatalError("parallelFor: failed to start worker thread.\n");
+    }
+  }
+  runParallelChunk(&chunks[0]);
+  for (int t = 1; t < numThreads; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  free(threads);
+  free(chunks);
+}
+
 /** Image Domain ****************************************************/
 
 static ImageDomain initImageDomain(int minX, int maxX, int minY, int maxY) {
@@ -556,16 +630,43 @@ void translateIntImage(IntImage *image, int x, int y) {
   domain->maxY += y;
 }
 
+/**
+ * Reverses a row of n ints in place. With SSE2, blocks of 4 are taken from both ends, reversed in registers and stored
+ * at the opposite end.
+ */
+static void reverseIntRow(int *row, int n) {
+  int lo = 0, hi = n - 1;
+#ifdef __SSE2__
+  for (; hi - lo + 1 >= 8; lo += 4, hi -= 4) {
+    __m128i left = _mm_loadu_si128((const __m128i *)(row + lo));
+    __m128i right = _mm_loadu_si128((const __m128i *)(row + hi - 3));
+    _mm_storeu_si128((__m128i *)(row + lo), _mm_shuffle_epi32(right, _MM_SHUFFLE(0, 1, 2, 3)));
+    _mm_storeu_si128((__m128i *)(row + hi - 3), _mm_shuffle_epi32(left, _MM_SHUFFLE(0, 1, 2, 3)));
+  }
+#endif
+  for (; lo < hi; lo++, hi--) {
+    int a = row[lo];
+    row[lo] = row[hi];
+    row[hi] = a;
+  }
+}
+
+/**
+ * Swaps the contents of two rows of n ints. Flips swap row contents rather than row pointers, because the pixels of an
+ * image have to stay a single contiguous block in row order.
+ */
+static void swapIntRows(int *rowA, int *rowB, int *tmp, int n) {
+  memcpy(tmp, rowA, n * sizeof(int));
+  memcpy(rowA, rowB, n * sizeof(int));
+  memcpy(rowB, tmp, n * sizeof(int));
+}
+
 void flipIntImageHorizontal(IntImage *image) {
   ImageDomain domain = getIntImageDomain(*image);
   int width = getWidth(domain);
   int height = getHeight(domain);
   for (int y = 0; y < height; y++) {
-    for (int x = 0; x <= width / 2; x++) {
-      int a = image->pixels[y][x];
-      image->pixels[y][x] = image->pixels[y][width - x - 1];
-      image->pixels[y][width - x - 1] = a;
-    }
+    reverseIntRow(image->pixels[y], width);
   }
   flipDomainHorizontal(getIntImageDomainPtr(image));
 }
@@ -574,20 +675,276 @@ void flipIntImageVertical(IntImage *image) {
   ImageDomain domain = getIntImageDomain(*image);
   int width = getWidth(domain);
   int height = getHeight(domain);
-  for (int y = 0; y <= height / 2; y++) {
-    for (int x = 0; x < width; x++) {
-      int a = image->pixels[y][x];
-      image->pixels[y][x] = image->pixels[height - y - 1][x];
-      image->pixels[height - y - 1][x] = a;
-    }
+  int *tmp = safeMalloc(width * sizeof(int));
+  for (int y = 0; y < height / 2; y++) {
+    swapIntRows(image->pixels[y], image->pixels[height - y - 1], tmp, width);
   }
+  free(tmp);
   flipDomainVertical(getIntImageDomainPtr(image));
 }
 
+/** Transposition ********************************************/
+
+/*
+ * The transposes walk the source in vertical strips: a strip of source columns becomes a band of destination rows, so
+ * every source row is read in whole cache lines and the band of destination rows being written stays in cache. Strips
+ * are distributed over threads. Within a strip, SSE2 transposes 4x4 blocks of ints or 2x2 blocks of doubles in
+ * registers.
+ */
+#define TRANSPOSE_STRIP 32
+
+typedef struct TransposeJob {
+  void **src, **dst;
+  int width, height;     // of the source
+  int reverseRows;       // source column x goes to destination row width-1-x
+  int reverseCols;       // source row y goes to destination column height-1-y
+} TransposeJob;
+
+static void transposeIntStrips(void *arg, int begin, int end) {
+  TransposeJob *job = arg;
+  int **src = (int **)job->src, **dst = (int **)job->dst;
+  int width = job->width, height = job->height;
+  for (int x0 = begin * TRANSPOSE_STRIP; x0 < end * TRANSPOSE_STRIP && x0 < width; x0 += TRANSPOSE_STRIP) {
+    int x1 = (x0 + TRANSPOSE_STRIP < width ? x0 + TRANSPOSE_STRIP : width);
+    int *out[TRANSPOSE_STRIP];
+    for (int x = x0; x < x1; x++) {
+      out[x - x0] = dst[job->reverseRows ? width - 1 - x : x];
+    }
+    int y = 0;
+#ifdef __SSE2__
+    for (; y + 4 <= height; y += 4) {
+      int x = x0;
+      int col = (job->reverseCols ? height - 4 - y : y);
+      for (; x + 4 <= x1; x += 4) {
+        __m128i r0 = _mm_loadu_si128((const __m128i *)(src[y] + x));
+        __m128i r1 = _mm_loadu_si128((const __m128i *)(src[y + 1] + x));
+        __m128i r2 = _mm_loadu_si128((const __m128i *)(src[y + 2] + x));
+        __m128i r3 = _mm_loadu_si128((const __m128i *)(src[y + 3] + x));
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+        __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+        __m128i c[4] = {_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1), _mm_unpacklo_epi64(t2, t3),
+                        _mm_unpackhi_epi64(t2, t3)};
+        for (int k = 0; k < 4; k++) {
+          __m128i v = (job->reverseCols ? _mm_shuffle_epi32(c[k], _MM_SHUFFLE(0, 1, 2, 3)) : c[k]);
+          _mm_storeu_si128((__m128i *)(out[x - x0 + k] + col), v);
+        }
+      }
+      for (; x < x1; x++) {
+        for (int k = 0; k < 4; k++) {
+          out[x - x0][job->reverseCols ? height - 1 - y - k : y + k] = src[y + k][x];
+        }
+      }
+    }
+#endif
+    for (; y < height; y++) {
+      int col = (job->reverseCols ? height - 1 - y : y);
+      for (int x = x0; x < x1; x++) {
+        out[x - x0][col] = src[y][x];
+      }
+    }
+  }
+}
+
+static void transposeDoubleStrips(void *arg, int begin, int end) {
+  TransposeJob *job = arg;
+  double **src = (double **)job->src, **dst = (double **)job->dst;
+  int width = job->width, height = job->height;
+  for (int x0 = begin * TRANSPOSE_STRIP; x0 < end * TRANSPOSE_STRIP && x0 < width; x0 += TRANSPOSE_STRIP) {
+    int x1 = (x0 + TRANSPOSE_STRIP < width ? x0 + TRANSPOSE_STRIP : width);
+    int y = 0;
+#ifdef __SSE2__
+    for (; y + 2 <= height; y += 2) {
+      int x = x0;
+      int col = (job->reverseCols ? height - 2 - y : y);
+      for (; x + 2 <= x1; x += 2) {
+        __m128d r0 = _mm_loadu_pd(src[y] + x);
+        __m128d r1 = _mm_loadu_pd(src[y + 1] + x);
+        __m128d c0 = (job->reverseCols ? _mm_unpacklo_pd(r1, r0) : _mm_unpacklo_pd(r0, r1));
+        __m128d c1 = (job->reverseCols ? _mm_unpackhi_pd(r1, r0) : _mm_unpackhi_pd(r0, r1));
+        _mm_storeu_pd(dst[job->reverseRows ? width - 1 - x : x] + col, c0);
+        _mm_storeu_pd(dst[job->reverseRows ? width - 2 - x : x + 1] + col, c1);
+      }
+      for (; x < x1; x++) {
+        double *out = dst[job->reverseRows ? width - 1 - x : x];
+        out[job->reverseCols ? height - 1 - y : y] = src[y][x];
+        out[job->reverseCols ? height - 2 - y : y + 1] = src[y + 1][x];
+      }
+    }
+#endif
+    for (; y < height; y++) {
+      int col = (job->reverseCols ? height - 1 - y : y);
+      for (int x = x0; x < x1; x++) {
+        dst[job->reverseRows ? width - 1 - x : x][col] = src[y][x];
+      }
+    }
+  }
+}
+
+static void transposeComplexStrips(void *arg, int begin, int end) {
+  TransposeJob *job = arg;
+  double complex **src = (double complex **)job->src, **dst = (double complex **)job->dst;
+  int width = job->width, height = job->height;
+  // a complex pixel fills a whole SSE register already, so there is nothing to shuffle
+  for (int x0 = begin * TRANSPOSE_STRIP; x0 < end * TRANSPOSE_STRIP && x0 < width; x0 += TRANSPOSE_STRIP) {
+    int x1 = (x0 + TRANSPOSE_STRIP < width ? x0 + TRANSPOSE_STRIP : width);
+    for (int y = 0; y < height; y++) {
+      int col = (job->reverseCols ? height - 1 - y : y);
+      for (int x = x0; x < x1; x++) {
+        dst[job->reverseRows ? width - 1 - x : x][col] = src[y][x];
+      }
+    }
+  }
+}
+
+static void transposePixels(void (*strips)(void *, int, int), void **src, void **dst, int width, int height,
+                            int reverseRows, int reverseCols) {
+  TransposeJob job = {src, dst, width, height, reverseRows, reverseCols};
+  int numStrips = (width + TRANSPOSE_STRIP - 1) / TRANSPOSE_STRIP;
+  // a strip is only worth a thread when it holds enough pixels
+  int minStrips = 1 + 65536 / (TRANSPOSE_STRIP * height);
+  parallelFor(numStrips, minStrips, strips, &job);
+}
+
+IntImage transposeIntImage(IntImage image) {
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  IntImage result = allocateIntImageGrid(minY, maxY, minX, maxX, image.minRange, image.maxRange);
+  transposePixels(transposeIntStrips, (void **)image.pixels, (void **)result.pixels, getWidth(image.domain),
+                  getHeight(image.domain), 0, 0);
+  return result;
+}
+
+DoubleImage transposeDoubleImage(DoubleImage image) {
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  DoubleImage result = allocateDoubleImageGrid(minY, maxY, minX, maxX, image.minRange, image.maxRange);
+  transposePixels(transposeDoubleStrips, (void **)image.pixels, (void **)result.pixels, getWidth(image.domain),
+                  getHeight(image.domain), 0, 0);
+  return result;
+}
+
+ComplexImage transposeComplexImage(ComplexImage image) {
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  ComplexImage result = allocateComplexImageGrid(minY, maxY, minX, maxX);
+  transposePixels(transposeComplexStrips, (void **)image.pixels, (void **)result.pixels, getWidth(image.domain),
+                  getHeight(image.domain), 0, 0);
+  return result;
+}
+
+IntImage rotate90IntImage(IntImage image, int turns) {
+  int minX, maxX, minY, maxY, width, height;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  getWidthHeight(image.domain, &width, &height);
+  IntImage result;
+  switch (((turns % 4) + 4) % 4) {
+    case 1:
+      // (x, y) -> (y, -x)
+      result = allocateIntImageGrid(minY, maxY, -maxX, -minX, image.minRange, image.maxRange);
+      transposePixels(transposeIntStrips, (void **)image.pixels, (void **)result.pixels, width, height, 1, 0);
+      break;
+    case 2:
+      // (x, y) -> (-x, -y)
+      result = allocateIntImageGrid(-maxX, -minX, -maxY, -minY, image.minRange, image.maxRange);
+      for (int y = 0; y < height; y++) {
+        const int *in = image.pixels[y];
+        int *out = result.pixels[height - 1 - y];
+        for (int x = 0; x < width; x++) {
+          out[width - 1 - x] = in[x];
+        }
+      }
+      break;
+    case 3:
+      // (x, y) -> (-y, x)
+      result = allocateIntImageGrid(-maxY, -minY, minX, maxX, image.minRange, image.maxRange);
+      transposePixels(transposeIntStrips, (void **)image.pixels, (void **)result.pixels, width, height, 0, 1);
+      break;
+    default:
+      result = copyIntImage(image);
+      break;
+  }
+  return result;
+}
+
 /** Loading ********************************************/
 
-static unsigned short *loadImagePGM(const char *path, int *width, int *height, int *maxVal) {
-  int magicNumber;
+/**
+ * Widens a row of n raw netpbm samples into ints. Samples of more than 8 bits are stored big-endian (most significant
+ * byte first) in netpbm files, so those are byte-swapped on the way.
+ */
+static void decodeNetpbmSamples(const uint8_t *src, int *dst, int n, int bytesPerSample) {
+  int i = 0;
+#ifdef __SSE2__
+  __m128i zero = _mm_setzero_si128();
+  if (bytesPerSample == 2) {
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+      v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));  // big-endian to host order
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(v, zero));
+      _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(v, zero));
+    }
+  } else {
+    for (; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+      _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(lo, zero));
+      _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+      _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+      _mm_storeu_si128((__m128i *)(dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+    }
+  }
+#endif
+  if (bytesPerSample == 2) {
+    for (; i < n; i++) {
+      dst[i] = (src[2 * i] << 8) | src[2 * i + 1];
+    }
+  } else {
+    for (; i < n; i++) {
+      dst[i] = src[i];
+    }
+  }
+}
+
+/**
+ * Skips any whitespace and comment lines in a netpbm header, so that the next read starts at the next header value.
+ */
+static void skipNetpbmComments(FILE *imgFile, const char *function, const char *format) {
+  int c;
+  while (1) {
+    do {
+      c = fgetc(imgFile);
+    } while ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'));
+    if (c != '#') {
+      break;
+    }
+    do {
+      c = fgetc(imgFile);
+    } while ((c != EOF) && (c != '\n'));
+    if (c == EOF) {
+      fatalError("%s: corrupt %s file.\n", function, format);
+    }
+  }
+  ungetc(c, imgFile);
+}
+
+/**
+ * Makes sure the image has the provided dimensions and dynamic range [0..maxVal]. The pixel memory of the image is
+ * reused when it already has the right dimensions. An image without pixel memory should have pixels == NULL.
+ */
+static void prepareIntImage(IntImage *image, int width, int height, int maxVal) {
+  if (image->pixels == NULL || getWidth(image->domain) != width || getHeight(image->domain) != height) {
+    free(image->pixels);
+    *image = allocateIntImage(width, height, 0, maxVal);
+  }
+  image->domain = initImageDomain(0, width - 1, 0, height - 1);
+  setDynamicRange(image, 0, maxVal);
+}
+
+static void loadImagePGM(const char *path, IntImage *image) {
+  int magicNumber, width, height, maxVal;
   FILE *imgFile = fopen(path, "r");
   if (fscanf(imgFile, "P%d\n", &magicNumber) != 1) {
     fclose(imgFile);
@@ -598,65 +955,102 @@ static unsigned short *loadImagePGM(const char *path, int *width, int *height, i
     fclose(imgFile);
     fatalError("loadImagePGM: illegal magic number P%d found. Only P2 and P5 are valid PGM files.\n", magicNumber);
   }
-  // skip comment lines
-  char c;
-  while ((c = fgetc(imgFile)) == '#') {
-    do {
-      c = fgetc(imgFile);
-    } while ((c != EOF) && (c != '\n'));
-    if (c == EOF) {
-      fatalError("loadImagePGM: corrupt PGM file.\n");
-    }
-  }
-  ungetc(c, imgFile);
+  skipNetpbmComments(imgFile, "loadImagePGM", "PGM");
 
   // read width and height
-  if (fscanf(imgFile, "%d %d", width, height) != 2) {
+  if (fscanf(imgFile, "%d %d", &width, &height) != 2) {
     fatalError("loadImagePGM: corrupt PGM: no file dimensions found.\n");
   }
-  if (fscanf(imgFile, "%d\n", maxVal) != 1) {
+  if (fscanf(imgFile, "%d", &maxVal) != 1 || fgetc(imgFile) == EOF) {
     fatalError("loadImagePGM: corrupt PGM file: no maximal grey value.\n");
   }
-  if ((*maxVal < 0) || (*maxVal > 65535)) {
-    fatalError("loadImagePGM: corrupt PGM: maximum grey value found is %d (must be in range [0..65535]).\n");
+  if ((maxVal < 0) || (maxVal > 65535)) {
+    fatalError("loadImagePGM: corrupt PGM: maximum grey value found is %d (must be in range [0..65535]).\n", maxVal);
   }
 
-  int npixels = (*width) * (*height);
-  unsigned short *buffer = malloc(npixels * sizeof(short));
+  prepareIntImage(image, width, height, maxVal);
   if (magicNumber == 2) {
     int gval;
-    for (int i = 0; i < npixels; i++) {
-      if (fscanf(imgFile, "%d", &gval) != 1) {
-        fatalError("loadPgmImage: corrupt PGM: non numeric data found in PGM image (P2 type).\n");
-      }
-      if ((gval < 0) || (gval > *maxVal)) {
-        fatalError("loadImagePGM: pixel with grey value %d found. Valid dynamic range is [0..%d].\n", gval, *maxVal);
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        if (fscanf(imgFile, "%d", &gval) != 1) {
+          fatalError("loadPgmImage: corrupt PGM: non numeric data found in PGM image (P2 type).\n");
+        }
+        if ((gval < 0) || (gval > maxVal)) {
+          fatalError("loadImagePGM: pixel with grey value %d found. Valid dynamic range is [0..%d].\n", gval, maxVal);
+        }
+        image->pixels[y][x] = gval;
       }
-      buffer[i] = gval;
     }
   } else {
-    // magicnumber == 5
-    if (*maxVal > 255) {  // 2 bytes per pixel, i.e. short
-      if (fread(buffer, 2, npixels, imgFile) != npixels) {
-        fatalError("loadImagePGM: corrupt PGM, file is truncated.\n");
-      }
-    } else {  // 1 byte per pixel
-      unsigned char *buf = malloc(npixels * sizeof(unsigned char));
-      if (fread(buf, 1, npixels, imgFile) != npixels) {
+    // magicnumber == 5: rows are streamed through a small buffer and decoded straight into the image
+    int bytesPerSample = (maxVal > 255 ? 2 : 1);
+    uint8_t *row = safeMalloc(width * bytesPerSample);
+    for (int y = 0; y < height; y++) {
+      if (fread(row, bytesPerSample, width, imgFile) != (size_t)width) {
         fatalError("loadImagePGM: corrupt PGM, file is truncated.\n");
       }
-      for (int i = 0; i < npixels; i++) {
-        buffer[i] = buf[i];
-      }
-      free(buf);
+      decodeNetpbmSamples(row, image->pixels[y], width, bytesPerSample);
     }
+    free(row);
   }
   fclose(imgFile);
-  return buffer;
 }
 
-static unsigned short *loadImagePBM(const char *path, int *width, int *height) {
-  int magicNumber;
+/**
+ * Unpacks a row of raw (P4) PBM bits into pixels. Note that in PBM 0 is white and 1 is black, so a set bit becomes 0.
+ */
+static void unpackPbmBits(const uint8_t *bytes, int *pixels, int width) {
+  int x = 0;
+#ifdef __SSE2__
+  // the byte is broadcast to all lanes, and each lane tests its own bit
+  const __m128i bitsHi = _mm_set_epi32(16, 32, 64, 128);
+  const __m128i bitsLo = _mm_set_epi32(1, 2, 4, 8);
+  const __m128i one = _mm_set1_epi32(1);
+  for (; x + 8 <= width; x += 8) {
+    __m128i byte = _mm_set1_epi32(bytes[x / 8]);
+    __m128i hi = _mm_cmpeq_epi32(_mm_and_si128(byte, bitsHi), _mm_setzero_si128());
+    __m128i lo = _mm_cmpeq_epi32(_mm_and_si128(byte, bitsLo), _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)(pixels + x), _mm_and_si128(hi, one));
+    _mm_storeu_si128((__m128i *)(pixels + x + 4), _mm_and_si128(lo, one));
+  }
+#endif
+  for (; x < width; x++) {
+    pixels[x] = !((bytes[x / 8] >> (7 - x % 8)) & 1);
+  }
+}
+
+/**
+ * Packs a row of pixels into raw (P4) PBM bits. Pixels <= 0 are black (bit 1), all others are white (bit 0). The bytes
+ * must be zero initialised.
+ */
+static void packPbmBits(const int *pixels, uint8_t *bytes, int width) {
+  int x = 0;
+#ifdef __SSE2__
+  // the lanes are reversed before packing, so that movemask produces the bits most significant (first pixel) first
+  const __m128i zero = _mm_setzero_si128();
+  for (; x + 16 <= width; x += 16) {
+    __m128i white[4];
+    for (int i = 0; i < 4; i++) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(pixels + x + 4 * i));
+      white[i] = _mm_shuffle_epi32(_mm_cmpgt_epi32(v, zero), _MM_SHUFFLE(0, 1, 2, 3));
+    }
+    __m128i firstByte = _mm_packs_epi32(white[1], white[0]);
+    __m128i secondByte = _mm_packs_epi32(white[3], white[2]);
+    int mask = ~_mm_movemask_epi8(_mm_packs_epi16(firstByte, secondByte));
+    bytes[x / 8] = mask & 0xff;
+    bytes[x / 8 + 1] = (mask >> 8) & 0xff;
+  }
+#endif
+  for (; x < width; x++) {
+    if (pixels[x] <= 0) {
+      bytes[x / 8] |= 128 >> (x % 8);
+    }
+  }
+}
+
+static void loadImagePBM(const char *path, IntImage *image) {
+  int magicNumber, width, height;
   FILE *imgFile = fopen(path, "r");
   if (fscanf(imgFile, "P%d\n", &magicNumber) != 1) {
     fclose(imgFile);
@@ -667,56 +1061,158 @@ static unsigned short *loadImagePBM(const char *path, int *width, int *height) {
     fclose(imgFile);
     fatalError("loadImagePBM: Illegal magic number P%d found. Only P1 and P4 are valid PBM files.\n", magicNumber);
   }
-  // skip comment lines
-  char c;
-  while ((c = fgetc(imgFile)) == '#') {
-    do {
-      c = fgetc(imgFile);
-    } while ((c != EOF) && (c != '\n'));
-    if (c == EOF) {
-      fatalError("loadImagePBM: corrupt PBM file.\n");
-    }
-  }
-  ungetc(c, imgFile);
+  skipNetpbmComments(imgFile, "loadImagePBM", "PBM");
 
-  // read width and height
-  if (fscanf(imgFile, "%d %d\n", width, height) != 2) {
+  // read width and height; exactly one whitespace character separates them from the data
+  if (fscanf(imgFile, "%d %d", &width, &height) != 2 || fgetc(imgFile) == EOF) {
     fatalError("loadImagePBM: corrupt PBM: no file dimensions found.\n");
   }
-  int npixels = (*width) * (*height);
-  unsigned short *buffer = malloc(npixels * sizeof(short));
+  prepareIntImage(image, width, height, 255);
   if (magicNumber == 1) {
-    for (int i = 0; i < npixels; i++) {
-      char bit;
-      do {
-        if (fscanf(imgFile, "%c", &bit) != 1) {
-          fatalError("loadImagePBM: corrupt PBM, , file is truncated.\n");
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) {
+        char bit;
+        do {
+          if (fscanf(imgFile, "%c", &bit) != 1) {
+            fatalError("loadImagePBM: corrupt PBM, , file is truncated.\n");
+          }
+        } while ((bit == ' ') || (bit == '\t') || (bit == '\n'));
+        if ((bit != '0') && (bit != '1')) {
+          fatalError("loadImagePBM: illegal character found.\n");
         }
-      } while ((bit == ' ') || (bit == '\t') || (bit == '\n'));
-      if ((bit != '0') && (bit != '1')) {
-        fatalError("loadImagePBM: illegal character found.\n");
+        image->pixels[y][x] = (bit == '1' ? 0 : 1);  // Note: in PBM 0 is white, 1 is black! (weird)
       }
-      buffer[i] = bit - '0';
     }
   } else {
-    int w = *width, h = *height, idx = 0;
-    for (int i = 0; i < h; i++) {
-      int j = 0;
-      while (j < w) {
-        unsigned char mask, byte;
-        byte = fgetc(imgFile);
-        for (mask = 128; mask && (j < w); mask >>= 1) {
-          buffer[idx++] = (byte & mask ? 0 : 1);  // Note: in PBM 0 is white, 1 is black! (weird)
-          j++;
-        }
+    // magicnumber == 4: every row is read with a single fread and unpacked a byte (8 pixels) at a time
+    int rowBytes = (width + 7) / 8;
+    uint8_t *bytes = safeMalloc(rowBytes);
+    for (int y = 0; y < height; y++) {
+      if (fread(bytes, 1, rowBytes, imgFile) != (size_t)rowBytes) {
+        fatalError("loadImagePBM: corrupt PBM, file is truncated.\n");
       }
+      unpackPbmBits(bytes, image->pixels[y], width);
     }
+    free(bytes);
   }
   fclose(imgFile);
-  return buffer;
 }
 
-IntImage loadIntImage(const char *path) {
+/**
+ * Header of a PAM (P7) file. Multiple TUPLTYPE lines are concatenated, separated by a space.
+ */
+typedef struct PamHeader {
+  int width, height, depth, maxVal;
+  char tupleType[128];
+} PamHeader;
+
+static void readPamHeader(FILE *imgFile, const char *path, PamHeader *header) {
+  char line[256];
+  if (fgets(line, sizeof(line), imgFile) == NULL || strcmp(line, "P7\n") != 0) {
+    fatalError("readPamHeader: corrupt PAM %s: no P7 magic number found.\n", path);
+  }
+  header->width = header->height = header->depth = header->maxVal = -1;
+  header->tupleType[0] = '\0';
+  while (1) {
+    if (fgets(line, sizeof(line), imgFile) == NULL) {
+      fatalError("readPamHeader: corrupt PAM %s: no ENDHDR found.\n", path);
+    }
+    char keyword[16];
+    int length;
+    if (line[0] == '#' || sscanf(line, " %15s%n", keyword, &length) != 1) {
+      continue;  // comment or blank line
+    }
+    if (strcmp(keyword, "ENDHDR") == 0) {
+      break;
+    }
+    char *value = line + length;
+    value += strspn(value, " \t");
+    value[strcspn(value, "\r\n")] = '\0';
+    if (strcmp(keyword, "TUPLTYPE") == 0) {
+      size_t used = strlen(header->tupleType);
+      if (used + 1 + strlen(value) >= sizeof(header->tupleType)) {
+        fatalError("readPamHeader: corrupt PAM %s: tuple type is too long.\n", path);
+      }
+      if (used > 0) {
+        strcat(header->tupleType, " ");
+      }
+      strcat(header->tupleType, value);
+      continue;
+    }
+    int *field = NULL;
+    if (strcmp(keyword, "WIDTH") == 0) {
+      field = &header->width;
+    } else if (strcmp(keyword, "HEIGHT") == 0) {
+      field = &header->height;
+    } else if (strcmp(keyword, "DEPTH") == 0) {
+      field = &header->depth;
+    } else if (strcmp(keyword, "MAXVAL") == 0) {
+      field = &header->maxVal;
+    } else {
+      fatalError("readPamHeader: corrupt PAM %s: unknown header field %s.\n", path, keyword);
+    }
+    if (sscanf(value, "%d", field) != 1) {
+      fatalError("readPamHeader: corrupt PAM %s: non numeric value for %s.\n", path, keyword);
+    }
+  }
+  if (header->width < 1 || header->height < 1 || header->depth < 1) {
+    fatalError("readPamHeader: corrupt PAM %s: missing or invalid WIDTH, HEIGHT or DEPTH.\n", path);
+  }
+  if ((header->maxVal < 1) || (header->maxVal > 65535)) {
+    fatalError("readPamHeader: corrupt PAM %s: maximum value found is %d (must be in range [1..65535]).\n", path,
+               header->maxVal);
+  }
+}
+
+/**
+ * Streams the raster of a PAM file row by row and deinterleaves the tuples into the provided channel matrices. A
+ * channel that is not needed can be skipped by passing NULL for it.
+ */
+static void decodePamRaster(FILE *imgFile, const char *path, PamHeader header, int **planes[]) {
+  int depth = header.depth;
+  int rowSamples = header.width * depth;
+  int bytesPerSample = (header.maxVal > 255 ? 2 : 1);
+  uint8_t *raw = safeMalloc(rowSamples * bytesPerSample);
+  int *samples = safeMalloc(rowSamples * sizeof(int));
+  for (int y = 0; y < header.height; y++) {
+    if (fread(raw, bytesPerSample, rowSamples, imgFile) != (size_t)rowSamples) {
+      fatalError("decodePamRaster: corrupt PAM %s, file is truncated.\n", path);
+    }
+    decodeNetpbmSamples(raw, samples, rowSamples, bytesPerSample);
+    for (int c = 0; c < depth; c++) {
+      if (planes[c] == NULL) {
+        continue;
+      }
+      int *dst = planes[c][y];
+      const int *src = samples + c;
+      for (int x = 0; x < header.width; x++) {
+        dst[x] = src[x * depth];
+      }
+    }
+  }
+  free(samples);
+  free(raw);
+}
+
+static void loadImagePAM(const char *path, IntImage *image) {
+  PamHeader header;
+  FILE *imgFile = fopen(path, "r");
+  readPamHeader(imgFile, path, &header);
+  if (header.depth != 1) {
+    fatalError("loadImagePAM: %s has %d channels (%s). Use loadIntImageChannels to load it.\n", path, header.depth,
+               header.tupleType);
+  }
+  prepareIntImage(image, header.width, header.height, header.maxVal);
+  int **planes[1] = {image->pixels};
+  decodePamRaster(imgFile, path, header, planes);
+  fclose(imgFile);
+}
+
+/**
+ * Loads the image at path into the provided image. The pixel memory of the image is reused when it already has the
+ * dimensions of the file. Otherwise, (re)allocates the image. An image without pixel memory should have pixels == NULL.
+ */
+static void loadIntImageInto(const char *path, IntImage *image) {
   char *extension = getFileNameExtension(path);
   if (extension == NULL) {
     fatalError("loadIntImage: filename '%s' has no extension.\n", path);
@@ -727,27 +1223,101 @@ IntImage loadIntImage(const char *path) {
   }
   fclose(f);
 
-  int width, height, maxVal;
-  unsigned short *buf = NULL;
-
   if (strcmp("pgm", extension) == 0) {
-    buf = loadImagePGM(path, &width, &height, &maxVal);
+    loadImagePGM(path, image);
   } else if (strcmp("pbm", extension) == 0) {
-    buf = loadImagePBM(path, &width, &height);
-    maxVal = 255;
+    loadImagePBM(path, image);
+  } else if (strcmp("pam", extension) == 0) {
+    loadImagePAM(path, image);
   } else {
-    fatalError("loadIntImage: filename '%s' must have either pgm or pbm as extension. \n", path);
+    fatalError("loadIntImage: filename '%s' must have pgm, pbm or pam as extension. \n", path);
   }
-  // copy buffer into image structure
-  IntImage image = allocateIntImage(width, height, 0, maxVal);
-  int idx = 0;
-  for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      setIntPixel(&image, x, y, buf[idx++]);
+}
+
+IntImage loadIntImage(const char *path) {
+  IntImage image;
+  image.pixels = NULL;
+  loadIntImageInto(path, &image);
+  return image;
+}
+
+void probeImage(const char *path, ImageInfo *info) {
+  FILE *imgFile = fopen(path, "rb");
+  if (imgFile == NULL) {
+    fatalError("probeImage: failed to open file '%s'.\n", path);
+  }
+  int magicNumber;
+  if (fscanf(imgFile, "P%d", &magicNumber) != 1 || magicNumber < 1 || magicNumber > 7) {
+    fatalError("probeImage: '%s' is not a netpbm file.\n", path);
+  }
+  info->magicNumber = magicNumber;
+  if (magicNumber == 7) {
+    PamHeader header;
+    rewind(imgFile);
+    readPamHeader(imgFile, path, &header);
+    info->width = header.width;
+    info->height = header.height;
+    info->channels = header.depth;
+    info->maxVal = header.maxVal;
+  } else {
+    // only the header values are parsed; a single whitespace character separates the header from the data
+    int values[3];
+    int numValues = ((magicNumber == 1) || (magicNumber == 4) ? 2 : 3);
+    for (int i = 0; i < numValues; i++) {
+      skipNetpbmComments(imgFile, "probeImage", "netpbm");
+      if (fscanf(imgFile, "%d", &values[i]) != 1) {
+        fatalError("probeImage: corrupt netpbm header in '%s'.\n", path);
+      }
     }
+    if (fgetc(imgFile) == EOF) {
+      fatalError("probeImage: '%s' has no pixel data.\n", path);
+    }
+    info->width = values[0];
+    info->height = values[1];
+    info->channels = ((magicNumber == 3) || (magicNumber == 6) ? 3 : 1);
+    info->maxVal = (numValues == 2 ? 1 : values[2]);
   }
-  free(buf);
-  return image;
+  if ((magicNumber == 1) || (magicNumber == 4)) {
+    info->bitDepth = 1;
+  } else {
+    info->bitDepth = (info->maxVal > 255 ? 16 : 8);
+  }
+  info->dataOffset = ftell(imgFile);
+  fclose(imgFile);
+}
+
+IntImage *loadIntImageChannels(const char *path, int *depth, char *tupleType, int tupleTypeSize) {
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL || strcmp("pam", extension) != 0) {
+    fatalError("loadIntImageChannels: filename '%s' must have pam as extension.\n", path);
+  }
+  FILE *imgFile = fopen(path, "r");
+  if (imgFile == NULL) {
+    fatalError("loadIntImageChannels: failed to open file '%s'.\n", path);
+  }
+  PamHeader header;
+  readPamHeader(imgFile, path, &header);
+  IntImage *channels = safeMalloc(header.depth * sizeof(IntImage));
+  int ***planes = safeMalloc(header.depth * sizeof(int **));
+  for (int c = 0; c < header.depth; c++) {
+    channels[c] = allocateIntImage(header.width, header.height, 0, header.maxVal);
+    planes[c] = channels[c].pixels;
+  }
+  decodePamRaster(imgFile, path, header, planes);
+  free(planes);
+  fclose(imgFile);
+  *depth = header.depth;
+  if (tupleType != NULL && tupleTypeSize > 0) {
+    snprintf(tupleType, tupleTypeSize, "%s", header.tupleType);
+  }
+  return channels;
+}
+
+void freeIntImageChannels(IntImage *channels, int depth) {
+  for (int c = 0; c < depth; c++) {
+    freeIntImage(channels[c]);
+  }
+  free(channels);
 }
 
 /** Saving ********************************************/
@@ -769,54 +1339,157 @@ static void saveImagePBMasP1(const char *path, int width, int height, uint8_t *b
   fclose(pbmFile);
 }
 
-static void saveImagePBMasP4(const char *path, int width, int height, uint8_t *buffer) {
-  FILE *pbmFile = fopen(path, "w");
-  if (pbmFile == NULL) {
-    fatalError("saveImagePBMasP4: failed to open file '%s'.\n", path);
-  }
-  fprintf(pbmFile, "P4\n%d %d\n", width, height);
-
-  int idx = 0;
-  for (int i = 0; i < height; i++) {
-    int j = 0;
-    while (j < width) {
-      unsigned char mask, byte = 0;
-      for (mask = 128; mask && (j < width); mask >>= 1) {
-        if (buffer[idx++] == 0) {  // Note: in PBM 0 is white, 1 is black! (weird)
-          byte |= mask;
-        }
-        j++;
-      }
-      fputc(byte, pbmFile);
+/**
+ * Raw netpbm data in the on-disk sample layout. The header is kept separately, so that header and samples can be
+ * written with a single vectored write.
+ */
+typedef struct PackedNetpbm {
+  char header[256];
+  int headerLength;
+  uint8_t *data;
+  size_t numBytes;
+  int minVal, maxVal;  // extremes of the original (unclamped) values
+} PackedNetpbm;
+
+static void writeNetpbmFile(const char *path, PackedNetpbm packed) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    fatalError("writeNetpbmFile: failed to open file '%s'.\n", path);
+  }
+  struct iovec iov[2];
+  iov[0].iov_base = packed.header;
+  iov[0].iov_len = packed.headerLength;
+  iov[1].iov_base = packed.data;
+  iov[1].iov_len = packed.numBytes;
+  int first = 0;
+  while (first < 2) {
+    ssize_t written = writev(fd, iov + first, 2 - first);
+    if (written < 0) {
+      close(fd);
+      fatalError("writeNetpbmFile: failed to write file '%s'.\n", path);
+    }
+    // advance over the (partially) written vectors
+    while (first < 2 && (size_t)written >= iov[first].iov_len) {
+      written -= iov[first].iov_len;
+      first++;
+    }
+    if (first < 2) {
+      iov[first].iov_base = (uint8_t *)iov[first].iov_base + written;
+      iov[first].iov_len -= written;
     }
   }
-  fclose(pbmFile);
+  close(fd);
 }
 
-static void saveImagePGMasP5(const char *path, int width, int height, unsigned short *buffer) {
-  FILE *pgmFile = fopen(path, "w");
-  if (pgmFile == NULL) {
-    fatalError("saveImagePGMasP5: failed to open file '%s'.\n", path);
+/**
+ * Clamps a value to [0..65535] and stores it as a big-endian 16-bit netpbm sample.
+ */
+static inline void storeBigEndianSample(uint8_t *dst, int val) {
+  val = (val < 0 ? 0 : (val > 65535 ? 65535 : val));
+  dst[0] = val >> 8;
+  dst[1] = val & 0xff;
+}
+
+/**
+ * Packs numSamples big-endian 16-bit samples in place into single bytes when the maximum fits in a byte (i.e. when all
+ * most significant bytes are 0). This is safe since byte i is only written after byte 2i+1 >= i was read.
+ */
+static size_t narrowSamples(uint8_t *samples, size_t numSamples, int maxSample) {
+  if (maxSample > 255) {
+    return 2 * numSamples;
   }
-  fprintf(pgmFile, "P5\n%d %d\n", width, height);
+  for (size_t i = 0; i < numSamples; i++) {
+    samples[i] = samples[2 * i + 1];
+  }
+  return numSamples;
+}
 
-  int npixels = (width) * (height);
-  unsigned short max = buffer[0];
-  for (int i = 0; (i < npixels) && (max < 65535); i++) {
-    max = (buffer[i] > max ? buffer[i] : max);
+/**
+ * Converts an image into the data of a raw (P5) PGM in one pass: the values are clamped to [0..65535] and packed,
+ * while the extremes are tracked for the header.
+ */
+static PackedNetpbm packIntImageP5(IntImage image) {
+  int width, height;
+  getWidthHeight(getIntImageDomain(image), &width, &height);
+  size_t npixels = (size_t)width * height;
+  uint8_t *samples = safeMalloc(2 * npixels);
+  int minVal = INT_MAX, maxVal = INT_MIN;
+  uint8_t *dst = samples;
+  for (int y = 0; y < height; y++) {
+    const int *row = image.pixels[y];
+    for (int x = 0; x < width; x++) {
+      int val = row[x];
+      minVal = (val < minVal ? val : minVal);
+      maxVal = (val > maxVal ? val : maxVal);
+      storeBigEndianSample(dst, val);
+      dst += 2;
+    }
   }
-  fprintf(pgmFile, "%d\n", max);
-  if (max > 255) {
-    fwrite(buffer, 2, npixels, pgmFile);
-  } else {
-    unsigned char *buf = malloc(npixels);
-    for (int i = 0; i < npixels; i++) {
-      buf[i] = buffer[i];
+  PackedNetpbm packed;
+  int maxSample = (maxVal < 0 ? 0 : (maxVal > 65535 ? 65535 : maxVal));
+  packed.data = samples;
+  packed.numBytes = narrowSamples(samples, npixels, maxSample);
+  packed.headerLength = sprintf(packed.header, "P5\n%d %d\n%d\n", width, height, maxSample);
+  packed.minVal = minVal;
+  packed.maxVal = maxVal;
+  return packed;
+}
+
+/**
+ * Converts depth channel matrices into the data of a PAM (P7) file in one pass: the channels are interleaved into
+ * tuples, clamped to [0..65535] and packed, while the extremes are tracked for the header.
+ */
+static PackedNetpbm packPamChannels(int **planes[], int depth, int width, int height, const char *tupleType) {
+  if (tupleType != NULL && strlen(tupleType) > 127) {
+    fatalError("packPamChannels: tuple type '%s' is too long.\n", tupleType);
+  }
+  size_t nsamples = (size_t)width * height * depth;
+  uint8_t *samples = safeMalloc(2 * nsamples);
+  int minVal = INT_MAX, maxVal = INT_MIN;
+  for (int y = 0; y < height; y++) {
+    uint8_t *tuples = samples + 2 * (size_t)y * width * depth;
+    for (int c = 0; c < depth; c++) {
+      const int *row = planes[c][y];
+      uint8_t *dst = tuples + 2 * c;
+      for (int x = 0; x < width; x++) {
+        int val = row[x];
+        minVal = (val < minVal ? val : minVal);
+        maxVal = (val > maxVal ? val : maxVal);
+        storeBigEndianSample(dst, val);
+        dst += 2 * depth;
+      }
     }
-    fwrite(buf, 1, npixels, pgmFile);
-    free(buf);
   }
-  fclose(pgmFile);
+  PackedNetpbm packed;
+  int maxSample = (maxVal < 1 ? 1 : (maxVal > 65535 ? 65535 : maxVal));  // PAM requires MAXVAL >= 1
+  packed.data = samples;
+  packed.numBytes = narrowSamples(samples, nsamples, maxSample);
+  packed.headerLength = sprintf(packed.header, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL %d\n", width, height, depth,
+                                maxSample);
+  if (tupleType != NULL && tupleType[0] != '\0') {
+    packed.headerLength += sprintf(packed.header + packed.headerLength, "TUPLTYPE %s\n", tupleType);
+  }
+  packed.headerLength += sprintf(packed.header + packed.headerLength, "ENDHDR\n");
+  packed.minVal = minVal;
+  packed.maxVal = maxVal;
+  return packed;
+}
+
+/**
+ * Converts an image into the data of a raw (P4) PBM, packing every row straight from the pixels.
+ */
+static PackedNetpbm packIntImageP4(IntImage image) {
+  int width, height;
+  getWidthHeight(getIntImageDomain(image), &width, &height);
+  int rowBytes = (width + 7) / 8;
+  PackedNetpbm packed;
+  packed.numBytes = (size_t)rowBytes * height;
+  packed.data = safeCalloc(packed.numBytes);
+  for (int y = 0; y < height; y++) {
+    packPbmBits(image.pixels[y], packed.data + (size_t)y * rowBytes, width);
+  }
+  packed.headerLength = sprintf(packed.header, "P4\n%d %d\n", width, height);
+  return packed;
 }
 
 static void saveImagePGMasP2(const char *path, int width, int height, unsigned short *buffer) {
@@ -843,6 +1516,21 @@ static void saveImagePGMasP2(const char *path, int width, int height, unsigned s
   fclose(pgmFile);
 }
 
+static void warnClampedRange(const char *function, const char *path, int minVal, int maxVal, int maxSample) {
+  if ((minVal < 0) || (maxVal > maxSample)) {
+    warning("%s: range of image %s is [%d,%d]. Saved image values are clamped to [%d,%d]. \n", function, path, minVal,
+            maxVal, (minVal < 0 ? 0 : minVal), (maxVal > maxSample ? maxSample : maxVal));
+  }
+}
+
+static void savePamChannels(int **planes[], int depth, int width, int height, const char *tupleType,
+                            const char *function, const char *path) {
+  PackedNetpbm packed = packPamChannels(planes, depth, width, height, tupleType);
+  warnClampedRange(function, path, packed.minVal, packed.maxVal, 65535);
+  writeNetpbmFile(path, packed);
+  free(packed.data);
+}
+
 static void saveIntImagePGM(IntImage image, int magicNumber, const char *path) {
   ImageDomain domain = getIntImageDomain(image);
   int minX, maxX, minY, maxY, minVal, maxVal, width, height, npixels;
@@ -850,7 +1538,6 @@ static void saveIntImagePGM(IntImage image, int magicNumber, const char *path) {
   height = getHeight(domain);
   npixels = width * height;
   getImageDomainValues(getIntImageDomain(image), &minX, &maxX, &minY, &maxY);
-  getMinMax(image, &minVal, &maxVal);
 
   char *extension = getFileNameExtension(path);
   if (extension == NULL) {
@@ -858,14 +1545,15 @@ static void saveIntImagePGM(IntImage image, int magicNumber, const char *path) {
   }
 
   if (strcmp(extension, "pgm") == 0) {
-    if ((minVal < 0) || (maxVal > 65535)) {
-      int originalMinVal = minVal;
-      int originalMaxVal = maxVal;
-      if (minVal < 0) minVal = 0;
-      if (maxVal > 65535) maxVal = 65535;
-      warning("saveIntImagePGM: range of image %s is [%d,%d]. Saved image values are clamped to [%d,%d]. \n", path,
-              originalMinVal, originalMaxVal, minVal, maxVal);
+    if (magicNumber == 5) {
+      PackedNetpbm packed = packIntImageP5(image);
+      warnClampedRange("saveIntImagePGM", path, packed.minVal, packed.maxVal, 65535);
+      writeNetpbmFile(path, packed);
+      free(packed.data);
+      return;
     }
+    getMinMax(image, &minVal, &maxVal);
+    warnClampedRange("saveIntImagePGM", path, minVal, maxVal, 65535);
     unsigned short *buffer = malloc(npixels * sizeof(unsigned short));
     int idx = 0;
     for (int y = minY; y <= maxY; y++) {
@@ -875,11 +1563,7 @@ static void saveIntImagePGM(IntImage image, int magicNumber, const char *path) {
         buffer[idx++] = val;
       }
     }
-    if (magicNumber == 5) {
-      saveImagePGMasP5(path, width, height, buffer);
-    } else {
-      saveImagePGMasP2(path, width, height, buffer);
-    }
+    saveImagePGMasP2(path, width, height, buffer);
     free(buffer);
   }
 }
@@ -901,6 +1585,12 @@ static void saveIntImagePBM(IntImage image, int magicNumber, const char *path) {
     warning("saveIntImagePBM: range of image %s is [%d,%d]. Saved image values are clamped to [%d,%d]. \n", path,
             originalMinVal, originalMaxVal, minVal, maxVal);
   }
+  if (magicNumber == 4) {
+    PackedNetpbm packed = packIntImageP4(image);
+    writeNetpbmFile(path, packed);
+    free(packed.data);
+    return;
+  }
   uint8_t *buffer = malloc(npixels * sizeof(uint8_t));
 
   int idx = 0;
@@ -910,11 +1600,7 @@ static void saveIntImagePBM(IntImage image, int magicNumber, const char *path) {
       buffer[idx++] = (val < 0 ? 0 : (val == 0 ? 0 : 1));
     }
   }
-  if (magicNumber == 1) {
-    saveImagePBMasP1(path, width, height, buffer);
-  } else {
-    saveImagePBMasP4(path, width, height, buffer);
-  }
+  saveImagePBMasP1(path, width, height, buffer);
   free(buffer);
 }
 
@@ -935,9 +1621,33 @@ void saveIntImage(IntImage image, const char *path) {
     saveIntImagePGM(image, 5, path);
   } else if (strcmp(extension, "pbm") == 0) {
     saveIntImagePBM(image, 4, path);
+  } else if (strcmp(extension, "pam") == 0) {
+    int **planes[1] = {image.pixels};
+    savePamChannels(planes, 1, getWidth(image.domain), getHeight(image.domain), "GRAYSCALE", "saveIntImage", path);
   } else {
-    fatalError("saveIntImage: filename '%s' must have either pgm or pbm as extension. \n", path);
+    fatalError("saveIntImage: filename '%s' must have pgm, pbm or pam as extension. \n", path);
+  }
+}
+
+void saveIntImageChannels(const IntImage *channels, int depth, const char *tupleType, const char *path) {
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL || strcmp(extension, "pam") != 0) {
+    fatalError("saveIntImageChannels: filename '%s' must have pam as extension.\n", path);
+  }
+  if (depth < 1) {
+    fatalError("saveIntImageChannels: at least one channel is required.\n");
+  }
+  int width, height;
+  getWidthHeight(getIntImageDomain(channels[0]), &width, &height);
+  int ***planes = safeMalloc(depth * sizeof(int **));
+  for (int c = 0; c < depth; c++) {
+    if (getWidth(channels[c].domain) != width || getHeight(channels[c].domain) != height) {
+      fatalError("saveIntImageChannels: channel %d does not have the dimensions of channel 0.\n", c);
+    }
+    planes[c] = channels[c].pixels;
   }
+  savePamChannels(planes, depth, width, height, tupleType, "saveIntImageChannels", path);
+  free(planes);
 }
 
 /** Histogram ********************************************/
@@ -964,34 +1674,6 @@ Histogram createHistogram(IntImage image) {
   return histogram;
 }
 
-void createRgbHistograms(RgbImage image, Histogram *redHist, Histogram *greenHist, Histogram *blueHist) {
-  int minRange, maxRange;
-  getRgbDynamicRange(image, &minRange, &maxRange);
-
-  int histSize = maxRange - minRange + 1;
-  int *redFrequencies = safeCalloc(histSize * sizeof(int));
-  int *greenFrequencies = safeCalloc(histSize * sizeof(int));
-  int *blueFrequencies = safeCalloc(histSize * sizeof(int));
-  redHist->frequencies = redFrequencies;
-  redHist->minRange = minRange;
-  redHist->maxRange = maxRange;
-
-  greenHist->frequencies = greenFrequencies;
-  greenHist->minRange = minRange;
-  greenHist->maxRange = maxRange;
-
-  blueHist->frequencies = blueFrequencies;
-  blueHist->minRange = minRange;
-  blueHist->maxRange = maxRange;
-  forAllPixels(image.domain) {
-    int r, g, b;
-    getRgbPixelI(image, x, y, &r, &g, &b);
-    incrementHistogramFrequency(redHist, r);
-    incrementHistogramFrequency(greenHist, g);
-    incrementHistogramFrequency(blueHist, b);
-  }
-}
-
 Histogram createEmptyHistogram(int minRange, int maxRange) {
   int histSize = maxRange - minRange + 1;
   int *frequencies = safeCalloc(histSize * sizeof(int));
@@ -1094,8 +1776,42 @@ void freeRgbImage(RgbImage image) {
   free(image.blue);
 }
 
+RgbImage mergeIntImagesToRgb(IntImage red, IntImage green, IntImage blue) {
+  ImageDomain domain = red.domain;
+  if (memcmp(&domain, &green.domain, sizeof(ImageDomain)) != 0 ||
+      memcmp(&domain, &blue.domain, sizeof(ImageDomain)) != 0) {
+    fatalError("mergeIntImagesToRgb: the channels do not have the same domain.\n");
+  }
+  if (red.pixels == green.pixels || red.pixels == blue.pixels || green.pixels == blue.pixels) {
+    fatalError("mergeIntImagesToRgb: the same image is used for more than one channel.\n");
+  }
+  RgbImage image;
+  image.domain = domain;
+  image.red = red.pixels;
+  image.green = green.pixels;
+  image.blue = blue.pixels;
+  image.minRange = minOp(red.minRange, minOp(green.minRange, blue.minRange));
+  image.maxRange = maxOp(red.maxRange, maxOp(green.maxRange, blue.maxRange));
+  return image;
+}
+
 ImageDomain getRgbImageDomain(RgbImage image) { return image.domain; }
 
+static IntImage channelView(RgbImage image, int **channel) {
+  IntImage view;
+  view.domain = image.domain;
+  view.pixels = channel;
+  view.minRange = image.minRange;
+  view.maxRange = image.maxRange;
+  return view;
+}
+
+IntImage getRedChannelView(RgbImage image) { return channelView(image, image.red); }
+
+IntImage getGreenChannelView(RgbImage image) { return channelView(image, image.green); }
+
+IntImage getBlueChannelView(RgbImage image) { return channelView(image, image.blue); }
+
 void getRgbDynamicRange(RgbImage image, int *minRange, int *maxRange) {
   *minRange = image.minRange;
   *maxRange = image.maxRange;
@@ -1260,8 +1976,24 @@ void displayRgbImage(RgbImage image, const char *windowTitle) {
 
 /* ----------------------------- Image Loading + Saving ----------------------------- */
 
-static unsigned short *loadImagePPM(const char *path, int *width, int *height, int *maxVal) {
-  int magicNumber;
+/**
+ * Makes sure the image has the provided dimensions and dynamic range [0..maxVal]. The pixel memory of the image is
+ * reused when it already has the right dimensions. An image without pixel memory should have red == NULL.
+ */
+static void prepareRgbImage(RgbImage *image, int width, int height, int maxVal) {
+  if (image->red == NULL || getWidth(image->domain) != width || getHeight(image->domain) != height) {
+    if (image->red != NULL) {
+      freeRgbImage(*image);
+    }
+    *image = allocateRgbImage(width, height, 0, maxVal);
+  }
+  image->domain = initImageDomain(0, width - 1, 0, height - 1);
+  image->minRange = 0;
+  image->maxRange = maxVal;
+}
+
+static void loadImagePPM(const char *path, RgbImage *image) {
+  int magicNumber, width, height, maxVal;
   FILE *imgFile = fopen(path, "r");
   if (fscanf(imgFile, "P%d\n", &magicNumber) != 1) {
     fclose(imgFile);
@@ -1272,64 +2004,72 @@ static unsigned short *loadImagePPM(const char *path, int *width, int *height, i
     fclose(imgFile);
     fatalError("Illegal magic number P%d found. Only P3 and P6 are valid PPM files.\n", magicNumber);
   }
-  // skip comment lines
-  char c;
-  while ((c = fgetc(imgFile)) == '#') {
-    do {
-      c = fgetc(imgFile);
-    } while ((c != EOF) && (c != '\n'));
-    if (c == EOF) {
-      fatalError("loadImagePPM: corrupt PPM file.\n");
-    }
-  }
-  ungetc(c, imgFile);
+  skipNetpbmComments(imgFile, "loadImagePPM", "PPM");
 
   // read width and height
-  if (fscanf(imgFile, "%d %d", width, height) != 2) {
+  if (fscanf(imgFile, "%d %d", &width, &height) != 2) {
     fatalError("loadImagePPM: corrupt PPM: no file dimensions found.\n");
   }
-  if (fscanf(imgFile, "%d\n", maxVal) != 1) {
+  if (fscanf(imgFile, "%d", &maxVal) != 1 || fgetc(imgFile) == EOF) {
     fatalError("loadImagePPM: corrupt PPM file: no maximal grey value.\n");
   }
-  if ((*maxVal < 0) || (*maxVal > 65535)) {
-    fatalError("loadImagePPM: corrupt PPM: maximum value found is %d (must be in range [0..65535]).\n");
+  if ((maxVal < 0) || (maxVal > 65535)) {
+    fatalError("loadImagePPM: corrupt PPM: maximum value found is %d (must be in range [0..65535]).\n", maxVal);
   }
 
-  int npixels = (*width) * (*height);
-  unsigned short *buffer = malloc(3 * npixels * sizeof(short));
-  if (magicNumber == 3) {
-    int gval;
-    for (int i = 0; i < 3 * npixels; i++) {
-      if (fscanf(imgFile, "%d", &gval) != 1) {
-        fatalError("loadImagePPM: corrupt PPM: non numeric data found in PPM image (P3 type).\n");
-      }
-      if ((gval < 0) || (gval > *maxVal)) {
-        fatalError("loadImagePPM: pixel with value %d found. Valid dynamic range is [0..%d].\n", gval, *maxVal);
-      }
-      buffer[i] = gval;
-    }
-  } else {
-    // magicnumber == 6
-    if (*maxVal > 255) {  // 2 bytes per pixel, i.e. short
-      if (fread(buffer, 2, 3 * npixels, imgFile) != 3 * npixels) {
-        fatalError("loadImagePPM: corrupt PPM, file is truncated.\n");
+  prepareRgbImage(image, width, height, maxVal);
+  int *samples = safeMalloc(3 * width * sizeof(int));
+  int bytesPerSample = (maxVal > 255 ? 2 : 1);
+  uint8_t *raw = safeMalloc(3 * width * bytesPerSample);
+  for (int y = 0; y < height; y++) {
+    if (magicNumber == 3) {
+      for (int i = 0; i < 3 * width; i++) {
+        if (fscanf(imgFile, "%d", &samples[i]) != 1) {
+          fatalError("loadImagePPM: corrupt PPM: non numeric data found in PPM image (P3 type).\n");
+        }
+        if ((samples[i] < 0) || (samples[i] > maxVal)) {
+          fatalError("loadImagePPM: pixel with value %d found. Valid dynamic range is [0..%d].\n", samples[i], maxVal);
+        }
       }
-    } else {  // 1 byte per pixel
-      unsigned char *buf = malloc(3 * npixels * sizeof(unsigned char));
-      if (fread(buf, 1, 3 * npixels, imgFile) != 3 * npixels) {
+    } else {
+      // magicnumber == 6: rows are streamed through a small buffer and decoded straight into the image
+      if (fread(raw, bytesPerSample, 3 * width, imgFile) != (size_t)(3 * width)) {
         fatalError("loadImagePPM: corrupt PPM, file is truncated.\n");
       }
-      for (int i = 0; i < 3 * npixels; i++) {
-        buffer[i] = buf[i];
-      }
-      free(buf);
+      decodeNetpbmSamples(raw, samples, 3 * width, bytesPerSample);
+    }
+    int *r = image->red[y], *g = image->green[y], *b = image->blue[y];
+    for (int x = 0; x < width; x++) {
+      r[x] = samples[3 * x];
+      g[x] = samples[3 * x + 1];
+      b[x] = samples[3 * x + 2];
     }
   }
+  free(raw);
+  free(samples);
   fclose(imgFile);
-  return buffer;
 }
 
-RgbImage loadRgbImage(const char *path) {
+static void loadImagePAMRgb(const char *path, RgbImage *image) {
+  PamHeader header;
+  FILE *imgFile = fopen(path, "r");
+  readPamHeader(imgFile, path, &header);
+  // the alpha channel of an RGB_ALPHA file is skipped
+  if (header.depth != 3 && !(header.depth == 4 && strcmp(header.tupleType, "RGB_ALPHA") == 0)) {
+    fatalError("loadImagePAMRgb: %s has %d channels (%s). Use loadIntImageChannels to load it.\n", path, header.depth,
+               header.tupleType);
+  }
+  prepareRgbImage(image, header.width, header.height, header.maxVal);
+  int **planes[4] = {image->red, image->green, image->blue, NULL};
+  decodePamRaster(imgFile, path, header, planes);
+  fclose(imgFile);
+}
+
+/**
+ * Loads the image at path into the provided image. The pixel memory of the image is reused when it already has the
+ * dimensions of the file. Otherwise, (re)allocates the image. An image without pixel memory should have red == NULL.
+ */
+static void loadRgbImageInto(const char *path, RgbImage *image) {
   char *extension = getFileNameExtension(path);
   if (extension == NULL) {
     fatalError("loadRgbImage: filename '%s' has no extension.\n", path);
@@ -1340,26 +2080,19 @@ RgbImage loadRgbImage(const char *path) {
   }
   fclose(f);
 
-  int width, height, maxVal;
-  unsigned short *buf = NULL;
-
   if (strcmp("ppm", extension) == 0) {
-    buf = loadImagePPM(path, &width, &height, &maxVal);
+    loadImagePPM(path, image);
+  } else if (strcmp("pam", extension) == 0) {
+    loadImagePAMRgb(path, image);
   } else {
-    fatalError("loadRgbImage: filename '%s' must have ppm as extension.\n", path);
-  }
-  // copy buffer into image structure
-  RgbImage image = allocateRgbImage(width, height, 0, maxVal);
-  int idx = 0;
-  for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      int r = buf[idx++];
-      int g = buf[idx++];
-      int b = buf[idx++];
-      setRgbPixel(&image, x, y, r, g, b);
-    }
+    fatalError("loadRgbImage: filename '%s' must have ppm or pam as extension.\n", path);
   }
-  free(buf);
+}
+
+RgbImage loadRgbImage(const char *path) {
+  RgbImage image;
+  image.red = NULL;
+  loadRgbImageInto(path, &image);
   return image;
 }
 
@@ -1381,30 +2114,40 @@ static void getRgbMinMax(RgbImage image, int *minimalValue, int *maximalValue) {
   *maximalValue = maxVal;
 }
 
-static void saveImagePPMasP6(const char *path, int width, int height, unsigned short *buffer) {
-  FILE *ppmFile = fopen(path, "w");
-  if (ppmFile == NULL) {
-    fatalError("saveImagePPMasP6: failed to open file '%s'.\n", path);
-  }
-  fprintf(ppmFile, "P6\n%d %d\n", width, height);
-
-  int npixels = (width) * (height);
-  unsigned short max = buffer[0];
-  for (int i = 0; (i < 3 * npixels) && (max < 65535); i++) {
-    max = (buffer[i] > max ? buffer[i] : max);
-  }
-  fprintf(ppmFile, "%d\n", max);
-  if (max > 255) {
-    fwrite(buffer, 2, 3 * npixels, ppmFile);
-  } else {
-    unsigned char *buf = malloc(3 * npixels);
-    for (int i = 0; i < 3 * npixels; i++) {
-      buf[i] = buffer[i];
+/**
+ * Converts an image into the data of a raw (P6) PPM in one pass: the channels are interleaved, clamped to
+ * [0..65535] and packed, while the extremes are tracked for the header.
+ */
+static PackedNetpbm packRgbImageP6(RgbImage image) {
+  int width, height;
+  getWidthHeight(getRgbImageDomain(image), &width, &height);
+  size_t nsamples = 3 * (size_t)width * height;
+  uint8_t *samples = safeMalloc(2 * nsamples);
+  int minVal = INT_MAX, maxVal = INT_MIN;
+  uint8_t *dst = samples;
+  for (int y = 0; y < height; y++) {
+    const int *r = image.red[y], *g = image.green[y], *b = image.blue[y];
+    for (int x = 0; x < width; x++) {
+      int lo = (r[x] < g[x] ? r[x] : g[x]);
+      int hi = (r[x] > g[x] ? r[x] : g[x]);
+      lo = (b[x] < lo ? b[x] : lo);
+      hi = (b[x] > hi ? b[x] : hi);
+      minVal = (lo < minVal ? lo : minVal);
+      maxVal = (hi > maxVal ? hi : maxVal);
+      storeBigEndianSample(dst, r[x]);
+      storeBigEndianSample(dst + 2, g[x]);
+      storeBigEndianSample(dst + 4, b[x]);
+      dst += 6;
     }
-    fwrite(buf, 1, 3 * npixels, ppmFile);
-    free(buf);
   }
-  fclose(ppmFile);
+  PackedNetpbm packed;
+  int maxSample = (maxVal < 0 ? 0 : (maxVal > 65535 ? 65535 : maxVal));
+  packed.data = samples;
+  packed.numBytes = narrowSamples(samples, nsamples, maxSample);
+  packed.headerLength = sprintf(packed.header, "P6\n%d %d\n%d\n", width, height, maxSample);
+  packed.minVal = minVal;
+  packed.maxVal = maxVal;
+  return packed;
 }
 
 static void saveImagePPMasP3(const char *path, int width, int height, unsigned short *buffer) {
@@ -1442,7 +2185,6 @@ static void saveRgbImagePPM(RgbImage image, int magicNumber, const char *path) {
   height = getHeight(domain);
   npixels = width * height;
   getImageDomainValues(domain, &minX, &maxX, &minY, &maxY);
-  getRgbMinMax(image, &minVal, &maxVal);
 
   char *extension = getFileNameExtension(path);
   if (extension == NULL) {
@@ -1450,14 +2192,15 @@ static void saveRgbImagePPM(RgbImage image, int magicNumber, const char *path) {
   }
 
   if (strcmp(extension, "ppm") == 0) {
-    if ((minVal < 0) || (maxVal > 65535)) {
-      int originalMinVal = minVal;
-      int originalMaxVal = maxVal;
-      if (minVal < 0) minVal = 0;
-      if (maxVal > 65535) maxVal = 65535;
-      warning("saveRgbImagePPM: range of image %s is [%d,%d]. Saved image values are clamped to [%d,%d].\n", path,
-              originalMinVal, originalMaxVal, minVal, maxVal);
+    if (magicNumber == 6) {
+      PackedNetpbm packed = packRgbImageP6(image);
+      warnClampedRange("saveRgbImagePPM", path, packed.minVal, packed.maxVal, 65535);
+      writeNetpbmFile(path, packed);
+      free(packed.data);
+      return;
     }
+    getRgbMinMax(image, &minVal, &maxVal);
+    warnClampedRange("saveRgbImagePPM", path, minVal, maxVal, 65535);
     unsigned short *buffer = malloc(3 * npixels * sizeof(unsigned short));
     int idx = 0;
     for (int y = minY; y <= maxY; y++) {
@@ -1472,11 +2215,7 @@ static void saveRgbImagePPM(RgbImage image, int magicNumber, const char *path) {
         buffer[idx++] = b;
       }
     }
-    if (magicNumber == 6) {
-      saveImagePPMasP6(path, width, height, buffer);
-    } else {
-      saveImagePPMasP3(path, width, height, buffer);
-    }
+    saveImagePPMasP3(path, width, height, buffer);
     free(buffer);
   }
 }
@@ -1488,8 +2227,11 @@ void saveRgbImage(RgbImage image, const char *path) {
   }
   if (strcmp(extension, "ppm") == 0) {
     saveRgbImagePPM(image, 6, path);
+  } else if (strcmp(extension, "pam") == 0) {
+    int **planes[3] = {image.red, image.green, image.blue};
+    savePamChannels(planes, 3, getWidth(image.domain), getHeight(image.domain), "RGB", "saveRgbImage", path);
   } else {
-    fatalError("saveRgbImage: filename '%s' is not a ppm file.\n", path);
+    fatalError("saveRgbImage: filename '%s' must have ppm or pam as extension.\n", path);
   }
 }
 
@@ -1603,17 +2345,9 @@ void flipRgbImageHorizontal(RgbImage *image) {
   int width = getWidth(domain);
   int height = getHeight(domain);
   for (int y = 0; y < height; y++) {
-    for (int x = 0; x <= width / 2; x++) {
-      int a = image->red[y][x];
-      image->red[y][x] = image->red[y][width - x - 1];
-      image->red[y][width - x - 1] = a;
-      a = image->green[y][x];
-      image->green[y][x] = image->green[y][width - x - 1];
-      image->green[y][width - x - 1] = a;
-      a = image->blue[y][x];
-      image->blue[y][x] = image->blue[y][width - x - 1];
-      image->blue[y][width - x - 1] = a;
-    }
+    reverseIntRow(image->red[y], width);
+    reverseIntRow(image->green[y], width);
+    reverseIntRow(image->blue[y], width);
   }
   flipDomainHorizontal(getRgbImageDomainPtr(image));
 }
@@ -1622,20 +2356,14 @@ void flipRgbImageVertical(RgbImage *image) {
   ImageDomain domain = getRgbImageDomain(*image);
   int width = getWidth(domain);
   int height = getHeight(domain);
-  for (int y = 0; y <= height / 2; y++) {
-    for (int x = 0; x < width; x++) {
-      int a = image->red[y][x];
-      image->red[y][x] = image->red[height - y - 1][x];
-      image->red[height - y - 1][x] = a;
-      a = image->green[y][x];
-      image->green[y][x] = image->green[height - y - 1][x];
-      image->green[height - y - 1][x] = a;
-      a = image->blue[y][x];
-      image->blue[y][x] = image->blue[height - y - 1][x];
-      image->blue[height - y - 1][x] = a;
-    }
+  int *tmp = safeMalloc(width * sizeof(int));
+  for (int y = 0; y < height / 2; y++) {
+    swapIntRows(image->red[y], image->red[height - y - 1], tmp, width);
+    swapIntRows(image->green[y], image->green[height - y - 1], tmp, width);
+    swapIntRows(image->blue[y], image->blue[height - y - 1], tmp, width);
   }
-  flipDomainHorizontal(getRgbImageDomainPtr(image));
+  free(tmp);
+  flipDomainVertical(getRgbImageDomainPtr(image));
 }
 
 /* ----------------------------- Distance Transforms ----------------------------- */
@@ -1733,7 +2461,7 @@ static IntImage dtMeijsterRoerdinkHesselink(int takeSquareRoot, int foreground,
   /* vertical phase */
   int maskDx[1] = {0};
   int maskDy[1] = {-1};
-  IntImage verticalDT = maskDistanceTransform(2, maskDx, maskDy, foreground, im);
+  IntImage verticalDT = maskDistanceTransform(1, maskDx, maskDy, foreground, im);
 
   /* square the verticalDT */
   IntImage vdt = allocateIntImage(width, height, 0, infinity);
@@ -1758,7 +2486,9 @@ static IntImage dtMeijsterRoerdinkHesselink(int takeSquareRoot, int foreground,
       int vxy = getIntPixel(vdt, x, y);
       while ((q >= 0) && ((t[q] - s[q]) * (t[q] - s[q]) + vsq > (t[q] - x) * (t[q] - x) + vxy)) {
         q--;
-        vsq = getIntPixel(vdt, s[q], y);
+        if (q >= 0) {
+          vsq = getIntPixel(vdt, s[q], y);
+        }
       }
       if (q < 0) {
         q = 0;
@@ -1777,7 +2507,7 @@ static IntImage dtMeijsterRoerdinkHesselink(int takeSquareRoot, int foreground,
     if (takeSquareRoot) {
       for (int x = width - 1; x >= 0; x--) {
         setIntPixel(&dt, x, y, 0.5 + sqrt((x - s[q]) * (x - s[q]) + vsq));
-        if (x == t[q]) {
+        if (x == t[q] && q > 0) {
           q--;
           vsq = getIntPixel(vdt, s[q], y);
         }
@@ -1785,7 +2515,7 @@ static IntImage dtMeijsterRoerdinkHesselink(int takeSquareRoot, int foreground,
     } else {
       for (int x = width - 1; x >= 0; x--) {
         setIntPixel(&dt, x, y, (x - s[q]) * (x - s[q]) + vsq);
-        if (x == t[q]) {
+        if (x == t[q] && q > 0) {
           q--;
           vsq = getIntPixel(vdt, s[q], y);
         }
@@ -2019,27 +2749,124 @@ static IntImage complexRealValsToIntImage(ComplexImage image) {
   return reals;
 }
 
+/**
+ * Raw float maps store the pixel matrix of a double or complex image verbatim, in the style of the PFM format: a short
+ * ascii header ("PD" for doubles, "PZ" for complex values) with the dimensions, the origin of the domain, the dynamic
+ * range (as exact hexadecimal floats) and a scale whose sign gives the byte order (negative is little-endian). Unlike
+ * PFM, rows are stored top to bottom and values are doubles. The header is padded to a multiple of 16 bytes, so the
+ * data is aligned when the file is memory mapped.
+ */
+static void saveFloatMap(const char *path, char type, ImageDomain domain, double minRange, double maxRange,
+                         const void *data, size_t elemSize) {
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(domain, &minX, &maxX, &minY, &maxY);
+  uint16_t byteOrderProbe = 1;
+  int littleEndian = *(uint8_t *)&byteOrderProbe;
+  char header[256];
+  int length = sprintf(header, "P%c\n%d %d\n%d %d\n%a %a\n%s", type, maxX - minX + 1, maxY - minY + 1, minX, minY,
+                       minRange, maxRange, (littleEndian ? "-1.0" : "1.0"));
+  while ((length + 1) % 16 != 0) {
+    header[length++] = ' ';
+  }
+  header[length++] = '\n';
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    fatalError("saveFloatMap: failed to open file '%s'.\n", path);
+  }
+  size_t numElems = (size_t)(maxX - minX + 1) * (maxY - minY + 1);
+  // the pixel matrix is one contiguous block, so the data is written in one go
+  int ok = fwrite(header, 1, length, file) == (size_t)length && fwrite(data, elemSize, numElems, file) == numElems;
+  if (fclose(file) != 0 || !ok) {
+    fatalError("saveFloatMap: failed to write file '%s'.\n", path);
+  }
+}
+
+/**
+ * Reads the header of a raw float map and positions the file at the start of the data. Returns whether the data needs
+ * to be byte swapped.
+ */
+static int readFloatMapHeader(FILE *file, const char *path, char type, ImageDomain *domain, double *minRange,
+                              double *maxRange) {
+  char magic[3];
+  int width, height, minX, minY;
+  double scale;
+  if (fscanf(file, "%2s", magic) != 1 || magic[0] != 'P' || magic[1] != type || magic[2] != '\0') {
+    fatalError("readFloatMapHeader: '%s' is not a P%c float map.\n", path, type);
+  }
+  if (fscanf(file, "%d %d %d %d %la %la %lf", &width, &height, &minX, &minY, minRange, maxRange, &scale) != 7) {
+    fatalError("readFloatMapHeader: corrupt header in '%s'.\n", path);
+  }
+  int c;
+  while ((c = fgetc(file)) == ' ') {
+  }
+  if (c != '\n' || width < 1 || height < 1) {
+    fatalError("readFloatMapHeader: corrupt header in '%s'.\n", path);
+  }
+  *domain = initImageDomain(minX, minX + width - 1, minY, minY + height - 1);
+  uint16_t byteOrderProbe = 1;
+  int littleEndian = *(uint8_t *)&byteOrderProbe;
+  return (scale < 0) != littleEndian;
+}
+
+static void readFloatMapData(FILE *file, const char *path, int swapBytes, double *data, size_t numDoubles) {
+  if (fread(data, sizeof(double), numDoubles, file) != numDoubles) {
+    fatalError("readFloatMapData: '%s' is truncated.\n", path);
+  }
+  if (swapBytes) {
+    for (size_t i = 0; i < numDoubles; i++) {
+      uint64_t bits;
+      memcpy(&bits, data + i, sizeof(bits));
+      bits = __builtin_bswap64(bits);
+      memcpy(data + i, &bits, sizeof(bits));
+    }
+  }
+}
+
 void saveComplexImage(ComplexImage image, const char *path) {
   char *extension = getFileNameExtension(path);
   if (extension == NULL) {
-    fatalError("saveRgbImage: filename '%s' has no extension.\n", path);
+    fatalError("saveComplexImage: filename '%s' has no extension.\n", path);
   }
   if (strcmp(extension, "pgm") == 0) {
     IntImage realVals = complexRealValsToIntImage(image);
-    saveIntImagePGM(realVals, 6, path);
+    saveIntImagePGM(realVals, 5, path);
+    freeIntImage(realVals);
+  } else if (strcmp(extension, "cfm") == 0) {
+    saveFloatMap(path, 'Z', image.domain, 0, 0, image.pixels[0], sizeof(double complex));
   } else {
-    fatalError("saveRgbImage: filename '%s' is not a ppm file.\n", path);
+    fatalError("saveComplexImage: filename '%s' must have pgm or cfm as extension.\n", path);
+  }
+}
+
+ComplexImage loadComplexImage(const char *path) {
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL || strcmp(extension, "cfm") != 0) {
+    fatalError("loadComplexImage: filename '%s' must have cfm as extension.\n", path);
   }
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fatalError("loadComplexImage: failed to open file '%s'.\n", path);
+  }
+  ImageDomain domain;
+  double minRange, maxRange;
+  int swapBytes = readFloatMapHeader(file, path, 'Z', &domain, &minRange, &maxRange);
+  ComplexImage image = allocateComplexImageGridDomain(domain);
+  readFloatMapData(file, path, swapBytes, (double *)image.pixels[0], 2 * (size_t)getWidth(domain) * getHeight(domain));
+  fclose(file);
+  return image;
 }
 
 void saveComplexImagePGMRaw(ComplexImage image, const char *path) {
   IntImage realVals = complexRealValsToIntImage(image);
   saveIntImagePGM(realVals, 5, path);
+  freeIntImage(realVals);
 }
 
 void saveComplexImagePGMAscii(ComplexImage image, const char *path) {
   IntImage realVals = complexRealValsToIntImage(image);
   saveIntImagePGM(realVals, 2, path);
+  freeIntImage(realVals);
 }
 
 static void inplaceCooleyTukeyFFT1D(int length, double complex *a, double complex omega, double complex *wsp) {
@@ -2171,31 +2998,61 @@ IntImage ifft2D(ComplexImage image) {
   return im;
 }
 
-static void swapComplexPixels(ComplexImage *image, int x1, int y1, int x2, int y2) {
-  double complex val1 = getComplexPixel(*image, x1, y1);
-  double complex val2 = getComplexPixel(*image, x2, y2);
-  setComplexPixel(image, x1, y1, val2);
-  setComplexPixel(image, x2, y2, val1);
+// copies a row of width elements from src to dst while rotating it to the right by shift elements
+static void copyRotatedRow(char *dst, const char *src, size_t elemSize, int width, int shift) {
+  size_t tail = (size_t)(width - shift) * elemSize;
+  size_t head = (size_t)shift * elemSize;
+  memcpy(dst + head, src, tail);
+  memcpy(dst, src + tail, head);
+}
+
+/*
+ * Cyclically shifts the rows of a matrix so that element (x, y) ends up at ((x + shiftX) % width, (y + shiftY) %
+ * height). The rows are moved along the cycles of the row permutation, so every element is copied exactly once (plus
+ * one row per cycle through the buffer). The rows are moved physically instead of permuting the row pointers, since
+ * the rest of the library relies on pixels[0] being one contiguous block.
+ */
+static void shiftMatrix(void **rows, size_t elemSize, int width, int height, int shiftX, int shiftY) {
+  if ((shiftX == 0 && shiftY == 0) || width == 0 || height == 0) {
+    return;
+  }
+  char *buffer = safeMalloc(width * elemSize);
+  // the row permutation consists of gcd(height, shiftY) cycles
+  int numCycles = height;
+  for (int b = shiftY; b != 0;) {
+    int t = numCycles % b;
+    numCycles = b;
+    b = t;
+  }
+  int cycleLength = height / numCycles;
+  for (int start = 0; start < numCycles; start++) {
+    // walk the cycle backwards: the destination of each step is filled with its (rotated) source row
+    memcpy(buffer, rows[start], (size_t)width * elemSize);
+    int dst = start;
+    for (int i = 1; i < cycleLength; i++) {
+      int src = (dst - shiftY + height) % height;
+      copyRotatedRow(rows[dst], rows[src], elemSize, width, shiftX);
+      dst = src;
+    }
+    copyRotatedRow(rows[dst], buffer, elemSize, width, shiftX);
+  }
+  free(buffer);
 }
 
 // swaps quadrants so that DC component is centered
 void fft2Dshift(ComplexImage *image) {
-  ImageDomain domain = getComplexImageDomain(*image);
   int width, height;
-  getWidthHeight(domain, &width, &height);
-  int w2 = width / 2;
-  int h2 = height / 2;
-  for (int y = 0; y < h2; y++) {
-    for (int x = 0; x < w2; x++) {
-      // top left with bottom right
-      swapComplexPixels(image, x, y, x + w2, y + h2);
-      // top right with bottom left
-      swapComplexPixels(image, x + w2, y, x, y + h2);
-    }
-  }
+  getWidthHeight(getComplexImageDomain(*image), &width, &height);
+  shiftMatrix((void **)image->pixels, sizeof(double complex), width, height, width / 2, height / 2);
+}
+
+// inverse shift; differs from fft2Dshift for odd sizes
+void ifft2Dshift(ComplexImage *image) {
+  int width, height;
+  getWidthHeight(getComplexImageDomain(*image), &width, &height);
+  shiftMatrix((void **)image->pixels, sizeof(double complex), width, height, width - width / 2,
+              height - height / 2);
 }
-// inverse shift
-void ifft2Dshift(ComplexImage *image) { fft2Dshift(image); }
 
 static ComplexImage applyFunctionComplexImage(ComplexImage imageA, ComplexImage imageB, binaryOpComplex operator) {
   ComplexImage result = allocateFromComplexImage(imageA);
@@ -2421,6 +3278,32 @@ void printDoubleLatexTableToFile(FILE *out, DoubleImage image) {
   fprintf(out, "\\end{tabular}\n");
 }
 
+void saveDoubleImage(DoubleImage image, const char *path) {
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL || strcmp(extension, "dfm") != 0) {
+    fatalError("saveDoubleImage: filename '%s' must have dfm as extension.\n", path);
+  }
+  saveFloatMap(path, 'D', image.domain, image.minRange, image.maxRange, image.pixels[0], sizeof(double));
+}
+
+DoubleImage loadDoubleImage(const char *path) {
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL || strcmp(extension, "dfm") != 0) {
+    fatalError("loadDoubleImage: filename '%s' must have dfm as extension.\n", path);
+  }
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fatalError("loadDoubleImage: failed to open file '%s'.\n", path);
+  }
+  ImageDomain domain;
+  double minRange, maxRange;
+  int swapBytes = readFloatMapHeader(file, path, 'D', &domain, &minRange, &maxRange);
+  DoubleImage image = allocateDoubleImageGridDomain(domain, minRange, maxRange);
+  readFloatMapData(file, path, swapBytes, image.pixels[0], (size_t)getWidth(domain) * getHeight(domain));
+  fclose(file);
+  return image;
+}
+
 DoubleImage int2DoubleImg(IntImage image) {
   ImageDomain domain = getIntImageDomain(image);
   int minRange, maxRange;
@@ -2522,6 +3405,32 @@ DoubleImage ifft2DDouble(ComplexImage image) {
   return im;
 }
 
+// multiplies every pixel by (-1)^(x+y), which shifts the spectrum by half its size in both directions
+static void modulateCheckerboard(DoubleImage *image) {
+  int width, height;
+  getWidthHeight(getDoubleImageDomain(*image), &width, &height);
+  for (int y = 0; y < height; y++) {
+    double *row = image->pixels[y];
+    for (int x = 1 - (y & 1); x < width; x += 2) {
+      row[x] = -row[x];
+    }
+  }
+}
+
+ComplexImage fft2DDoubleCentered(DoubleImage image) {
+  DoubleImage modulated = copyDoubleImage(image);
+  modulateCheckerboard(&modulated);
+  ComplexImage ft = fft2DDouble(modulated);
+  freeDoubleImage(modulated);
+  return ft;
+}
+
+DoubleImage ifft2DDoubleCentered(ComplexImage image) {
+  DoubleImage im = ifft2DDouble(image);
+  modulateCheckerboard(&im);
+  return im;
+}
+
 /**
  * The Quack is a double ended queue (also known as Dequeue) datastructure that
  * allows for pushing and popping at either side of a list in O(1) time. The
@@ -2535,11 +3444,11 @@ typedef struct quack {
   int capacity;
 } Quack;
 
-inline int quackIsEmpty(Quack *quack) {
+static inline int quackIsEmpty(Quack *quack) {
   return quack->size == 0;
 }
 
-inline int quackPeekBack(Quack *quack) {
+static inline int quackPeekBack(Quack *quack) {
   return quack->buffer[(quack->end + quack->capacity - 1) % quack->capacity];
 }
 
@@ -2559,7 +3468,7 @@ static void quackPushBack(Quack *quack, int value) {
   quack->size++;
 }
 
-inline int quackPeekFront(Quack *quack) {
+static inline int quackPeekFront(Quack *quack) {
   return quack->buffer[quack->start];
 }
 
@@ -2656,17 +3565,17 @@ IntImage dilateErodeIntImageRect(IntImage image, int kw, int kh, int flag) {
     slidingWindowOrd(image.pixels[0], result.pixels[0], width, kw, flag, 1, row * width, memory);
   }
 
-  // next we make a copy of the result (because the algorithm does not run in place) and run the min/max operator on
-  // the columns of the image (skipping by a full column height each iteration)
-  IntImage copy = copyIntImage(result);
+  // next we run the min/max operator on the columns of the image. the columns are rows of the transposed image, so
+  // the sliding window walks over contiguous memory instead of skipping a full row width each iteration
+  IntImage copy = transposeIntImage(result);
+  IntImage filtered = allocateIntImageGridDomain(copy.domain, image.minRange, image.maxRange);
 
   for (int col = 0; col < width; col++) {
-    // in the below function call, the third last `height` parameter specifies the jump offset between iterations.
-    // there is a good chance that transposing the image twice will be faster due to row major indexing. we will
-    // need to benchmark this.
-    slidingWindowOrd(copy.pixels[0], result.pixels[0], height, kh, flag, height, col, memory);
+    slidingWindowOrd(copy.pixels[0], filtered.pixels[0], height, kh, flag, 1, col * height, memory);
   }
+  transposePixels(transposeIntStrips, (void **)filtered.pixels, (void **)result.pixels, height, width, 0, 0);
 
+  freeIntImage(filtered);
   freeIntImage(copy);
   free(memory);
 
@@ -2698,3 +3607,3978 @@ IntImage dilateIntImageRect(IntImage image, int kw, int kh) {
 IntImage erodeIntImageRect(IntImage image, int kw, int kh) {
   return dilateErodeIntImageRect(image, kw, kh, 0);
 }
+
+/** Image sequences ********************************************/
+
+enum { SLOT_FREE, SLOT_DECODING, SLOT_READY, SLOT_IN_USE };
+
+typedef struct SequenceSlot {
+  int frame;
+  int state;
+  IntImage intImage;
+  RgbImage rgbImage;
+} SequenceSlot;
+
+/**
+ * The frames are decoded by a number of background threads into a ring of slots. Frame f always goes into slot
+ * f % numSlots, so a decoder can only start on frame f once frame f - numSlots has been released by the consumer.
+ * The image memory of a slot is allocated when it is filled for the first time, and reused for all later frames of
+ * the same size.
+ */
+struct ImageSequenceReader {
+  char **paths;
+  int numPaths;
+  int isRgb;
+  SequenceSlot *slots;
+  int numSlots;
+  int nextToDecode, nextToDeliver;
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  pthread_t *threads;
+  int numThreads;
+};
+
+static void *sequenceDecoder(void *arg) {
+  ImageSequenceReader *reader = arg;
+  pthread_mutex_lock(&reader->lock);
+  while (!reader->stop && reader->nextToDecode < reader->numPaths) {
+    int frame = reader->nextToDecode;
+    SequenceSlot *slot = &reader->slots[frame % reader->numSlots];
+    if (slot->state != SLOT_FREE) {
+      pthread_cond_wait(&reader->changed, &reader->lock);
+      continue;
+    }
+    reader->nextToDecode++;
+    slot->frame = frame;
+    slot->state = SLOT_DECODING;
+    pthread_mutex_unlock(&reader->lock);
+    if (reader->isRgb) {
+      loadRgbImageInto(reader->paths[frame], &slot->rgbImage);
+    } else {
+      loadIntImageInto(reader->paths[frame], &slot->intImage);
+    }
+    pthread_mutex_lock(&reader->lock);
+    slot->state = SLOT_READY;
+    pthread_cond_broadcast(&reader->changed);
+  }
+  pthread_mutex_unlock(&reader->lock);
+  return NULL;
+}
+
+static ImageSequenceReader *openImageSequence(const char **paths, int numPaths, int numBuffers, int isRgb) {
+  if (numPaths < 0 || numBuffers < 1) {
+    fatalError("openImageSequence: invalid number of paths (%d) or buffers (%d).\n", numPaths, numBuffers);
+  }
+  ImageSequenceReader *reader = safeMalloc(sizeof(ImageSequenceReader));
+  reader->numPaths = numPaths;
+  reader->paths = safeMalloc((numPaths > 0 ? numPaths : 1) * sizeof(char *));
+  for (int i = 0; i < numPaths; i++) {
+    reader->paths[i] = safeMalloc(strlen(paths[i]) + 1);
+    strcpy(reader->paths[i], paths[i]);
+  }
+  reader->isRgb = isRgb;
+  reader->numSlots = numBuffers;
+  reader->slots = safeCalloc(numBuffers * sizeof(SequenceSlot));
+  for (int i = 0; i < numBuffers; i++) {
+    reader->slots[i].state = SLOT_FREE;
+    reader->slots[i].intImage.pixels = NULL;
+    reader->slots[i].rgbImage.red = NULL;
+  }
+  reader->nextToDecode = reader->nextToDeliver = 0;
+  reader->stop = 0;
+  pthread_mutex_init(&reader->lock, NULL);
+  pthread_cond_init(&reader->changed, NULL);
+
+  // one of the buffers is typically held by the consumer, so more decoders than that would only wait
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  reader->numThreads = (numBuffers > 1 ? numBuffers - 1 : 1);
+  reader->numThreads = (cpus > 0 && reader->numThreads > cpus ? cpus : reader->numThreads);
+  reader->threads = safeMalloc(reader->numThreads * sizeof(pthread_t));
+  for (int i = 0; i < reader->numThreads; i++) {
+    if (pthread_create(&reader->threads[i], NULL, sequenceDecoder, reader) != 0) {
+      fatalError("openImageSequence: failed to start decoder thread.\n");
+    }
+  }
+  return reader;
+}
+
+ImageSequenceReader *openIntImageSequence(const char **paths, int numPaths, int numBuffers) {
+  return openImageSequence(paths, numPaths, numBuffers, 0);
+}
+
+ImageSequenceReader *openRgbImageSequence(const char **paths, int numPaths, int numBuffers) {
+  return openImageSequence(paths, numPaths, numBuffers, 1);
+}
+
+static SequenceSlot *nextSequenceSlot(ImageSequenceReader *reader) {
+  pthread_mutex_lock(&reader->lock);
+  if (reader->nextToDeliver >= reader->numPaths) {
+    pthread_mutex_unlock(&reader->lock);
+    return NULL;
+  }
+  int frame = reader->nextToDeliver;
+  SequenceSlot *slot = &reader->slots[frame % reader->numSlots];
+  while (slot->frame != frame || slot->state != SLOT_READY) {
+    if (slot->state == SLOT_IN_USE) {
+      pthread_mutex_unlock(&reader->lock);
+      fatalError("nextImage: all %d buffers of the image sequence are in use. Release frames before requesting more.\n",
+                 reader->numSlots);
+    }
+    pthread_cond_wait(&reader->changed, &reader->lock);
+  }
+  slot->state = SLOT_IN_USE;
+  reader->nextToDeliver++;
+  pthread_mutex_unlock(&reader->lock);
+  return slot;
+}
+
+int nextIntImage(ImageSequenceReader *reader, IntImage *image) {
+  if (reader->isRgb) {
+    fatalError("nextIntImage: the sequence was opened as an rgb image sequence.\n");
+  }
+  SequenceSlot *slot = nextSequenceSlot(reader);
+  if (slot == NULL) {
+    return 0;
+  }
+  *image = slot->intImage;
+  return 1;
+}
+
+int nextRgbImage(ImageSequenceReader *reader, RgbImage *image) {
+  if (!reader->isRgb) {
+    fatalError("nextRgbImage: the sequence was opened as an int image sequence.\n");
+  }
+  SequenceSlot *slot = nextSequenceSlot(reader);
+  if (slot == NULL) {
+    return 0;
+  }
+  *image = slot->rgbImage;
+  return 1;
+}
+
+static void releaseSequenceSlot(ImageSequenceReader *reader, void *pixels) {
+  pthread_mutex_lock(&reader->lock);
+  for (int i = 0; i < reader->numSlots; i++) {
+    SequenceSlot *slot = &reader->slots[i];
+    void *slotPixels = (reader->isRgb ? (void *)slot->rgbImage.red : (void *)slot->intImage.pixels);
+    if (slot->state == SLOT_IN_USE && slotPixels == pixels) {
+      slot->state = SLOT_FREE;
+      pthread_cond_broadcast(&reader->changed);
+      pthread_mutex_unlock(&reader->lock);
+      return;
+    }
+  }
+  pthread_mutex_unlock(&reader->lock);
+  fatalError("releaseImage: image does not belong to this image sequence or was already released.\n");
+}
+
+void releaseIntImage(ImageSequenceReader *reader, IntImage image) { releaseSequenceSlot(reader, image.pixels); }
+
+void releaseRgbImage(ImageSequenceReader *reader, RgbImage image) { releaseSequenceSlot(reader, image.red); }
+
+void closeImageSequence(ImageSequenceReader *reader) {
+  pthread_mutex_lock(&reader->lock);
+  reader->stop = 1;
+  pthread_cond_broadcast(&reader->changed);
+  pthread_mutex_unlock(&reader->lock);
+  for (int i = 0; i < reader->numThreads; i++) {
+    pthread_join(reader->threads[i], NULL);
+  }
+  for (int i = 0; i < reader->numSlots; i++) {
+    if (reader->slots[i].intImage.pixels != NULL) {
+      freeIntImage(reader->slots[i].intImage);
+    }
+    if (reader->slots[i].rgbImage.red != NULL) {
+      freeRgbImage(reader->slots[i].rgbImage);
+    }
+  }
+  for (int i = 0; i < reader->numPaths; i++) {
+    free(reader->paths[i]);
+  }
+  pthread_cond_destroy(&reader->changed);
+  pthread_mutex_destroy(&reader->lock);
+  free(reader->threads);
+  free(reader->slots);
+  free(reader->paths);
+  free(reader);
+}
+
+/** Asynchronous saving ********************************************/
+
+typedef struct SaveRequest {
+  int isRgb;
+  IntImage intImage;
+  RgbImage rgbImage;
+  char *path;
+} SaveRequest;
+
+/**
+ * Save requests are queued in a bounded ring buffer and written in order by a single background thread. Queueing
+ * blocks when the ring is full, so a slow disk throttles the producer instead of letting the queue grow unbounded.
+ */
+struct ImageSaver {
+  SaveRequest *queue;
+  int capacity, head, count;
+  int busy;  // 1 while the writer thread is saving a request that has already left the queue
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty, notFull, idle;
+  pthread_t thread;
+};
+
+static void *imageSaverThread(void *arg) {
+  ImageSaver *saver = arg;
+  pthread_mutex_lock(&saver->lock);
+  for (;;) {
+    while (saver->count == 0 && !saver->stop) {
+      pthread_cond_wait(&saver->notEmpty, &saver->lock);
+    }
+    if (saver->count == 0) {
+      break;
+    }
+    SaveRequest request = saver->queue[saver->head];
+    saver->head = (saver->head + 1) % saver->capacity;
+    saver->count--;
+    saver->busy = 1;
+    pthread_cond_signal(&saver->notFull);
+    pthread_mutex_unlock(&saver->lock);
+
+    if (request.isRgb) {
+      saveRgbImage(request.rgbImage, request.path);
+      freeRgbImage(request.rgbImage);
+    } else {
+      saveIntImage(request.intImage, request.path);
+      freeIntImage(request.intImage);
+    }
+    free(request.path);
+
+    pthread_mutex_lock(&saver->lock);
+    saver->busy = 0;
+    if (saver->count == 0) {
+      pthread_cond_broadcast(&saver->idle);
+    }
+  }
+  pthread_mutex_unlock(&saver->lock);
+  return NULL;
+}
+
+ImageSaver *createImageSaver(int maxQueued) {
+  if (maxQueued < 1) {
+    fatalError("createImageSaver: the queue should be able to hold at least 1 image (got %d).\n", maxQueued);
+  }
+  ImageSaver *saver = safeMalloc(sizeof(ImageSaver));
+  saver->queue = safeMalloc(maxQueued * sizeof(SaveRequest));
+  saver->capacity = maxQueued;
+  saver->head = saver->count = 0;
+  saver->busy = saver->stop = 0;
+  pthread_mutex_init(&saver->lock, NULL);
+  pthread_cond_init(&saver->notEmpty, NULL);
+  pthread_cond_init(&saver->notFull, NULL);
+  pthread_cond_init(&saver->idle, NULL);
+  if (pthread_create(&saver->thread, NULL, imageSaverThread, saver) != 0) {
+    fatalError("createImageSaver: failed to start writer thread.\n");
+  }
+  return saver;
+}
+
+static void queueSaveRequest(ImageSaver *saver, SaveRequest request, const char *path) {
+  request.path = safeMalloc(strlen(path) + 1);
+  strcpy(request.path, path);
+  pthread_mutex_lock(&saver->lock);
+  while (saver->count == saver->capacity) {
+    pthread_cond_wait(&saver->notFull, &saver->lock);
+  }
+  saver->queue[(saver->head + saver->count) % saver->capacity] = request;
+  saver->count++;
+  pthread_cond_signal(&saver->notEmpty);
+  pthread_mutex_unlock(&saver->lock);
+}
+
+void queueIntImageSave(ImageSaver *saver, IntImage image, const char *path) {
+  // validate here, so that mistakes are reported at the call site rather than later on the writer thread
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL ||
+      (strcmp(extension, "pgm") != 0 && strcmp(extension, "pbm") != 0 && strcmp(extension, "pam") != 0)) {
+    fatalError("queueIntImageSave: filename '%s' must have pgm, pbm or pam as extension.\n", path);
+  }
+  SaveRequest request;
+  request.isRgb = 0;
+  request.intImage = image;
+  queueSaveRequest(saver, request, path);
+}
+
+void queueRgbImageSave(ImageSaver *saver, RgbImage image, const char *path) {
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL || (strcmp(extension, "ppm") != 0 && strcmp(extension, "pam") != 0)) {
+    fatalError("queueRgbImageSave: filename '%s' must have ppm or pam as extension.\n", path);
+  }
+  SaveRequest request;
+  request.isRgb = 1;
+  request.rgbImage = image;
+  queueSaveRequest(saver, request, path);
+}
+
+void flushImageSaver(ImageSaver *saver) {
+  pthread_mutex_lock(&saver->lock);
+  while (saver->count > 0 || saver->busy) {
+    pthread_cond_wait(&saver->idle, &saver->lock);
+  }
+  pthread_mutex_unlock(&saver->lock);
+}
+
+void closeImageSaver(ImageSaver *saver) {
+  pthread_mutex_lock(&saver->lock);
+  saver->stop = 1;
+  pthread_cond_signal(&saver->notEmpty);
+  pthread_mutex_unlock(&saver->lock);
+  // the writer thread drains the queue before it stops
+  pthread_join(saver->thread, NULL);
+  pthread_cond_destroy(&saver->idle);
+  pthread_cond_destroy(&saver->notFull);
+  pthread_cond_destroy(&saver->notEmpty);
+  pthread_mutex_destroy(&saver->lock);
+  free(saver->queue);
+  free(saver);
+}
+
+/** Tiled image files ********************************************/
+
+#define TILED_MAGIC "IMPTILE"
+#define TILED_BYTE_ORDER 0x01020304u
+
+/**
+ * On-disk header of a tiled image file. It is followed by an index with the offset and size of every tile (in
+ * row-major tile order) and then by the tiles themselves. All values are stored in the byte order of the machine that
+ * wrote the file.
+ */
+typedef struct TiledFileHeader {
+  char magic[8];
+  uint32_t byteOrder;
+  uint32_t pixelType;
+  int32_t minX, maxX, minY, maxY;
+  double minRange, maxRange;
+  uint32_t tileWidth, tileHeight;
+  uint32_t compression;
+  uint32_t numTiles;
+} TiledFileHeader;
+
+typedef struct TileIndexEntry {
+  uint64_t offset;
+  uint64_t size;  // a tile is stored uncompressed iff its size equals the raw size of the tile
+} TileIndexEntry;
+
+struct TiledImageFile {
+  uint8_t *data;  // mmapped file
+  size_t size;
+  TiledFileHeader header;
+  const TileIndexEntry *index;
+  int tilesX, tilesY;
+};
+
+/**
+ * One channel of an image as seen by the tile codec: a grid of words of wordSize bytes. Pixel (x, y) of the channel
+ * starts at base + y * rowStride + x * pixelStride.
+ */
+typedef struct TilePlane {
+  uint8_t *base;
+  size_t pixelStride, rowStride;
+} TilePlane;
+
+static int tiledWordSize(int pixelType) { return (pixelType == DOUBLE_PIXELS || pixelType == COMPLEX_PIXELS ? 8 : 4); }
+
+static int tiledNumPlanes(int pixelType) {
+  return (pixelType == RGB_PIXELS ? 3 : (pixelType == COMPLEX_PIXELS ? 2 : 1));
+}
+
+static TilePlane initTilePlane(void *pixels, size_t pixelStride, int width) {
+  TilePlane plane;
+  plane.base = pixels;
+  plane.pixelStride = pixelStride;
+  plane.rowStride = pixelStride * width;
+  return plane;
+}
+
+/**
+ * Copies the tile [x0..x0+w) x [y0..y0+h) of each plane into raw, plane after plane and row after row.
+ */
+static void gatherTile(const TilePlane *planes, int numPlanes, int wordSize, int x0, int y0, int w, int h,
+                       uint8_t *raw) {
+  for (int p = 0; p < numPlanes; p++) {
+    for (int y = 0; y < h; y++) {
+      const uint8_t *src = planes[p].base + (y0 + y) * planes[p].rowStride + x0 * planes[p].pixelStride;
+      if (planes[p].pixelStride == (size_t)wordSize) {
+        memcpy(raw, src, (size_t)w * wordSize);
+        raw += (size_t)w * wordSize;
+        continue;
+      }
+      for (int x = 0; x < w; x++) {
+        memcpy(raw, src, wordSize);
+        raw += wordSize;
+        src += planes[p].pixelStride;
+      }
+    }
+  }
+}
+
+static void scatterTile(const uint8_t *raw, const TilePlane *planes, int numPlanes, int wordSize, int w, int h) {
+  for (int p = 0; p < numPlanes; p++) {
+    for (int y = 0; y < h; y++) {
+      uint8_t *dst = planes[p].base + y * planes[p].rowStride;
+      if (planes[p].pixelStride == (size_t)wordSize) {
+        memcpy(dst, raw, (size_t)w * wordSize);
+        raw += (size_t)w * wordSize;
+        continue;
+      }
+      for (int x = 0; x < w; x++) {
+        memcpy(dst, raw, wordSize);
+        raw += wordSize;
+        dst += planes[p].pixelStride;
+      }
+    }
+  }
+}
+
+static inline uint64_t loadTileWord(const uint8_t *src, int wordSize) {
+  if (wordSize == 4) {
+    uint32_t word;
+    memcpy(&word, src, 4);
+    return word;
+  }
+  uint64_t word;
+  memcpy(&word, src, 8);
+  return word;
+}
+
+static inline void storeTileWord(uint8_t *dst, uint64_t word, int wordSize) {
+  if (wordSize == 4) {
+    uint32_t narrow = (uint32_t)word;
+    memcpy(dst, &narrow, 4);
+  } else {
+    memcpy(dst, &word, 8);
+  }
+}
+
+static inline uint8_t *putVarint(uint8_t *dst, uint64_t val) {
+  while (val >= 0x80) {
+    *dst++ = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  *dst++ = (uint8_t)val;
+  return dst;
+}
+
+static const uint8_t *getVarint(const uint8_t *src, const uint8_t *end, uint64_t *val) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && src < end; shift += 7) {
+    uint8_t byte = *src++;
+    result |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *val = result;
+      return src;
+    }
+  }
+  return NULL;  // truncated or overlong
+}
+
+/**
+ * Delta + run-length codec for tiles. Every row of every plane is delta coded (words are subtracted modulo 2^bits,
+ * which is lossless for integer as well as floating point bit patterns) and the deltas are zigzag mapped, so that
+ * small differences of either sign become small numbers. The stream then consists of pairs (number of zero deltas,
+ * next non-zero delta), each a LEB128 varint, optionally ended by a final run of zeros. Flat regions therefore cost a
+ * few bytes per run and smooth regions about 1-2 bytes per sample. Returns the number of bytes written to out, which
+ * must have room for 11 bytes per word.
+ */
+static size_t encodeTile(const uint8_t *raw, int numRows, int w, int wordSize, uint8_t *out) {
+  int bits = 8 * wordSize;
+  uint64_t mask = (wordSize == 8 ? UINT64_MAX : UINT32_MAX);
+  uint8_t *dst = out;
+  uint64_t run = 0;
+  for (int y = 0; y < numRows; y++) {
+    uint64_t prev = 0;
+    for (int x = 0; x < w; x++) {
+      uint64_t word = loadTileWord(raw, wordSize);
+      raw += wordSize;
+      uint64_t delta = (word - prev) & mask;
+      prev = word;
+      uint64_t sign = (delta >> (bits - 1)) & 1;
+      uint64_t zigzag = ((delta << 1) & mask) ^ (sign ? mask : 0);
+      if (zigzag == 0) {
+        run++;
+        continue;
+      }
+      dst = putVarint(dst, run);
+      dst = putVarint(dst, zigzag);
+      run = 0;
+    }
+  }
+  if (run > 0) {
+    dst = putVarint(dst, run);
+  }
+  return dst - out;
+}
+
+static void decodeTile(const uint8_t *src, size_t size, int numRows, int w, int wordSize, uint8_t *raw) {
+  const uint8_t *end = src + size;
+  uint64_t mask = (wordSize == 8 ? UINT64_MAX : UINT32_MAX);
+  uint64_t numWords = (uint64_t)numRows * w;
+  uint64_t count = 0;
+  uint8_t *dst = raw;
+  // first expand the stream into zigzagged deltas
+  while (count < numWords) {
+    uint64_t run, zigzag;
+    src = getVarint(src, end, &run);
+    if (src == NULL || run > numWords - count) {
+      fatalError("decodeTile: corrupt tile data.\n");
+    }
+    memset(dst, 0, run * wordSize);
+    dst += run * wordSize;
+    count += run;
+    if (count == numWords) {
+      break;
+    }
+    src = getVarint(src, end, &zigzag);
+    if (src == NULL) {
+      fatalError("decodeTile: corrupt tile data.\n");
+    }
+    storeTileWord(dst, zigzag, wordSize);
+    dst += wordSize;
+    count++;
+  }
+  // then undo the zigzag mapping and the delta coding of every row
+  for (int y = 0; y < numRows; y++) {
+    uint64_t prev = 0;
+    for (int x = 0; x < w; x++) {
+      uint64_t zigzag = loadTileWord(raw, wordSize);
+      uint64_t delta = (zigzag >> 1) ^ (zigzag & 1 ? mask : 0);
+      prev = (prev + delta) & mask;
+      storeTileWord(raw, prev, wordSize);
+      raw += wordSize;
+    }
+  }
+}
+
+static void saveTiledImage(const char *path, int pixelType, ImageDomain domain, double minRange, double maxRange,
+                           const TilePlane *planes, int tileSize, int compression) {
+  if (tileSize < 1) {
+    fatalError("saveTiledImage: tile size must be positive, but is %d.\n", tileSize);
+  }
+  if (compression != TILE_UNCOMPRESSED && compression != TILE_DELTA_RLE) {
+    fatalError("saveTiledImage: unknown compression %d.\n", compression);
+  }
+  int width, height;
+  getWidthHeight(domain, &width, &height);
+  int tileW = (tileSize < width ? tileSize : width);
+  int tileH = (tileSize < height ? tileSize : height);
+  int tilesX = (width + tileW - 1) / tileW;
+  int tilesY = (height + tileH - 1) / tileH;
+  int wordSize = tiledWordSize(pixelType);
+  int numPlanes = tiledNumPlanes(pixelType);
+
+  TiledFileHeader header;
+  memset(&header, 0, sizeof(header));
+  strcpy(header.magic, TILED_MAGIC);
+  header.byteOrder = TILED_BYTE_ORDER;
+  header.pixelType = pixelType;
+  getImageDomainValues(domain, &header.minX, &header.maxX, &header.minY, &header.maxY);
+  header.minRange = minRange;
+  header.maxRange = maxRange;
+  header.tileWidth = tileW;
+  header.tileHeight = tileH;
+  header.compression = compression;
+  header.numTiles = tilesX * tilesY;
+
+  FILE *file = fopen(path, "wb");
+  if (file == NULL) {
+    fatalError("saveTiledImage: failed to open file '%s'.\n", path);
+  }
+  TileIndexEntry *index = safeCalloc(header.numTiles * sizeof(TileIndexEntry));
+  size_t maxRawSize = (size_t)tileW * tileH * numPlanes * wordSize;
+  uint8_t *raw = safeMalloc(maxRawSize);
+  uint8_t *packed = (compression == TILE_DELTA_RLE ? safeMalloc(11 * maxRawSize / wordSize) : NULL);
+  // the index is written as a placeholder first and filled in at the end
+  int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(index, sizeof(TileIndexEntry), header.numTiles, file) == header.numTiles;
+  uint64_t offset = sizeof(header) + header.numTiles * sizeof(TileIndexEntry);
+  for (int t = 0; ok && t < (int)header.numTiles; t++) {
+    int x0 = (t % tilesX) * tileW;
+    int y0 = (t / tilesX) * tileH;
+    int w = (x0 + tileW <= width ? tileW : width - x0);
+    int h = (y0 + tileH <= height ? tileH : height - y0);
+    size_t rawSize = (size_t)w * h * numPlanes * wordSize;
+    gatherTile(planes, numPlanes, wordSize, x0, y0, w, h, raw);
+    const uint8_t *tile = raw;
+    size_t size = rawSize;
+    if (packed != NULL) {
+      size_t packedSize = encodeTile(raw, h * numPlanes, w, wordSize, packed);
+      if (packedSize < rawSize) {  // incompressible tiles are kept raw
+        tile = packed;
+        size = packedSize;
+      }
+    }
+    index[t].offset = offset;
+    index[t].size = size;
+    offset += size;
+    ok = fwrite(tile, 1, size, file) == size;
+  }
+  ok = ok && fseek(file, sizeof(header), SEEK_SET) == 0 &&
+       fwrite(index, sizeof(TileIndexEntry), header.numTiles, file) == header.numTiles;
+  if (fclose(file) != 0 || !ok) {
+    fatalError("saveTiledImage: failed to write file '%s'.\n", path);
+  }
+  free(packed);
+  free(raw);
+  free(index);
+}
+
+void saveIntImageTiled(IntImage image, const char *path, int tileSize, int compression) {
+  TilePlane plane = initTilePlane(image.pixels[0], sizeof(int), getWidth(image.domain));
+  saveTiledImage(path, INT_PIXELS, image.domain, image.minRange, image.maxRange, &plane, tileSize, compression);
+}
+
+void saveRgbImageTiled(RgbImage image, const char *path, int tileSize, int compression) {
+  int width = getWidth(image.domain);
+  TilePlane planes[3] = {initTilePlane(image.red[0], sizeof(int), width),
+                         initTilePlane(image.green[0], sizeof(int), width),
+                         initTilePlane(image.blue[0], sizeof(int), width)};
+  saveTiledImage(path, RGB_PIXELS, image.domain, image.minRange, image.maxRange, planes, tileSize, compression);
+}
+
+void saveDoubleImageTiled(DoubleImage image, const char *path, int tileSize, int compression) {
+  TilePlane plane = initTilePlane(image.pixels[0], sizeof(double), getWidth(image.domain));
+  saveTiledImage(path, DOUBLE_PIXELS, image.domain, image.minRange, image.maxRange, &plane, tileSize, compression);
+}
+
+void saveComplexImageTiled(ComplexImage image, const char *path, int tileSize, int compression) {
+  // the real and imaginary parts are stored as separate planes, which compress better than interleaved values
+  int width = getWidth(image.domain);
+  TilePlane planes[2] = {initTilePlane(image.pixels[0], sizeof(double complex), width),
+                         initTilePlane((double *)image.pixels[0] + 1, sizeof(double complex), width)};
+  saveTiledImage(path, COMPLEX_PIXELS, image.domain, 0, 0, planes, tileSize, compression);
+}
+
+TiledImageFile *openTiledImage(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fatalError("openTiledImage: failed to open file '%s'.\n", path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TiledFileHeader)) {
+    close(fd);
+    fatalError("openTiledImage: '%s' is not a tiled image file.\n", path);
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fatalError("openTiledImage: failed to map file '%s'.\n", path);
+  }
+  TiledImageFile *file = safeMalloc(sizeof(TiledImageFile));
+  file->data = data;
+  file->size = st.st_size;
+  memcpy(&file->header, data, sizeof(TiledFileHeader));
+  TiledFileHeader *header = &file->header;
+  if (memcmp(header->magic, TILED_MAGIC, sizeof(TILED_MAGIC)) != 0) {
+    fatalError("openTiledImage: '%s' is not a tiled image file.\n", path);
+  }
+  if (header->byteOrder != TILED_BYTE_ORDER) {
+    fatalError("openTiledImage: '%s' was written on a machine with a different byte order.\n", path);
+  }
+  if (header->pixelType > COMPLEX_PIXELS || header->compression > TILE_DELTA_RLE || header->minX > header->maxX ||
+      header->minY > header->maxY || header->tileWidth < 1 || header->tileHeight < 1) {
+    fatalError("openTiledImage: corrupt header in '%s'.\n", path);
+  }
+  int width = header->maxX - header->minX + 1;
+  int height = header->maxY - header->minY + 1;
+  file->tilesX = (width + header->tileWidth - 1) / header->tileWidth;
+  file->tilesY = (height + header->tileHeight - 1) / header->tileHeight;
+  size_t indexEnd = sizeof(TiledFileHeader) + (size_t)header->numTiles * sizeof(TileIndexEntry);
+  if ((int)header->numTiles != file->tilesX * file->tilesY || indexEnd > file->size) {
+    fatalError("openTiledImage: corrupt tile index in '%s'.\n", path);
+  }
+  file->index = (const TileIndexEntry *)(file->data + sizeof(TiledFileHeader));
+  for (uint32_t t = 0; t < header->numTiles; t++) {
+    if (file->index[t].offset > file->size || file->index[t].size > file->size - file->index[t].offset) {
+      fatalError("openTiledImage: tile %u lies outside of '%s'.\n", t, path);
+    }
+  }
+  return file;
+}
+
+TiledImageInfo getTiledImageInfo(TiledImageFile *file) {
+  TiledFileHeader header = file->header;
+  TiledImageInfo info;
+  info.pixelType = header.pixelType;
+  info.domain = initImageDomain(header.minX, header.maxX, header.minY, header.maxY);
+  info.minRange = header.minRange;
+  info.maxRange = header.maxRange;
+  info.tileWidth = header.tileWidth;
+  info.tileHeight = header.tileHeight;
+  info.tilesX = file->tilesX;
+  info.tilesY = file->tilesY;
+  info.compression = header.compression;
+  return info;
+}
+
+void closeTiledImage(TiledImageFile *file) {
+  munmap(file->data, file->size);
+  free(file);
+}
+
+/**
+ * Returns the domain of tile (tileX, tileY) within the domain of the file.
+ */
+static ImageDomain getTileDomain(TiledImageFile *file, int pixelType, const char *function, int tileX, int tileY) {
+  TiledFileHeader header = file->header;
+  if ((int)header.pixelType != pixelType) {
+    fatalError("%s: the file contains pixels of type %d instead of %d.\n", function, header.pixelType, pixelType);
+  }
+  if (tileX < 0 || tileX >= file->tilesX || tileY < 0 || tileY >= file->tilesY) {
+    fatalError("%s: tile (%d,%d) does not exist; the file has %dx%d tiles.\n", function, tileX, tileY, file->tilesX,
+               file->tilesY);
+  }
+  int minX = header.minX + tileX * (int)header.tileWidth;
+  int minY = header.minY + tileY * (int)header.tileHeight;
+  int maxX = minX + header.tileWidth - 1;
+  int maxY = minY + header.tileHeight - 1;
+  return initImageDomain(minX, (maxX < header.maxX ? maxX : header.maxX), minY,
+                         (maxY < header.maxY ? maxY : header.maxY));
+}
+
+/**
+ * Decodes a tile into the provided planes, which point at the top-left pixel of the tile in the destination.
+ */
+static void readTileInto(TiledImageFile *file, int tileX, int tileY, ImageDomain tileDomain, const TilePlane *planes) {
+  int pixelType = file->header.pixelType;
+  int wordSize = tiledWordSize(pixelType);
+  int numPlanes = tiledNumPlanes(pixelType);
+  int w, h;
+  getWidthHeight(tileDomain, &w, &h);
+  size_t rawSize = (size_t)w * h * numPlanes * wordSize;
+  TileIndexEntry entry = file->index[tileY * file->tilesX + tileX];
+  const uint8_t *tile = file->data + entry.offset;
+  if (entry.size == rawSize) {
+    scatterTile(tile, planes, numPlanes, wordSize, w, h);
+    return;
+  }
+  if (file->header.compression != TILE_DELTA_RLE) {
+    fatalError("readTileInto: tile (%d,%d) has an unexpected size.\n", tileX, tileY);
+  }
+  uint8_t *raw = safeMalloc(rawSize);
+  decodeTile(tile, entry.size, h * numPlanes, w, wordSize, raw);
+  scatterTile(raw, planes, numPlanes, wordSize, w, h);
+  free(raw);
+}
+
+/**
+ * Offsets the planes of an image with domain imageDomain to the top-left pixel of tileDomain.
+ */
+static void offsetTilePlanes(TilePlane *planes, int numPlanes, ImageDomain imageDomain, ImageDomain tileDomain) {
+  for (int p = 0; p < numPlanes; p++) {
+    planes[p].base += (tileDomain.minY - imageDomain.minY) * planes[p].rowStride +
+                      (tileDomain.minX - imageDomain.minX) * planes[p].pixelStride;
+  }
+}
+
+/**
+ * Decodes all tiles of the file into the planes of an image that has the domain of the file.
+ */
+static void readAllTiles(TiledImageFile *file, ImageDomain domain, const TilePlane *planes) {
+  int numPlanes = tiledNumPlanes(file->header.pixelType);
+  for (int tileY = 0; tileY < file->tilesY; tileY++) {
+    for (int tileX = 0; tileX < file->tilesX; tileX++) {
+      ImageDomain tileDomain = getTileDomain(file, file->header.pixelType, "readAllTiles", tileX, tileY);
+      TilePlane tilePlanes[3];
+      memcpy(tilePlanes, planes, numPlanes * sizeof(TilePlane));
+      offsetTilePlanes(tilePlanes, numPlanes, domain, tileDomain);
+      readTileInto(file, tileX, tileY, tileDomain, tilePlanes);
+    }
+  }
+}
+
+IntImage readIntImageTile(TiledImageFile *file, int tileX, int tileY) {
+  ImageDomain domain = getTileDomain(file, INT_PIXELS, "readIntImageTile", tileX, tileY);
+  IntImage image = allocateIntImageGrid(domain.minX, domain.maxX, domain.minY, domain.maxY, file->header.minRange,
+                                        file->header.maxRange);
+  TilePlane plane = initTilePlane(image.pixels[0], sizeof(int), getWidth(domain));
+  readTileInto(file, tileX, tileY, domain, &plane);
+  return image;
+}
+
+RgbImage readRgbImageTile(TiledImageFile *file, int tileX, int tileY) {
+  ImageDomain domain = getTileDomain(file, RGB_PIXELS, "readRgbImageTile", tileX, tileY);
+  RgbImage image = allocateRgbImageGrid(domain.minX, domain.maxX, domain.minY, domain.maxY, file->header.minRange,
+                                        file->header.maxRange);
+  int width = getWidth(domain);
+  TilePlane planes[3] = {initTilePlane(image.red[0], sizeof(int), width),
+                         initTilePlane(image.green[0], sizeof(int), width),
+                         initTilePlane(image.blue[0], sizeof(int), width)};
+  readTileInto(file, tileX, tileY, domain, planes);
+  return image;
+}
+
+DoubleImage readDoubleImageTile(TiledImageFile *file, int tileX, int tileY) {
+  ImageDomain domain = getTileDomain(file, DOUBLE_PIXELS, "readDoubleImageTile", tileX, tileY);
+  DoubleImage image = allocateDoubleImageGrid(domain.minX, domain.maxX, domain.minY, domain.maxY,
+                                              file->header.minRange, file->header.maxRange);
+  TilePlane plane = initTilePlane(image.pixels[0], sizeof(double), getWidth(domain));
+  readTileInto(file, tileX, tileY, domain, &plane);
+  return image;
+}
+
+ComplexImage readComplexImageTile(TiledImageFile *file, int tileX, int tileY) {
+  ImageDomain domain = getTileDomain(file, COMPLEX_PIXELS, "readComplexImageTile", tileX, tileY);
+  ComplexImage image = allocateComplexImageGridDomain(domain);
+  int width = getWidth(domain);
+  TilePlane planes[2] = {initTilePlane(image.pixels[0], sizeof(double complex), width),
+                         initTilePlane((double *)image.pixels[0] + 1, sizeof(double complex), width)};
+  readTileInto(file, tileX, tileY, domain, planes);
+  return image;
+}
+
+static TiledImageFile *openTiledImageOfType(const char *path, int pixelType, const char *function) {
+  TiledImageFile *file = openTiledImage(path);
+  if ((int)file->header.pixelType != pixelType) {
+    fatalError("%s: '%s' contains pixels of type %d instead of %d.\n", function, path, file->header.pixelType,
+               pixelType);
+  }
+  return file;
+}
+
+IntImage loadIntImageTiled(const char *path) {
+  TiledImageFile *file = openTiledImageOfType(path, INT_PIXELS, "loadIntImageTiled");
+  TiledImageInfo info = getTiledImageInfo(file);
+  IntImage image = allocateIntImageGrid(info.domain.minX, info.domain.maxX, info.domain.minY, info.domain.maxY,
+                                        info.minRange, info.maxRange);
+  TilePlane plane = initTilePlane(image.pixels[0], sizeof(int), getWidth(info.domain));
+  readAllTiles(file, info.domain, &plane);
+  closeTiledImage(file);
+  return image;
+}
+
+RgbImage loadRgbImageTiled(const char *path) {
+  TiledImageFile *file = openTiledImageOfType(path, RGB_PIXELS, "loadRgbImageTiled");
+  TiledImageInfo info = getTiledImageInfo(file);
+  RgbImage image = allocateRgbImageGrid(info.domain.minX, info.domain.maxX, info.domain.minY, info.domain.maxY,
+                                        info.minRange, info.maxRange);
+  int width = getWidth(info.domain);
+  TilePlane planes[3] = {initTilePlane(image.red[0], sizeof(int), width),
+                         initTilePlane(image.green[0], sizeof(int), width),
+                         initTilePlane(image.blue[0], sizeof(int), width)};
+  readAllTiles(file, info.domain, planes);
+  closeTiledImage(file);
+  return image;
+}
+
+DoubleImage loadDoubleImageTiled(const char *path) {
+  TiledImageFile *file = openTiledImageOfType(path, DOUBLE_PIXELS, "loadDoubleImageTiled");
+  TiledImageInfo info = getTiledImageInfo(file);
+  DoubleImage image = allocateDoubleImageGrid(info.domain.minX, info.domain.maxX, info.domain.minY, info.domain.maxY,
+                                              info.minRange, info.maxRange);
+  TilePlane plane = initTilePlane(image.pixels[0], sizeof(double), getWidth(info.domain));
+  readAllTiles(file, info.domain, &plane);
+  closeTiledImage(file);
+  return image;
+}
+
+ComplexImage loadComplexImageTiled(const char *path) {
+  TiledImageFile *file = openTiledImageOfType(path, COMPLEX_PIXELS, "loadComplexImageTiled");
+  TiledImageInfo info = getTiledImageInfo(file);
+  ComplexImage image = allocateComplexImageGridDomain(info.domain);
+  int width = getWidth(info.domain);
+  TilePlane planes[2] = {initTilePlane(image.pixels[0], sizeof(double complex), width),
+                         initTilePlane((double *)image.pixels[0] + 1, sizeof(double complex), width)};
+  readAllTiles(file, info.domain, planes);
+  closeTiledImage(file);
+  return image;
+}
+
+/** Bit images ********************************************/
+
+/*
+ * Bit images store one bit per pixel in rows of 64-bit words. Pixel x of a row is bit 63 - (x % 64) of word x / 64,
+ * i.e. the pixels are stored most significant bit first, just like the rows of a raw (P4) PBM. Padding bits beyond
+ * the width of the image are always 0.
+ */
+
+static int bitWordsPerRow(int width) { return (width + 63) / 64; }
+
+/**
+ * Mask of the valid bits in the last word of a row.
+ */
+static uint64_t lastWordMask(int width) {
+  int used = width % 64;
+  return (used == 0 ? UINT64_MAX : UINT64_MAX << (64 - used));
+}
+
+BitImage allocateBitImageGrid(int minX, int maxX, int minY, int maxY) {
+  BitImage image;
+  image.domain = initImageDomain(minX, maxX, minY, maxY);
+  int height = getHeight(image.domain);
+  image.wordsPerRow = bitWordsPerRow(getWidth(image.domain));
+  image.rows = safeCalloc(height * sizeof(uint64_t *) + height * image.wordsPerRow * sizeof(uint64_t));
+  uint64_t *p = (uint64_t *)(image.rows + height);
+  for (int y = 0; y < height; y++) {
+    image.rows[y] = p + image.wordsPerRow * y;
+  }
+  return image;
+}
+
+BitImage allocateBitImage(int width, int height) { return allocateBitImageGrid(0, width - 1, 0, height - 1); }
+
+BitImage allocateFromBitImage(BitImage image) {
+  ImageDomain domain = image.domain;
+  return allocateBitImageGrid(domain.minX, domain.maxX, domain.minY, domain.maxY);
+}
+
+BitImage copyBitImage(BitImage image) {
+  BitImage copy = allocateFromBitImage(image);
+  memcpy(copy.rows[0], image.rows[0], getHeight(image.domain) * image.wordsPerRow * sizeof(uint64_t));
+  return copy;
+}
+
+void freeBitImage(BitImage image) { free(image.rows); }
+
+ImageDomain getBitImageDomain(BitImage image) { return image.domain; }
+
+int getBitPixel(BitImage image, int x, int y) {
+#if !FAST
+  checkDomain(x, y, image.domain.minX, image.domain.maxX, image.domain.minY, image.domain.maxY);
+#endif
+  return getBitPixelI(image, x - image.domain.minX, y - image.domain.minY);
+}
+
+int getBitPixelI(BitImage image, int x, int y) {
+#if !FAST
+  checkDomainI(x, y, getWidth(image.domain), getHeight(image.domain));
+#endif
+  return (image.rows[y][x / 64] >> (63 - x % 64)) & 1;
+}
+
+void setBitPixel(BitImage *image, int x, int y, int val) {
+#if !FAST
+  checkDomain(x, y, image->domain.minX, image->domain.maxX, image->domain.minY, image->domain.maxY);
+#endif
+  setBitPixelI(image, x - image->domain.minX, y - image->domain.minY, val);
+}
+
+void setBitPixelI(BitImage *image, int x, int y, int val) {
+#if !FAST
+  checkDomainI(x, y, getWidth(image->domain), getHeight(image->domain));
+#endif
+  uint64_t bit = (uint64_t)1 << (63 - x % 64);
+  if (val) {
+    image->rows[y][x / 64] |= bit;
+  } else {
+    image->rows[y][x / 64] &= ~bit;
+  }
+}
+
+long countBitPixels(BitImage image) {
+  long count = 0;
+  size_t numWords = (size_t)getHeight(image.domain) * image.wordsPerRow;
+  const uint64_t *words = image.rows[0];
+  for (size_t i = 0; i < numWords; i++) {
+    count += __builtin_popcountll(words[i]);
+  }
+  return count;
+}
+
+BitImage int2BitImg(IntImage image) {
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  BitImage bits = allocateBitImageGrid(image.domain.minX, image.domain.maxX, image.domain.minY, image.domain.maxY);
+  for (int y = 0; y < height; y++) {
+    const int *row = image.pixels[y];
+    uint64_t *words = bits.rows[y];
+    for (int x = 0; x < width; x++) {
+      words[x / 64] |= (uint64_t)(row[x] != 0) << (63 - x % 64);
+    }
+  }
+  return bits;
+}
+
+IntImage bit2IntImg(BitImage image) {
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  IntImage result = allocateIntImageGridDomain(image.domain, 0, 1);
+  for (int y = 0; y < height; y++) {
+    const uint64_t *words = image.rows[y];
+    int *row = result.pixels[y];
+    for (int x = 0; x < width; x++) {
+      row[x] = (words[x / 64] >> (63 - x % 64)) & 1;
+    }
+  }
+  return result;
+}
+
+static void compareBitDomains(BitImage imageA, BitImage imageB) {
+  ImageDomain a = imageA.domain, b = imageB.domain;
+  if (a.minX != b.minX || a.maxX != b.maxX || a.minY != b.minY || a.maxY != b.maxY) {
+    fatalError("Images do not have the same domain.\n");
+  }
+}
+
+// Bitwise operators for applyFunctionBitImage
+#define BIT_AND 0
+#define BIT_OR 1
+#define BIT_XOR 2
+
+static BitImage applyFunctionBitImage(BitImage imageA, BitImage imageB, int operator) {
+  compareBitDomains(imageA, imageB);
+  BitImage result = allocateFromBitImage(imageA);
+  size_t numWords = (size_t)getHeight(imageA.domain) * imageA.wordsPerRow;
+  const uint64_t *a = imageA.rows[0], *b = imageB.rows[0];
+  uint64_t *out = result.rows[0];
+  // the loops are kept free of branches, so that the compiler can vectorize them
+  switch (operator) {
+    case BIT_AND:
+      for (size_t i = 0; i < numWords; i++) out[i] = a[i] & b[i];
+      break;
+    case BIT_OR:
+      for (size_t i = 0; i < numWords; i++) out[i] = a[i] | b[i];
+      break;
+    default:
+      for (size_t i = 0; i < numWords; i++) out[i] = a[i] ^ b[i];
+      break;
+  }
+  return result;
+}
+
+BitImage andBitImage(BitImage imageA, BitImage imageB) { return applyFunctionBitImage(imageA, imageB, BIT_AND); }
+
+BitImage orBitImage(BitImage imageA, BitImage imageB) { return applyFunctionBitImage(imageA, imageB, BIT_OR); }
+
+BitImage xorBitImage(BitImage imageA, BitImage imageB) { return applyFunctionBitImage(imageA, imageB, BIT_XOR); }
+
+BitImage notBitImage(BitImage image) {
+  BitImage result = allocateFromBitImage(image);
+  int height = getHeight(image.domain);
+  int wordsPerRow = image.wordsPerRow;
+  uint64_t mask = lastWordMask(getWidth(image.domain));
+  for (int y = 0; y < height; y++) {
+    for (int i = 0; i < wordsPerRow; i++) {
+      result.rows[y][i] = ~image.rows[y][i];
+    }
+    result.rows[y][wordsPerRow - 1] &= mask;  // keep the padding bits 0
+  }
+  return result;
+}
+
+/**
+ * Shifts a row of numWords words shift pixels to the right (towards higher x), i.e. dst pixel x = src pixel x - shift.
+ * Pixels that are shifted in at the left take the value of fill (0 or UINT64_MAX).
+ */
+static void shiftBitRowRight(const uint64_t *src, uint64_t *dst, int numWords, int shift, uint64_t fill) {
+  int wordShift = shift / 64;
+  int bitShift = shift % 64;
+  for (int i = numWords - 1; i >= 0; i--) {
+    uint64_t hi = (i - wordShift >= 0 ? src[i - wordShift] : fill);
+    uint64_t lo = (i - wordShift - 1 >= 0 ? src[i - wordShift - 1] : fill);
+    dst[i] = (bitShift == 0 ? hi : (hi >> bitShift) | (lo << (64 - bitShift)));
+  }
+}
+
+/**
+ * Dilation or erosion with a rectangle of kw x kh pixels, using the same (trailing) window as dilateIntImageRect: the
+ * result at (x, y) depends on the pixels in [x-kw+1..x] x [y-kh+1..y]. Pixels outside of the image are ignored.
+ * Instead of sliding over all kw positions, the window is grown by doubling: after combining the row with itself
+ * shifted by 1, 2, 4, ... pixels, every bit covers a run of that many pixels, so only O(log kw) shifts of whole words
+ * are needed. The columns are handled in the same way, with whole rows instead of bits.
+ */
+static BitImage dilateErodeBitImageRect(BitImage image, int kw, int kh, int dilate) {
+  if (kw < 1 || kh < 1) {
+    fatalError("dilateErodeBitImageRect: kernel size %dx%d is invalid.\n", kw, kh);
+  }
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  int wordsPerRow = image.wordsPerRow;
+  uint64_t fill = (dilate ? 0 : UINT64_MAX);
+  uint64_t mask = lastWordMask(width);
+  BitImage result = copyBitImage(image);
+  uint64_t *shifted = safeMalloc(wordsPerRow * sizeof(uint64_t));
+
+  for (int y = 0; y < height; y++) {
+    uint64_t *row = result.rows[y];
+    int span = 1;
+    while (span < kw) {
+      int shift = (2 * span <= kw ? span : kw - span);
+      shiftBitRowRight(row, shifted, wordsPerRow, shift, fill);
+      for (int i = 0; i < wordsPerRow; i++) {
+        row[i] = (dilate ? row[i] | shifted[i] : row[i] & shifted[i]);
+      }
+      span += shift;
+    }
+    row[wordsPerRow - 1] &= mask;
+  }
+
+  int span = 1;
+  while (span < kh) {
+    int shift = (2 * span <= kh ? span : kh - span);
+    // rows are updated bottom to top, so that row y - shift still holds its value of the previous step
+    for (int y = height - 1; y >= shift; y--) {
+      uint64_t *row = result.rows[y];
+      const uint64_t *above = result.rows[y - shift];
+      for (int i = 0; i < wordsPerRow; i++) {
+        row[i] = (dilate ? row[i] | above[i] : row[i] & above[i]);
+      }
+    }
+    span += shift;
+  }
+  free(shifted);
+  return result;
+}
+
+BitImage dilateBitImageRect(BitImage image, int kw, int kh) { return dilateErodeBitImageRect(image, kw, kh, 1); }
+
+BitImage erodeBitImageRect(BitImage image, int kw, int kh) { return dilateErodeBitImageRect(image, kw, kh, 0); }
+
+/**
+ * Converts between a P4 row and a bit image row. Both store the pixels most significant bit first, so a word is just
+ * 8 row bytes in big-endian order. Note that in PBM 1 is black, which is 0 in the images of this framework.
+ */
+static void unpackPbmRow(const uint8_t *bytes, uint64_t *words, int width) {
+  int numWords = bitWordsPerRow(width);
+  for (int i = 0; i < numWords; i++) {
+    uint64_t word = 0;
+    for (int b = 0; b < 8; b++) {
+      word = (word << 8) | bytes[8 * i + b];
+    }
+    words[i] = ~word;
+  }
+  words[numWords - 1] &= lastWordMask(width);
+}
+
+static void packPbmRow(const uint64_t *words, uint8_t *bytes, int width) {
+  int numWords = bitWordsPerRow(width);
+  uint64_t mask = UINT64_MAX;
+  for (int i = 0; i < numWords; i++) {
+    if (i == numWords - 1) {
+      mask = lastWordMask(width);
+    }
+    uint64_t word = ~words[i] & mask;
+    for (int b = 7; b >= 0; b--) {
+      bytes[8 * i + b] = word & 0xff;
+      word >>= 8;
+    }
+  }
+}
+
+BitImage loadBitImage(const char *path) {
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL || strcmp(extension, "pbm") != 0) {
+    fatalError("loadBitImage: filename '%s' must have pbm as extension.\n", path);
+  }
+  FILE *imgFile = fopen(path, "rb");
+  if (imgFile == NULL) {
+    fatalError("loadBitImage: failed to open file '%s'.\n", path);
+  }
+  int magicNumber, width, height;
+  if (fscanf(imgFile, "P%d", &magicNumber) != 1 || ((magicNumber != 1) && (magicNumber != 4))) {
+    fatalError("loadBitImage: '%s' is not a PBM file.\n", path);
+  }
+  if (magicNumber == 1) {
+    // ascii files are rare; they take the regular path
+    fclose(imgFile);
+    IntImage image = loadIntImage(path);
+    BitImage bits = int2BitImg(image);
+    freeIntImage(image);
+    return bits;
+  }
+  skipNetpbmComments(imgFile, "loadBitImage", "PBM");
+  if (fscanf(imgFile, "%d %d", &width, &height) != 2 || fgetc(imgFile) == EOF) {
+    fatalError("loadBitImage: corrupt PBM: no file dimensions found.\n");
+  }
+  BitImage image = allocateBitImage(width, height);
+  int rowBytes = (width + 7) / 8;
+  uint8_t *bytes = safeCalloc(image.wordsPerRow * sizeof(uint64_t));
+  for (int y = 0; y < height; y++) {
+    if (fread(bytes, 1, rowBytes, imgFile) != (size_t)rowBytes) {
+      fatalError("loadBitImage: corrupt PBM, file is truncated.\n");
+    }
+    unpackPbmRow(bytes, image.rows[y], width);
+  }
+  free(bytes);
+  fclose(imgFile);
+  return image;
+}
+
+void saveBitImage(BitImage image, const char *path) {
+  char *extension = getFileNameExtension(path);
+  if (extension == NULL || strcmp(extension, "pbm") != 0) {
+    fatalError("saveBitImage: filename '%s' must have pbm as extension.\n", path);
+  }
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  int rowBytes = (width + 7) / 8;
+  PackedNetpbm packed;
+  packed.headerLength = sprintf(packed.header, "P4\n%d %d\n", width, height);
+  packed.numBytes = (size_t)rowBytes * height;
+  // rows are packed in whole words, so the buffer has room for the bytes beyond the last row
+  packed.data = safeMalloc(packed.numBytes + image.wordsPerRow * sizeof(uint64_t));
+  for (int y = 0; y < height; y++) {
+    packPbmRow(image.rows[y], packed.data + (size_t)y * rowBytes, width);
+  }
+  writeNetpbmFile(path, packed);
+  free(packed.data);
+}
+
+/** Resampling ********************************************/
+
+typedef struct ResampleWeights {
+  int *start;       // first source index that contributes to output i
+  int *count;       // number of source indices that contribute to output i
+  double *weights;  // the weights of output i start at i * maxCount
+  int maxCount;
+} ResampleWeights;
+
+static double resampleSupport(int filter) {
+  switch (filter) {
+    case RESIZE_AREA:
+      return 0.5;
+    case RESIZE_BILINEAR:
+      return 1.0;
+    case RESIZE_BICUBIC:
+      return 2.0;
+    default:
+      return 3.0;
+  }
+}
+
+static double sinc(double x) {
+  if (x == 0.0) {
+    return 1.0;
+  }
+  x *= PI;
+  return sin(x) / x;
+}
+
+static double resampleKernel(int filter, double x) {
+  x = fabs(x);
+  switch (filter) {
+    case RESIZE_AREA:
+      return (x < 0.5 ? 1.0 : 0.0);
+    case RESIZE_BILINEAR:
+      return (x < 1.0 ? 1.0 - x : 0.0);
+    case RESIZE_BICUBIC: {
+      const double a = -0.5;
+      if (x < 1.0) {
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+      }
+      return (x < 2.0 ? (((x - 5.0) * x + 8.0) * x - 4.0) * a : 0.0);
+    }
+    default:
+      return (x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0);
+  }
+}
+
+/**
+ * Precomputes for every output index which source indices contribute to it and with which (normalised) weights. When
+ * downsampling, the filter is stretched by the scale factor, so that every source pixel contributes and no aliasing
+ * occurs.
+ */
+static ResampleWeights computeResampleWeights(int srcSize, int dstSize, int filter) {
+  double ratio = (double)srcSize / dstSize;
+  double scale = (ratio > 1.0 ? ratio : 1.0);
+  double support = resampleSupport(filter) * scale;
+  ResampleWeights w;
+  w.maxCount = 2 * (int)ceil(support) + 1;
+  w.start = safeMalloc(dstSize * sizeof(int));
+  w.count = safeMalloc(dstSize * sizeof(int));
+  w.weights = safeCalloc(dstSize * w.maxCount * sizeof(double));
+  for (int i = 0; i < dstSize; i++) {
+    double center = (i + 0.5) * ratio;
+    int lo = (int)floor(center - support + 0.5);
+    int hi = (int)floor(center + support + 0.5);
+    lo = (lo < 0 ? 0 : lo);
+    hi = (hi > srcSize ? srcSize : hi);
+    double *weights = w.weights + i * w.maxCount;
+    double sum = 0.0;
+    for (int j = lo; j < hi; j++) {
+      weights[j - lo] = resampleKernel(filter, (j - center + 0.5) / scale);
+      sum += weights[j - lo];
+    }
+    if (sum == 0.0) {
+      // only possible for degenerate sizes; fall back to the nearest source pixel
+      lo = (int)center;
+      lo = (lo >= srcSize ? srcSize - 1 : lo);
+      hi = lo + 1;
+      weights[0] = sum = 1.0;
+    }
+    for (int j = 0; j < hi - lo; j++) {
+      weights[j] /= sum;
+    }
+    w.start[i] = lo;
+    w.count[i] = hi - lo;
+  }
+  return w;
+}
+
+static void freeResampleWeights(ResampleWeights w) {
+  free(w.start);
+  free(w.count);
+  free(w.weights);
+}
+
+/**
+ * A resampler holds everything that can be shared between the channels of an image: the weights of both passes and
+ * the buffer for the horizontally resampled rows. For integer downscaling factors with the area filter, the weights
+ * are not needed: every output pixel is the mean of a boxX x boxY block.
+ */
+typedef struct Resampler {
+  int srcWidth, srcHeight, dstWidth, dstHeight;
+  int boxX, boxY;  // 0 if the general path is used
+  ResampleWeights horizontal, vertical;
+  double *rows;  // srcHeight rows of dstWidth values
+} Resampler;
+
+typedef struct ResampleJob {
+  Resampler *resampler;
+  int **srcInt;  // either the int or the double source/destination is used
+  double **srcDouble;
+  int **dstInt;
+  double **dstDouble;
+  double minVal, maxVal;
+} ResampleJob;
+
+static Resampler createResampler(int srcWidth, int srcHeight, int dstWidth, int dstHeight, int filter) {
+  if (dstWidth < 1 || dstHeight < 1) {
+    fatalError("resize: target size %dx%d is invalid.\n", dstWidth, dstHeight);
+  }
+  if (filter < RESIZE_AREA || filter > RESIZE_LANCZOS) {
+    fatalError("resize: unknown filter %d.\n", filter);
+  }
+  Resampler r;
+  r.srcWidth = srcWidth;
+  r.srcHeight = srcHeight;
+  r.dstWidth = dstWidth;
+  r.dstHeight = dstHeight;
+  r.boxX = r.boxY = 0;
+  r.rows = NULL;
+  if (filter == RESIZE_AREA && srcWidth % dstWidth == 0 && srcHeight % dstHeight == 0) {
+    r.boxX = srcWidth / dstWidth;
+    r.boxY = srcHeight / dstHeight;
+    return r;
+  }
+  r.horizontal = computeResampleWeights(srcWidth, dstWidth, filter);
+  r.vertical = computeResampleWeights(srcHeight, dstHeight, filter);
+  r.rows = safeMalloc(srcHeight * dstWidth * sizeof(double));
+  return r;
+}
+
+static void freeResampler(Resampler r) {
+  if (r.boxX == 0) {
+    freeResampleWeights(r.horizontal);
+    freeResampleWeights(r.vertical);
+    free(r.rows);
+  }
+}
+
+static inline double clampResampled(double val, double minVal, double maxVal) {
+  return (val < minVal ? minVal : (val > maxVal ? maxVal : val));
+}
+
+static void storeResampledRow(ResampleJob *job, int y, const double *values) {
+  int width = job->resampler->dstWidth;
+  if (job->dstInt != NULL) {
+    int *dst = job->dstInt[y];
+    for (int x = 0; x < width; x++) {
+      dst[x] = (int)floor(clampResampled(values[x], job->minVal, job->maxVal) + 0.5);
+    }
+  } else {
+    double *dst = job->dstDouble[y];
+    for (int x = 0; x < width; x++) {
+      dst[x] = clampResampled(values[x], job->minVal, job->maxVal);
+    }
+  }
+}
+
+/**
+ * Horizontal pass for the source rows [begin..end): every row is resampled to dstWidth values.
+ */
+static void resampleRows(void *arg, int begin, int end) {
+  ResampleJob *job = arg;
+  Resampler *r = job->resampler;
+  ResampleWeights w = r->horizontal;
+  double *converted = (job->srcInt != NULL ? safeMalloc(r->srcWidth * sizeof(double)) : NULL);
+  for (int y = begin; y < end; y++) {
+    const double *src = job->srcDouble != NULL ? job->srcDouble[y] : converted;
+    if (converted != NULL) {
+      for (int x = 0; x < r->srcWidth; x++) {
+        converted[x] = job->srcInt[y][x];
+      }
+    }
+    double *dst = r->rows + (size_t)y * r->dstWidth;
+    for (int x = 0; x < r->dstWidth; x++) {
+      const double *weights = w.weights + x * w.maxCount;
+      const double *in = src + w.start[x];
+      double sum = 0.0;
+      for (int k = 0; k < w.count[x]; k++) {
+        sum += weights[k] * in[k];
+      }
+      dst[x] = sum;
+    }
+  }
+  free(converted);
+}
+
+/**
+ * Vertical pass for the output rows [begin..end). Each output row is a weighted sum of whole rows of the horizontal
+ * pass, so the inner loop runs over contiguous memory.
+ */
+static void resampleColumns(void *arg, int begin, int end) {
+  ResampleJob *job = arg;
+  Resampler *r = job->resampler;
+  ResampleWeights w = r->vertical;
+  int width = r->dstWidth;
+  double *acc = safeMalloc(width * sizeof(double));
+  for (int y = begin; y < end; y++) {
+    memset(acc, 0, width * sizeof(double));
+    for (int k = 0; k < w.count[y]; k++) {
+      double weight = w.weights[y * w.maxCount + k];
+      const double *row = r->rows + (size_t)(w.start[y] + k) * width;
+      for (int x = 0; x < width; x++) {
+        acc[x] += weight * row[x];
+      }
+    }
+    storeResampledRow(job, y, acc);
+  }
+  free(acc);
+}
+
+/**
+ * Integer factor area downsampling for the output rows [begin..end): the mean of every boxX x boxY block. Integer
+ * images are summed exactly.
+ */
+static void boxDownsampleRows(void *arg, int begin, int end) {
+  ResampleJob *job = arg;
+  Resampler *r = job->resampler;
+  int width = r->dstWidth, boxX = r->boxX, boxY = r->boxY;
+  double *mean = safeMalloc(width * sizeof(double));
+  int64_t *sums = safeMalloc(width * sizeof(int64_t));
+  double area = (double)boxX * boxY;
+  for (int y = begin; y < end; y++) {
+    if (job->srcInt != NULL) {
+      memset(sums, 0, width * sizeof(int64_t));
+      for (int dy = 0; dy < boxY; dy++) {
+        const int *src = job->srcInt[y * boxY + dy];
+        for (int x = 0; x < width; x++) {
+          int64_t sum = 0;
+          for (int dx = 0; dx < boxX; dx++) {
+            sum += src[x * boxX + dx];
+          }
+          sums[x] += sum;
+        }
+      }
+      for (int x = 0; x < width; x++) {
+        mean[x] = sums[x] / area;
+      }
+    } else {
+      memset(mean, 0, width * sizeof(double));
+      for (int dy = 0; dy < boxY; dy++) {
+        const double *src = job->srcDouble[y * boxY + dy];
+        for (int x = 0; x < width; x++) {
+          double sum = 0.0;
+          for (int dx = 0; dx < boxX; dx++) {
+            sum += src[x * boxX + dx];
+          }
+          mean[x] += sum;
+        }
+      }
+      for (int x = 0; x < width; x++) {
+        mean[x] /= area;
+      }
+    }
+    storeResampledRow(job, y, mean);
+  }
+  free(sums);
+  free(mean);
+}
+
+static void resamplePlane(ResampleJob *job) {
+  Resampler *r = job->resampler;
+  // chunks of at least ~64K multiply-adds, so that threads are only used when it pays off
+  int minRows = 1 + 65536 / (r->dstWidth * (r->boxX > 0 ? r->boxX * r->boxY : 4));
+  if (r->boxX > 0) {
+    parallelFor(r->dstHeight, minRows, boxDownsampleRows, job);
+    return;
+  }
+  parallelFor(r->srcHeight, minRows, resampleRows, job);
+  parallelFor(r->dstHeight, minRows, resampleColumns, job);
+}
+
+IntImage resizeIntImage(IntImage image, int newWidth, int newHeight, int filter) {
+  Resampler r = createResampler(getWidth(image.domain), getHeight(image.domain), newWidth, newHeight, filter);
+  IntImage result = allocateIntImage(newWidth, newHeight, image.minRange, image.maxRange);
+  ResampleJob job = {&r, image.pixels, NULL, result.pixels, NULL, image.minRange, image.maxRange};
+  resamplePlane(&job);
+  freeResampler(r);
+  return result;
+}
+
+RgbImage resizeRgbImage(RgbImage image, int newWidth, int newHeight, int filter) {
+  Resampler r = createResampler(getWidth(image.domain), getHeight(image.domain), newWidth, newHeight, filter);
+  RgbImage result = allocateRgbImage(newWidth, newHeight, image.minRange, image.maxRange);
+  int **src[3] = {image.red, image.green, image.blue};
+  int **dst[3] = {result.red, result.green, result.blue};
+  for (int c = 0; c < 3; c++) {
+    ResampleJob job = {&r, src[c], NULL, dst[c], NULL, image.minRange, image.maxRange};
+    resamplePlane(&job);
+  }
+  freeResampler(r);
+  return result;
+}
+
+DoubleImage resizeDoubleImage(DoubleImage image, int newWidth, int newHeight, int filter) {
+  Resampler r = createResampler(getWidth(image.domain), getHeight(image.domain), newWidth, newHeight, filter);
+  DoubleImage result = allocateDoubleImage(newWidth, newHeight, image.minRange, image.maxRange);
+  ResampleJob job = {&r, NULL, image.pixels, NULL, result.pixels, image.minRange, image.maxRange};
+  resamplePlane(&job);
+  freeResampler(r);
+  return result;
+}
+
+/** Image pyramids ********************************************/
+
+/*
+ * The pyramids use the 5-tap binomial kernel [1 4 6 4 1] / 16 of Burt and Adelson. Borders are mirrored without
+ * repeating the border pixel.
+ */
+
+static inline int mirrorIndex(int i, int n) {
+  if (n == 1) {
+    return 0;
+  }
+  while (i < 0 || i >= n) {
+    i = (i < 0 ? -i : 2 * n - 2 - i);
+  }
+  return i;
+}
+
+static inline double binomial5(const double *v, int i, int n) {
+  if (i >= 2 && i + 2 < n) {
+    return (v[i - 2] + 4.0 * (v[i - 1] + v[i + 1]) + 6.0 * v[i] + v[i + 2]) / 16.0;
+  }
+  return (v[mirrorIndex(i - 2, n)] + 4.0 * (v[mirrorIndex(i - 1, n)] + v[mirrorIndex(i + 1, n)]) + 6.0 * v[i] +
+          v[mirrorIndex(i + 2, n)]) /
+         16.0;
+}
+
+/**
+ * Blurs src and keeps every second pixel in both directions, without computing the samples that are thrown away: the
+ * horizontal pass is only evaluated at even columns and the vertical pass only at even rows. tmp must have room for
+ * getWidth(dst) * getHeight(src) values.
+ */
+static void blurDecimate(DoubleImage src, DoubleImage dst, double *tmp) {
+  int width, height, dstWidth, dstHeight;
+  getWidthHeight(src.domain, &width, &height);
+  getWidthHeight(dst.domain, &dstWidth, &dstHeight);
+  for (int y = 0; y < height; y++) {
+    const double *row = src.pixels[y];
+    double *out = tmp + (size_t)y * dstWidth;
+    for (int x = 0; x < dstWidth; x++) {
+      out[x] = binomial5(row, 2 * x, width);
+    }
+  }
+  for (int y = 0; y < dstHeight; y++) {
+    const double *rows[5];
+    for (int j = 0; j < 5; j++) {
+      rows[j] = tmp + (size_t)mirrorIndex(2 * y + j - 2, height) * dstWidth;
+    }
+    double *out = dst.pixels[y];
+    for (int x = 0; x < dstWidth; x++) {
+      out[x] = (rows[0][x] + 4.0 * (rows[1][x] + rows[3][x]) + 6.0 * rows[2][x] + rows[4][x]) / 16.0;
+    }
+  }
+}
+
+/**
+ * Upsamples small to width x height (the inverse of blurDecimate's size reduction) by inserting zeros and filtering
+ * with 4 times the binomial kernel. Only the non-zero taps are evaluated: even positions take (1 6 1) / 8 and odd
+ * positions (4 4) / 8 of the small image. Then computes dst = base + sign * upsampled. tmp must have room for
+ * width * getHeight(small) values.
+ */
+static void expandAndAdd(DoubleImage small, DoubleImage base, double sign, DoubleImage dst, double *tmp) {
+  int width, height, smallWidth, smallHeight;
+  getWidthHeight(base.domain, &width, &height);
+  getWidthHeight(small.domain, &smallWidth, &smallHeight);
+  for (int y = 0; y < smallHeight; y++) {
+    const double *row = small.pixels[y];
+    double *out = tmp + (size_t)y * width;
+    for (int x = 0; x < width; x++) {
+      int m = x / 2;
+      if (x % 2 == 0) {
+        out[x] = (row[mirrorIndex(m - 1, smallWidth)] + 6.0 * row[m] + row[mirrorIndex(m + 1, smallWidth)]) / 8.0;
+      } else {
+        out[x] = (row[m] + row[mirrorIndex(m + 1, smallWidth)]) / 2.0;
+      }
+    }
+  }
+  for (int y = 0; y < height; y++) {
+    int m = y / 2;
+    const double *in = base.pixels[y];
+    double *out = dst.pixels[y];
+    const double *center = tmp + (size_t)m * width;
+    const double *next = tmp + (size_t)mirrorIndex(m + 1, smallHeight) * width;
+    if (y % 2 == 0) {
+      const double *prev = tmp + (size_t)mirrorIndex(m - 1, smallHeight) * width;
+      for (int x = 0; x < width; x++) {
+        out[x] = in[x] + sign * (prev[x] + 6.0 * center[x] + next[x]) / 8.0;
+      }
+    } else {
+      for (int x = 0; x < width; x++) {
+        out[x] = in[x] + sign * (center[x] + next[x]) / 2.0;
+      }
+    }
+  }
+}
+
+ImagePyramid allocateImagePyramid(int width, int height, int levels) {
+  if (width < 1 || height < 1 || levels < 1) {
+    fatalError("allocateImagePyramid: invalid pyramid of %d levels of %dx%d.\n", levels, width, height);
+  }
+  // levels halve (rounding up) until they are a single pixel
+  int maxLevels = 1;
+  for (int w = width, h = height; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) {
+    maxLevels++;
+  }
+  ImagePyramid pyramid;
+  pyramid.numLevels = (levels < maxLevels ? levels : maxLevels);
+  pyramid.levels = safeMalloc(pyramid.numLevels * sizeof(DoubleImage));
+  size_t numRows = 0, numPixels = 0;
+  for (int l = 0, w = width, h = height; l < pyramid.numLevels; l++, w = (w + 1) / 2, h = (h + 1) / 2) {
+    numRows += h;
+    numPixels += (size_t)w * h;
+  }
+  // a single allocation holds the row pointers of all levels, followed by the pixels of all levels
+  double **rows = safeMalloc(numRows * sizeof(double *) + numPixels * sizeof(double));
+  double *pixels = (double *)(rows + numRows);
+  for (int l = 0, w = width, h = height; l < pyramid.numLevels; l++, w = (w + 1) / 2, h = (h + 1) / 2) {
+    DoubleImage *level = &pyramid.levels[l];
+    level->domain = initImageDomain(0, w - 1, 0, h - 1);
+    level->minRange = -DBL_MAX;
+    level->maxRange = DBL_MAX;
+    level->pixels = rows;
+    for (int y = 0; y < h; y++) {
+      rows[y] = pixels + (size_t)y * w;
+    }
+    rows += h;
+    pixels += (size_t)w * h;
+  }
+  return pyramid;
+}
+
+void freeImagePyramid(ImagePyramid pyramid) {
+  free(pyramid.levels[0].pixels);
+  free(pyramid.levels);
+}
+
+void computeGaussianPyramid(DoubleImage image, ImagePyramid *pyramid) {
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  DoubleImage *levels = pyramid->levels;
+  if (getWidth(levels[0].domain) != width || getHeight(levels[0].domain) != height) {
+    fatalError("computeGaussianPyramid: image of %dx%d does not fit a pyramid of %dx%d.\n", width, height,
+               getWidth(levels[0].domain), getHeight(levels[0].domain));
+  }
+  memcpy(levels[0].pixels[0], image.pixels[0], (size_t)width * height * sizeof(double));
+  if (pyramid->numLevels == 1) {
+    return;
+  }
+  double *tmp = safeMalloc(getWidth(levels[1].domain) * height * sizeof(double));
+  for (int l = 1; l < pyramid->numLevels; l++) {
+    blurDecimate(levels[l - 1], levels[l], tmp);
+  }
+  free(tmp);
+}
+
+void computeLaplacianPyramid(DoubleImage image, ImagePyramid *pyramid) {
+  computeGaussianPyramid(image, pyramid);
+  if (pyramid->numLevels == 1) {
+    return;
+  }
+  DoubleImage *levels = pyramid->levels;
+  double *tmp = safeMalloc(getWidth(image.domain) * getHeight(levels[1].domain) * sizeof(double));
+  // level l + 1 is still a Gaussian level when level l is turned into a band-pass level
+  for (int l = 0; l + 1 < pyramid->numLevels; l++) {
+    expandAndAdd(levels[l + 1], levels[l], -1.0, levels[l], tmp);
+  }
+  free(tmp);
+}
+
+ImagePyramid buildGaussianPyramid(DoubleImage image, int levels) {
+  ImagePyramid pyramid = allocateImagePyramid(getWidth(image.domain), getHeight(image.domain), levels);
+  computeGaussianPyramid(image, &pyramid);
+  return pyramid;
+}
+
+ImagePyramid buildLaplacianPyramid(DoubleImage image, int levels) {
+  ImagePyramid pyramid = allocateImagePyramid(getWidth(image.domain), getHeight(image.domain), levels);
+  computeLaplacianPyramid(image, &pyramid);
+  return pyramid;
+}
+
+DoubleImage collapseLaplacianPyramid(ImagePyramid pyramid) {
+  DoubleImage *levels = pyramid.levels;
+  int width, height;
+  getWidthHeight(levels[0].domain, &width, &height);
+  DoubleImage result = allocateDefaultDoubleImage(width, height);
+  if (pyramid.numLevels == 1) {
+    memcpy(result.pixels[0], levels[0].pixels[0], (size_t)width * height * sizeof(double));
+    return result;
+  }
+  // the levels are reconstructed from coarse to fine in a copy of the pyramid, so that the input is left intact
+  ImagePyramid work = allocateImagePyramid(width, height, pyramid.numLevels);
+  int last = pyramid.numLevels - 1;
+  memcpy(work.levels[last].pixels[0], levels[last].pixels[0],
+         getWidth(levels[last].domain) * getHeight(levels[last].domain) * sizeof(double));
+  double *tmp = safeMalloc(width * getHeight(levels[1].domain) * sizeof(double));
+  for (int l = last - 1; l >= 0; l--) {
+    expandAndAdd(work.levels[l + 1], levels[l], 1.0, (l == 0 ? result : work.levels[l]), tmp);
+  }
+  free(tmp);
+  freeImagePyramid(work);
+  return result;
+}
+
+/** Warping ********************************************/
+
+/*
+ * Source coordinates are stepped along each output row in 32.32 fixed point. Every row start is computed from the
+ * matrix in floating point, so the rounding error of the step only accumulates within a single row.
+ */
+#define WARP_FRACTION_BITS 32
+#define WARP_ONE ((int64_t)1 << WARP_FRACTION_BITS)
+
+typedef struct WarpJob {
+  IntImage src, dst;
+  double inverse[6];  // maps destination domain coordinates to source domain coordinates
+  int interpolation, background;
+} WarpJob;
+
+static inline int64_t toWarpFixed(double v) { return (int64_t)llround(v * (double)WARP_ONE); }
+
+static void warpRows(void *arg, int begin, int end) {
+  WarpJob *job = arg;
+  const double *m = job->inverse;
+  int srcWidth, srcHeight, dstWidth;
+  getWidthHeight(job->src.domain, &srcWidth, &srcHeight);
+  dstWidth = getWidth(job->dst.domain);
+  int **src = job->src.pixels;
+  int dstMinX = job->dst.domain.minX;
+  // valid source positions are [0..width-1] x [0..height-1] in index coordinates
+  uint64_t limitX = (uint64_t)(srcWidth - 1) << WARP_FRACTION_BITS;
+  uint64_t limitY = (uint64_t)(srcHeight - 1) << WARP_FRACTION_BITS;
+  int64_t stepX = toWarpFixed(m[0]);
+  int64_t stepY = toWarpFixed(m[3]);
+  // nearest neighbour rounds by starting half a pixel further and truncating
+  double half = (job->interpolation == INTERP_NEAREST ? 0.5 : 0.0);
+  if (job->interpolation == INTERP_NEAREST) {
+    limitX += WARP_ONE - 1;
+    limitY += WARP_ONE - 1;
+  }
+  for (int y = begin; y < end; y++) {
+    int *dst = job->dst.pixels[y];
+    double dy = job->dst.domain.minY + y;
+    int64_t sx = toWarpFixed(m[0] * dstMinX + m[1] * dy + m[2] - job->src.domain.minX + half);
+    int64_t sy = toWarpFixed(m[3] * dstMinX + m[4] * dy + m[5] - job->src.domain.minY + half);
+    if (job->interpolation == INTERP_NEAREST) {
+      for (int x = 0; x < dstWidth; x++, sx += stepX, sy += stepY) {
+        if ((uint64_t)sx > limitX || (uint64_t)sy > limitY) {
+          dst[x] = job->background;
+          continue;
+        }
+        dst[x] = src[sy >> WARP_FRACTION_BITS][sx >> WARP_FRACTION_BITS];
+      }
+      continue;
+    }
+    for (int x = 0; x < dstWidth; x++, sx += stepX, sy += stepY) {
+      if ((uint64_t)sx > limitX || (uint64_t)sy > limitY) {
+        dst[x] = job->background;
+        continue;
+      }
+      int ix = (int)(sx >> WARP_FRACTION_BITS), iy = (int)(sy >> WARP_FRACTION_BITS);
+      double fx = (double)(sx & (WARP_ONE - 1)) / WARP_ONE;
+      double fy = (double)(sy & (WARP_ONE - 1)) / WARP_ONE;
+      // a neighbour is only read when its weight is non-zero, which keeps the reads at the last row/column in bounds
+      int nx = (fx > 0.0 ? 1 : 0), ny = (fy > 0.0 ? 1 : 0);
+      const int *top = src[iy], *bottom = src[iy + ny];
+      double upper = top[ix] + fx * (top[ix + nx] - top[ix]);
+      double lower = bottom[ix] + fx * (bottom[ix + nx] - bottom[ix]);
+      dst[x] = (int)floor(upper + fy * (lower - upper) + 0.5);
+    }
+  }
+}
+
+static IntImage warpIntImageTo(IntImage image, ImageDomain domain, const double inverse[6], int interpolation,
+                               int background) {
+  if (interpolation != INTERP_NEAREST && interpolation != INTERP_BILINEAR) {
+    fatalError("Unknown interpolation method %d.\n", interpolation);
+  }
+  IntImage result = allocateIntImageGrid(domain.minX, domain.maxX, domain.minY, domain.maxY, image.minRange,
+                                         image.maxRange);
+  WarpJob job = {image, result, {0}, interpolation, background};
+  memcpy(job.inverse, inverse, sizeof(job.inverse));
+  int width = getWidth(domain);
+  parallelFor(getHeight(domain), 1 + 65536 / width, warpRows, &job);
+  return result;
+}
+
+IntImage warpAffineIntImage(IntImage image, const double matrix[6], int interpolation, int background) {
+  double det = matrix[0] * matrix[4] - matrix[1] * matrix[3];
+  if (fabs(det) < 1e-12) {
+    fatalError("warpAffineIntImage: the transformation matrix is singular.\n");
+  }
+  double inverse[6];
+  inverse[0] = matrix[4] / det;
+  inverse[1] = -matrix[1] / det;
+  inverse[3] = -matrix[3] / det;
+  inverse[4] = matrix[0] / det;
+  inverse[2] = -(inverse[0] * matrix[2] + inverse[1] * matrix[5]);
+  inverse[5] = -(inverse[3] * matrix[2] + inverse[4] * matrix[5]);
+  return warpIntImageTo(image, image.domain, inverse, interpolation, background);
+}
+
+IntImage rotateIntImage(IntImage image, double angle, int interpolation, int background) {
+  double turns = angle / 90.0;
+  double wholeTurns = round(turns);
+  if (fabs(turns - wholeTurns) < 1e-9) {
+    return rotate90IntImage(image, (int)fmod(wholeTurns, 4.0));
+  }
+  double radians = angle * PI / 180.0;
+  double c = cos(radians), s = sin(radians);
+  // the result covers the rotated corners of the domain; the slack keeps exact corners from adding a row or column
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  double cornersX[4] = {minX, maxX, minX, maxX};
+  double cornersY[4] = {minY, minY, maxY, maxY};
+  double loX = INFINITY, hiX = -INFINITY, loY = INFINITY, hiY = -INFINITY;
+  for (int i = 0; i < 4; i++) {
+    double rx = c * cornersX[i] + s * cornersY[i];
+    double ry = -s * cornersX[i] + c * cornersY[i];
+    loX = fmin(loX, rx);
+    hiX = fmax(hiX, rx);
+    loY = fmin(loY, ry);
+    hiY = fmax(hiY, ry);
+  }
+  ImageDomain domain = initImageDomain((int)floor(loX + 1e-6), (int)ceil(hiX - 1e-6), (int)floor(loY + 1e-6),
+                                       (int)ceil(hiY - 1e-6));
+  double inverse[6] = {c, -s, 0.0, s, c, 0.0};
+  return warpIntImageTo(image, domain, inverse, interpolation, background);
+}
+
+/** Colour conversion ********************************************/
+
+/*
+ * The integer conversions use weights with 15 fractional bits. SSE2 computes 4 pixels at a time with _mm_madd_epi16 on
+ * interleaved channel pairs when all 12 channel values fit in 15 bits; other blocks take a scalar path that produces
+ * the same results with 64-bit intermediates. The values themselves are checked rather than the dynamic range, since
+ * pixels may lie outside of it (e.g. when FAST skips clamping).
+ */
+#define COLOUR_SHIFT 15
+#define COLOUR_HALF (1 << (COLOUR_SHIFT - 1))
+
+static const int greyWeights[2][3] = {
+    {9798, 19235, 3735},   // BT.601: 0.299, 0.587, 0.114
+    {6966, 23436, 2366}};  // BT.709: 0.2126, 0.7152, 0.0722
+static const int cbWeights[3] = {-5529, -10855, 16384};  // -0.168736, -0.331264, 0.5
+static const int crWeights[3] = {16384, -13720, -2664};  // 0.5, -0.418688, -0.081312
+
+typedef struct ColourJob {
+  RgbImage rgb;
+  int **ints[3];
+  double **doubles[3];
+  int standard;
+  double *linear;  // sRGB to linear lookup table for every value of the dynamic range, or NULL
+  int numLinear;   // number of entries of linear
+} ColourJob;
+
+static void checkConversionSize(ImageDomain a, ImageDomain b, const char *function) {
+  if (getWidth(a) != getWidth(b) || getHeight(a) != getHeight(b)) {
+    fatalError("%s: images of %dx%d and %dx%d do not have the same size.\n", function, getWidth(a), getHeight(a),
+               getWidth(b), getHeight(b));
+  }
+}
+
+static inline int mixChannels(const int *w, int a, int b, int c) {
+  return (int)(((int64_t)w[0] * a + (int64_t)w[1] * b + (int64_t)w[2] * c + COLOUR_HALF) >> COLOUR_SHIFT);
+}
+
+#ifdef __SSE2__
+/**
+ * (w[0]*a + w[1]*b + w[2]*c + COLOUR_HALF) >> COLOUR_SHIFT for 4 pixels whose values lie in [0..32767].
+ */
+static inline __m128i mixChannels4(const int *w, __m128i a, __m128i b, __m128i c) {
+  __m128i weightsAB = _mm_set1_epi32((int)(((uint32_t)w[1] << 16) | (w[0] & 0xFFFF)));
+  __m128i weightsC = _mm_set1_epi32((int)(((uint32_t)COLOUR_HALF << 16) | (w[2] & 0xFFFF)));
+  __m128i ab = _mm_or_si128(a, _mm_slli_epi32(b, 16));
+  __m128i c1 = _mm_or_si128(c, _mm_set1_epi32(1 << 16));
+  __m128i sum = _mm_add_epi32(_mm_madd_epi16(ab, weightsAB), _mm_madd_epi16(c1, weightsC));
+  return _mm_srai_epi32(sum, COLOUR_SHIFT);
+}
+
+// non-zero if all lanes of a, b and c lie in [0..32767]
+static inline int fitsInt16Lanes(__m128i a, __m128i b, __m128i c) {
+  __m128i outside = _mm_and_si128(_mm_or_si128(_mm_or_si128(a, b), c), _mm_set1_epi32((int)0xFFFF8000));
+  return _mm_movemask_epi8(_mm_cmpeq_epi32(outside, _mm_setzero_si128())) == 0xFFFF;
+}
+#endif
+
+/**
+ * dst[x] = offset + mixChannels(w, r[x], g[x], b[x]) for a row of n pixels.
+ */
+static void mixChannelRow(const int *w, int offset, const int *r, const int *g, const int *b, int *dst, int n) {
+  int x = 0;
+#ifdef __SSE2__
+  __m128i off = _mm_set1_epi32(offset);
+  for (; x + 4 <= n; x += 4) {
+    __m128i vr = _mm_loadu_si128((const __m128i *)(r + x));
+    __m128i vg = _mm_loadu_si128((const __m128i *)(g + x));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + x));
+    if (fitsInt16Lanes(vr, vg, vb)) {
+      _mm_storeu_si128((__m128i *)(dst + x), _mm_add_epi32(mixChannels4(w, vr, vg, vb), off));
+    } else {
+      for (int i = x; i < x + 4; i++) {
+        dst[i] = offset + mixChannels(w, r[i], g[i], b[i]);
+      }
+    }
+  }
+#endif
+  for (; x < n; x++) {
+    dst[x] = offset + mixChannels(w, r[x], g[x], b[x]);
+  }
+}
+
+static void rgb2GreyRows(void *arg, int begin, int end) {
+  ColourJob *job = arg;
+  int width = getWidth(job->rgb.domain);
+  for (int y = begin; y < end; y++) {
+    mixChannelRow(greyWeights[job->standard], 0, job->rgb.red[y], job->rgb.green[y], job->rgb.blue[y],
+                  job->ints[0][y], width);
+  }
+}
+
+/**
+ * Runs body over the rows of the image on multiple threads, in chunks of at least ~64K pixels.
+ */
+static void convertColourRows(ColourJob *job, void (*body)(void *arg, int begin, int end)) {
+  int width, height;
+  getWidthHeight(job->rgb.domain, &width, &height);
+  parallelFor(height, 1 + 65536 / width, body, job);
+}
+
+void rgb2GreyImg(RgbImage image, IntImage *grey, int standard) {
+  checkConversionSize(image.domain, grey->domain, "rgb2GreyImg");
+  if (standard != GREY_BT601 && standard != GREY_BT709) {
+    fatalError("rgb2GreyImg: unknown standard %d.\n", standard);
+  }
+  ColourJob job = {image, {grey->pixels}, {NULL}, standard, NULL, 0};
+  convertColourRows(&job, rgb2GreyRows);
+}
+
+static inline int centreOfRange(RgbImage image) { return (image.minRange + image.maxRange + 1) / 2; }
+
+static void rgb2YCbCrRows(void *arg, int begin, int end) {
+  ColourJob *job = arg;
+  int width = getWidth(job->rgb.domain);
+  int centre = centreOfRange(job->rgb);
+  for (int y = begin; y < end; y++) {
+    const int *r = job->rgb.red[y], *g = job->rgb.green[y], *b = job->rgb.blue[y];
+    mixChannelRow(greyWeights[GREY_BT601], 0, r, g, b, job->ints[0][y], width);
+    mixChannelRow(cbWeights, centre, r, g, b, job->ints[1][y], width);
+    mixChannelRow(crWeights, centre, r, g, b, job->ints[2][y], width);
+  }
+}
+
+static inline int clampToRange(int64_t v, int minVal, int maxVal) {
+  return (int)(v < minVal ? minVal : (v > maxVal ? maxVal : v));
+}
+
+static void yCbCr2RgbRows(void *arg, int begin, int end) {
+  ColourJob *job = arg;
+  int width = getWidth(job->rgb.domain);
+  int minVal = job->rgb.minRange, maxVal = job->rgb.maxRange;
+  int64_t centre = centreOfRange(job->rgb);
+  // 1.402, 0.344136, 0.714136 and 1.772 with COLOUR_SHIFT fractional bits
+  const int64_t crR = 45941, cbG = 11277, crG = 23401, cbB = 58065;
+  for (int y = begin; y < end; y++) {
+    const int *lum = job->ints[0][y], *cb = job->ints[1][y], *cr = job->ints[2][y];
+    int *r = job->rgb.red[y], *g = job->rgb.green[y], *b = job->rgb.blue[y];
+    for (int x = 0; x < width; x++) {
+      int64_t l = ((int64_t)lum[x] << COLOUR_SHIFT) + COLOUR_HALF;
+      int64_t u = cb[x] - centre, v = cr[x] - centre;
+      r[x] = clampToRange((l + crR * v) >> COLOUR_SHIFT, minVal, maxVal);
+      g[x] = clampToRange((l - cbG * u - crG * v) >> COLOUR_SHIFT, minVal, maxVal);
+      b[x] = clampToRange((l + cbB * u) >> COLOUR_SHIFT, minVal, maxVal);
+    }
+  }
+}
+
+void rgb2YCbCrImg(RgbImage image, IntImage *lum, IntImage *cb, IntImage *cr) {
+  checkConversionSize(image.domain, lum->domain, "rgb2YCbCrImg");
+  checkConversionSize(image.domain, cb->domain, "rgb2YCbCrImg");
+  checkConversionSize(image.domain, cr->domain, "rgb2YCbCrImg");
+  ColourJob job = {image, {lum->pixels, cb->pixels, cr->pixels}, {NULL}, 0, NULL, 0};
+  convertColourRows(&job, rgb2YCbCrRows);
+}
+
+void yCbCr2RgbImg(IntImage lum, IntImage cb, IntImage cr, RgbImage *image) {
+  checkConversionSize(image->domain, lum.domain, "yCbCr2RgbImg");
+  checkConversionSize(image->domain, cb.domain, "yCbCr2RgbImg");
+  checkConversionSize(image->domain, cr.domain, "yCbCr2RgbImg");
+  ColourJob job = {*image, {lum.pixels, cb.pixels, cr.pixels}, {NULL}, 0, NULL, 0};
+  convertColourRows(&job, yCbCr2RgbRows);
+}
+
+static void rgb2HsvRows(void *arg, int begin, int end) {
+  ColourJob *job = arg;
+  int width = getWidth(job->rgb.domain);
+  double minVal = job->rgb.minRange;
+  double scale = 1.0 / ((double)job->rgb.maxRange - job->rgb.minRange);
+  for (int y = begin; y < end; y++) {
+    const int *r = job->rgb.red[y], *g = job->rgb.green[y], *b = job->rgb.blue[y];
+    double *hue = job->doubles[0][y], *sat = job->doubles[1][y], *val = job->doubles[2][y];
+    for (int x = 0; x < width; x++) {
+      int hi = maxOp(r[x], maxOp(g[x], b[x]));
+      int lo = minOp(r[x], minOp(g[x], b[x]));
+      double delta = (double)hi - lo;
+      double h = 0.0;
+      if (delta > 0) {
+        if (hi == r[x]) {
+          h = (g[x] - b[x]) / delta;
+          h = (h < 0 ? h + 6.0 : h);
+        } else if (hi == g[x]) {
+          h = 2.0 + (b[x] - r[x]) / delta;
+        } else {
+          h = 4.0 + (r[x] - g[x]) / delta;
+        }
+      }
+      hue[x] = 60.0 * h;
+      val[x] = (hi - minVal) * scale;
+      sat[x] = (hi - minVal > 0 ? delta / (hi - minVal) : 0.0);
+    }
+  }
+}
+
+static void hsv2RgbRows(void *arg, int begin, int end) {
+  ColourJob *job = arg;
+  int width = getWidth(job->rgb.domain);
+  int minVal = job->rgb.minRange, maxVal = job->rgb.maxRange;
+  double scale = (double)maxVal - minVal;
+  for (int y = begin; y < end; y++) {
+    const double *hue = job->doubles[0][y], *sat = job->doubles[1][y], *val = job->doubles[2][y];
+    int *r = job->rgb.red[y], *g = job->rgb.green[y], *b = job->rgb.blue[y];
+    for (int x = 0; x < width; x++) {
+      double h = fmod(hue[x], 360.0) / 60.0;
+      h = (h < 0 ? h + 6.0 : h);
+      int sector = (int)h % 6;
+      double f = h - floor(h);
+      double v = val[x], s = sat[x];
+      double p = v * (1.0 - s), q = v * (1.0 - s * f), t = v * (1.0 - s * (1.0 - f));
+      double rgb[6][3] = {{v, t, p}, {q, v, p}, {p, v, t}, {p, q, v}, {t, p, v}, {v, p, q}};
+      r[x] = clampToRange(llround(minVal + rgb[sector][0] * scale), minVal, maxVal);
+      g[x] = clampToRange(llround(minVal + rgb[sector][1] * scale), minVal, maxVal);
+      b[x] = clampToRange(llround(minVal + rgb[sector][2] * scale), minVal, maxVal);
+    }
+  }
+}
+
+void rgb2HsvImg(RgbImage image, DoubleImage *hue, DoubleImage *saturation, DoubleImage *value) {
+  checkConversionSize(image.domain, hue->domain, "rgb2HsvImg");
+  checkConversionSize(image.domain, saturation->domain, "rgb2HsvImg");
+  checkConversionSize(image.domain, value->domain, "rgb2HsvImg");
+  ColourJob job = {image, {NULL}, {hue->pixels, saturation->pixels, value->pixels}, 0, NULL, 0};
+  convertColourRows(&job, rgb2HsvRows);
+}
+
+void hsv2RgbImg(DoubleImage hue, DoubleImage saturation, DoubleImage value, RgbImage *image) {
+  checkConversionSize(image->domain, hue.domain, "hsv2RgbImg");
+  checkConversionSize(image->domain, saturation.domain, "hsv2RgbImg");
+  checkConversionSize(image->domain, value.domain, "hsv2RgbImg");
+  ColourJob job = {*image, {NULL}, {hue.pixels, saturation.pixels, value.pixels}, 0, NULL, 0};
+  convertColourRows(&job, hsv2RgbRows);
+}
+
+/*
+ * Lab conversions treat the channels as sRGB, scaled to [0..1] by the dynamic range, with a D65 white point.
+ */
+static const double labWhite[3] = {0.95047, 1.0, 1.08883};
+
+static inline double srgbToLinear(double c) { return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4); }
+
+static inline double linearToSrgb(double c) { return c <= 0.0031308 ? 12.92 * c : 1.055 * pow(c, 1.0 / 2.4) - 0.055; }
+
+static inline double labF(double t) {
+  const double delta = 6.0 / 29.0;
+  return t > delta * delta * delta ? cbrt(t) : t / (3.0 * delta * delta) + 4.0 / 29.0;
+}
+
+static inline double labInverseF(double t) {
+  const double delta = 6.0 / 29.0;
+  return t > delta ? t * t * t : 3.0 * delta * delta * (t - 4.0 / 29.0);
+}
+
+// linear intensity of a channel value; values outside of the dynamic range (and of the table) are computed directly
+static inline double channelToLinear(const ColourJob *job, int value, double scale) {
+  int64_t index = (int64_t)value - job->rgb.minRange;
+  if (job->linear != NULL && index >= 0 && index < job->numLinear) {
+    return job->linear[index];
+  }
+  return srgbToLinear(index * scale);
+}
+
+static void rgb2LabRows(void *arg, int begin, int end) {
+  ColourJob *job = arg;
+  int width = getWidth(job->rgb.domain);
+  double range = (double)job->rgb.maxRange - job->rgb.minRange;
+  double scale = range > 0 ? 1.0 / range : 0.0;
+  for (int y = begin; y < end; y++) {
+    const int *r = job->rgb.red[y], *g = job->rgb.green[y], *b = job->rgb.blue[y];
+    double *lOut = job->doubles[0][y], *aOut = job->doubles[1][y], *bOut = job->doubles[2][y];
+    for (int x = 0; x < width; x++) {
+      double lr = channelToLinear(job, r[x], scale);
+      double lg = channelToLinear(job, g[x], scale);
+      double lb = channelToLinear(job, b[x], scale);
+      double fx = labF((0.4124564 * lr + 0.3575761 * lg + 0.1804375 * lb) / labWhite[0]);
+      double fy = labF((0.2126729 * lr + 0.7151522 * lg + 0.0721750 * lb) / labWhite[1]);
+      double fz = labF((0.0193339 * lr + 0.1191920 * lg + 0.9503041 * lb) / labWhite[2]);
+      lOut[x] = 116.0 * fy - 16.0;
+      aOut[x] = 500.0 * (fx - fy);
+      bOut[x] = 200.0 * (fy - fz);
+    }
+  }
+}
+
+static void lab2RgbRows(void *arg, int begin, int end) {
+  ColourJob *job = arg;
+  int width = getWidth(job->rgb.domain);
+  int minVal = job->rgb.minRange, maxVal = job->rgb.maxRange;
+  double scale = (double)maxVal - minVal;
+  for (int y = begin; y < end; y++) {
+    const double *lIn = job->doubles[0][y], *aIn = job->doubles[1][y], *bIn = job->doubles[2][y];
+    int *r = job->rgb.red[y], *g = job->rgb.green[y], *b = job->rgb.blue[y];
+    for (int x = 0; x < width; x++) {
+      double fy = (lIn[x] + 16.0) / 116.0;
+      double cx = labWhite[0] * labInverseF(fy + aIn[x] / 500.0);
+      double cy = labWhite[1] * labInverseF(fy);
+      double cz = labWhite[2] * labInverseF(fy - bIn[x] / 200.0);
+      double lr = 3.2404542 * cx - 1.5371385 * cy - 0.4985314 * cz;
+      double lg = -0.9692660 * cx + 1.8760108 * cy + 0.0415560 * cz;
+      double lb = 0.0556434 * cx - 0.2040259 * cy + 1.0572252 * cz;
+      r[x] = clampToRange(llround(minVal + linearToSrgb(fmax(lr, 0.0)) * scale), minVal, maxVal);
+      g[x] = clampToRange(llround(minVal + linearToSrgb(fmax(lg, 0.0)) * scale), minVal, maxVal);
+      b[x] = clampToRange(llround(minVal + linearToSrgb(fmax(lb, 0.0)) * scale), minVal, maxVal);
+    }
+  }
+}
+
+void rgb2LabImg(RgbImage image, DoubleImage *lightness, DoubleImage *a, DoubleImage *b) {
+  checkConversionSize(image.domain, lightness->domain, "rgb2LabImg");
+  checkConversionSize(image.domain, a->domain, "rgb2LabImg");
+  checkConversionSize(image.domain, b->domain, "rgb2LabImg");
+  ColourJob job = {image, {NULL}, {lightness->pixels, a->pixels, b->pixels}, 0, NULL, 0};
+  // the gamma curve is tabulated when the dynamic range is small enough, e.g. for 8 and 16 bit images
+  int64_t numValues = (int64_t)image.maxRange - image.minRange + 1;
+  if (numValues <= 65536) {
+    job.numLinear = (int)numValues;
+    job.linear = safeMalloc(numValues * sizeof(double));
+    for (int i = 0; i < numValues; i++) {
+      job.linear[i] = srgbToLinear(numValues > 1 ? i / (double)(numValues - 1) : 0.0);
+    }
+  }
+  convertColourRows(&job, rgb2LabRows);
+  free(job.linear);
+}
+
+void lab2RgbImg(DoubleImage lightness, DoubleImage a, DoubleImage b, RgbImage *image) {
+  checkConversionSize(image->domain, lightness.domain, "lab2RgbImg");
+  checkConversionSize(image->domain, a.domain, "lab2RgbImg");
+  checkConversionSize(image->domain, b.domain, "lab2RgbImg");
+  ColourJob job = {*image, {NULL}, {lightness.pixels, a.pixels, b.pixels}, 0, NULL, 0};
+  convertColourRows(&job, lab2RgbRows);
+}
+
+/** RGB channel dispatch ********************************************/
+
+/*
+ * The RGB variants of grey operations run the operation on views of the three channels at the same time, one thread
+ * per channel.
+ */
+typedef struct RgbChannelJob {
+  IntImage channels[3];
+  void (*op)(IntImage channel, int c, void *arg);
+  void *arg;
+} RgbChannelJob;
+
+static void runRgbChannels(void *arg, int begin, int end) {
+  RgbChannelJob *job = arg;
+  for (int c = begin; c < end; c++) {
+    job->op(job->channels[c], c, job->arg);
+  }
+}
+
+static void forEachRgbChannel(RgbImage image, void (*op)(IntImage channel, int c, void *arg), void *arg) {
+  RgbChannelJob job = {{getRedChannelView(image), getGreenChannelView(image), getBlueChannelView(image)}, op, arg};
+  // small images are not worth starting threads for
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  parallelFor(3, ((long)width * height >= 65536 ? 1 : 3), runRgbChannels, &job);
+}
+
+typedef struct RgbOpArgs {
+  int kw, kh, flag;
+  int metric, foreground;
+  IntImage results[3];
+  ComplexImage spectra[3];
+  Histogram histograms[3];
+} RgbOpArgs;
+
+static void dilateErodeChannel(IntImage channel, int c, void *arg) {
+  RgbOpArgs *args = arg;
+  args->results[c] = dilateErodeIntImageRect(channel, args->kw, args->kh, args->flag);
+}
+
+RgbImage dilateRgbImageRect(RgbImage image, int kw, int kh) {
+  RgbOpArgs args = {.kw = kw, .kh = kh, .flag = 1};
+  forEachRgbChannel(image, dilateErodeChannel, &args);
+  return mergeIntImagesToRgb(args.results[0], args.results[1], args.results[2]);
+}
+
+RgbImage erodeRgbImageRect(RgbImage image, int kw, int kh) {
+  RgbOpArgs args = {.kw = kw, .kh = kh, .flag = 0};
+  forEachRgbChannel(image, dilateErodeChannel, &args);
+  return mergeIntImagesToRgb(args.results[0], args.results[1], args.results[2]);
+}
+
+static void distanceTransformChannel(IntImage channel, int c, void *arg) {
+  RgbOpArgs *args = arg;
+  args->results[c] = distanceTransform(channel, args->metric, args->foreground);
+}
+
+RgbImage distanceTransformRgb(RgbImage image, int metric, int foreground) {
+  RgbOpArgs args = {.metric = metric, .foreground = foreground};
+  forEachRgbChannel(image, distanceTransformChannel, &args);
+  return mergeIntImagesToRgb(args.results[0], args.results[1], args.results[2]);
+}
+
+static void fftChannel(IntImage channel, int c, void *arg) {
+  RgbOpArgs *args = arg;
+  args->spectra[c] = fft2D(channel);
+}
+
+void fft2DRgb(RgbImage image, ComplexImage *red, ComplexImage *green, ComplexImage *blue) {
+  RgbOpArgs args = {0};
+  forEachRgbChannel(image, fftChannel, &args);
+  *red = args.spectra[0];
+  *green = args.spectra[1];
+  *blue = args.spectra[2];
+}
+
+static void histogramChannel(IntImage channel, int c, void *arg) {
+  RgbOpArgs *args = arg;
+  args->histograms[c] = createHistogram(channel);
+}
+
+void createRgbHistograms(RgbImage image, Histogram *redHist, Histogram *greenHist, Histogram *blueHist) {
+  RgbOpArgs args = {0};
+  forEachRgbChannel(image, histogramChannel, &args);
+  *redHist = args.histograms[0];
+  *greenHist = args.histograms[1];
+  *blueHist = args.histograms[2];
+}
+
+/** Float images ********************************************/
+
+FloatImage allocateFloatImage(int width, int height, float minValue, float maxValue) {
+  return allocateFloatImageGrid(0, width - 1, 0, height - 1, minValue, maxValue);
+}
+
+FloatImage allocateFloatImageGrid(int minX, int maxX, int minY, int maxY, float minValue, float maxValue) {
+  FloatImage image;
+  ImageDomain domain = initImageDomain(minX, maxX, minY, maxY);
+  image.domain = domain;
+  image.pixels = allocFloatMatrix(getWidth(domain), getHeight(domain));
+  image.minRange = minValue;
+  image.maxRange = maxValue;
+  return image;
+}
+
+FloatImage allocateFloatImageGridDomain(ImageDomain domain, float minValue, float maxValue) {
+  return allocateFloatImageGrid(domain.minX, domain.maxX, domain.minY, domain.maxY, minValue, maxValue);
+}
+
+FloatImage allocateDefaultFloatImage(int width, int height) {
+  return allocateFloatImage(width, height, -FLT_MAX, FLT_MAX);
+}
+
+FloatImage allocateFromFloatImage(FloatImage image) {
+  return allocateFloatImageGridDomain(image.domain, image.minRange, image.maxRange);
+}
+
+FloatImage copyFloatImage(FloatImage image) {
+  FloatImage copy = allocateFromFloatImage(image);
+  memcpy(copy.pixels[0], image.pixels[0], (size_t)getWidth(image.domain) * getHeight(image.domain) * sizeof(float));
+  return copy;
+}
+
+void freeFloatImage(FloatImage image) { free(image.pixels); }
+
+void getFloatDynamicRange(FloatImage image, float *minRange, float *maxRange) {
+  *minRange = image.minRange;
+  *maxRange = image.maxRange;
+}
+
+ImageDomain getFloatImageDomain(FloatImage image) { return image.domain; }
+
+void getFloatMinMax(FloatImage image, float *minimalValue, float *maximalValue) {
+  size_t n = (size_t)getWidth(image.domain) * getHeight(image.domain);
+  const float *p = image.pixels[0];
+  float minVal = p[0], maxVal = p[0];
+  for (size_t i = 1; i < n; i++) {
+    minVal = (p[i] < minVal ? p[i] : minVal);
+    maxVal = (p[i] > maxVal ? p[i] : maxVal);
+  }
+  *minimalValue = minVal;
+  *maximalValue = maxVal;
+}
+
+float getFloatPixel(FloatImage image, int x, int y) {
+#if FAST
+  return image.pixels[y - image.domain.minY][x - image.domain.minX];
+#else
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  checkDomain(x, y, minX, maxX, minY, maxY);
+  return image.pixels[y - minY][x - minX];
+#endif
+}
+
+float getFloatPixelI(FloatImage image, int x, int y) {
+#if FAST
+  return image.pixels[y][x];
+#else
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  checkDomainI(x, y, width, height);
+  return image.pixels[y][x];
+#endif
+}
+
+static float clampFloatPixel(const FloatImage *image, float val, const char *function) {
+  if (val < image->minRange) {
+    warning("%s: value %f is outside dynamic range [%f,%f]: clamped to %f\n", function, val, image->minRange,
+            image->maxRange, image->minRange);
+    return image->minRange;
+  }
+  if (val > image->maxRange) {
+    warning("%s: value %f is outside dynamic range [%f,%f]: clamped to %f\n", function, val, image->minRange,
+            image->maxRange, image->maxRange);
+    return image->maxRange;
+  }
+  return val;
+}
+
+void setFloatPixel(FloatImage *image, int x, int y, float val) {
+#if FAST
+  image->pixels[y - image->domain.minY][x - image->domain.minX] = val;
+#else
+  val = clampFloatPixel(image, val, "setFloatPixel");
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image->domain, &minX, &maxX, &minY, &maxY);
+  checkDomain(x, y, minX, maxX, minY, maxY);
+  image->pixels[y - minY][x - minX] = val;
+#endif
+}
+
+void setFloatPixelI(FloatImage *image, int x, int y, float val) {
+#if FAST
+  image->pixels[y][x] = val;
+#else
+  val = clampFloatPixel(image, val, "setFloatPixelI");
+  int width, height;
+  getWidthHeight(image->domain, &width, &height);
+  checkDomainI(x, y, width, height);
+  image->pixels[y][x] = val;
+#endif
+}
+
+void setAllFloatPixels(FloatImage *image, float val) {
+  val = clampFloatPixel(image, val, "setAllFloatPixels");
+  size_t n = (size_t)getWidth(image->domain) * getHeight(image->domain);
+  float *p = image->pixels[0];
+  for (size_t i = 0; i < n; i++) {
+    p[i] = val;
+  }
+}
+
+void printFloatBuffer(FloatImage image) {
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  for (int y = minY; y <= maxY; y++) {
+    for (int x = minX; x <= maxX; x++) {
+      printf("%.2f ", getFloatPixel(image, x, y));
+    }
+    printf("\n");
+  }
+}
+
+ComplexFloatImage allocateComplexFloatImage(int width, int height) {
+  return allocateComplexFloatImageGrid(0, width - 1, 0, height - 1);
+}
+
+ComplexFloatImage allocateComplexFloatImageGrid(int minX, int maxX, int minY, int maxY) {
+  ComplexFloatImage image;
+  image.domain = initImageDomain(minX, maxX, minY, maxY);
+  image.pixels = allocComplexFloatMatrix(getWidth(image.domain), getHeight(image.domain));
+  return image;
+}
+
+ComplexFloatImage allocateComplexFloatImageGridDomain(ImageDomain domain) {
+  return allocateComplexFloatImageGrid(domain.minX, domain.maxX, domain.minY, domain.maxY);
+}
+
+ComplexFloatImage allocateFromComplexFloatImage(ComplexFloatImage image) {
+  return allocateComplexFloatImageGridDomain(image.domain);
+}
+
+ComplexFloatImage copyComplexFloatImage(ComplexFloatImage image) {
+  ComplexFloatImage copy = allocateFromComplexFloatImage(image);
+  memcpy(copy.pixels[0], image.pixels[0],
+         (size_t)getWidth(image.domain) * getHeight(image.domain) * sizeof(float complex));
+  return copy;
+}
+
+void freeComplexFloatImage(ComplexFloatImage image) { free(image.pixels); }
+
+ImageDomain getComplexFloatImageDomain(ComplexFloatImage image) { return image.domain; }
+
+float complex getComplexFloatPixel(ComplexFloatImage image, int x, int y) {
+#if FAST
+  return image.pixels[y - image.domain.minY][x - image.domain.minX];
+#else
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  checkDomain(x, y, minX, maxX, minY, maxY);
+  return image.pixels[y - minY][x - minX];
+#endif
+}
+
+float complex getComplexFloatPixelI(ComplexFloatImage image, int x, int y) {
+#if FAST
+  return image.pixels[y][x];
+#else
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  checkDomainI(x, y, width, height);
+  return image.pixels[y][x];
+#endif
+}
+
+void setComplexFloatPixel(ComplexFloatImage *image, int x, int y, float complex complexValue) {
+#if FAST
+  image->pixels[y - image->domain.minY][x - image->domain.minX] = complexValue;
+#else
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image->domain, &minX, &maxX, &minY, &maxY);
+  checkDomain(x, y, minX, maxX, minY, maxY);
+  image->pixels[y - minY][x - minX] = complexValue;
+#endif
+}
+
+void setComplexFloatPixelI(ComplexFloatImage *image, int x, int y, float complex complexValue) {
+#if FAST
+  image->pixels[y][x] = complexValue;
+#else
+  int width, height;
+  getWidthHeight(image->domain, &width, &height);
+  checkDomainI(x, y, width, height);
+  image->pixels[y][x] = complexValue;
+#endif
+}
+
+void setAllComplexFloatPixels(ComplexFloatImage *image, float complex complexValue) {
+  size_t n = (size_t)getWidth(image->domain) * getHeight(image->domain);
+  float complex *p = image->pixels[0];
+  for (size_t i = 0; i < n; i++) {
+    p[i] = complexValue;
+  }
+}
+
+void printComplexFloatBuffer(ComplexFloatImage image) {
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(image.domain, &minX, &maxX, &minY, &maxY);
+  for (int y = minY; y <= maxY; y++) {
+    for (int x = minX; x <= maxX; x++) {
+      float complex val = getComplexFloatPixel(image, x, y);
+      printf("%.2f+%.2fi ", crealf(val), cimagf(val));
+    }
+    printf("\n");
+  }
+}
+
+/*
+ * The conversions below work on the whole pixel buffer at once, which is a single contiguous block for every image
+ * type. Float to int conversion rounds half up and clamps to the dynamic range of the result.
+ */
+
+static void convertIntsToFloats(const int *src, float *dst, size_t n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = (float)src[i];
+  }
+}
+
+static void convertFloatsToInts(const float *src, int *dst, size_t n, int minVal, int maxVal) {
+  size_t i = 0;
+  // the clamping bounds must be exactly representable floats that convert to ints without overflow
+  float lo = (minVal < -2147483520 ? -2147483520.0f : (float)minVal);
+  float hi = (maxVal > 2147483520 ? 2147483520.0f : (float)maxVal);
+#ifdef __SSE2__
+  __m128 half = _mm_set1_ps(0.5f), loV = _mm_set1_ps(lo), hiV = _mm_set1_ps(hi);
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_add_ps(_mm_loadu_ps(src + i), half);
+    // floor(v) for the clamped values: truncation, corrected by one where it rounded up
+    v = _mm_min_ps(_mm_max_ps(v, loV), hiV);
+    __m128i t = _mm_cvttps_epi32(v);
+    __m128 roundedUp = _mm_cmpgt_ps(_mm_cvtepi32_ps(t), v);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi32(t, _mm_castps_si128(roundedUp)));
+  }
+#endif
+  for (; i < n; i++) {
+    float v = src[i] + 0.5f;
+    v = (v < lo ? lo : (v > hi ? hi : v));
+    dst[i] = (int)floorf(v);
+  }
+}
+
+static void convertDoublesToFloats(const double *src, float *dst, size_t n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= n; i += 4) {
+    __m128 low = _mm_cvtpd_ps(_mm_loadu_pd(src + i));
+    __m128 high = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+    _mm_storeu_ps(dst + i, _mm_movelh_ps(low, high));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = (float)src[i];
+  }
+}
+
+static void convertFloatsToDoubles(const float *src, double *dst, size_t n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_loadu_ps(src + i);
+    _mm_storeu_pd(dst + i, _mm_cvtps_pd(v));
+    _mm_storeu_pd(dst + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = src[i];
+  }
+}
+
+static inline size_t numPixels(ImageDomain domain) { return (size_t)getWidth(domain) * getHeight(domain); }
+
+static inline int floatRangeToInt(float v) {
+  return (v <= (float)INT_MIN ? INT_MIN : (v >= (float)INT_MAX ? INT_MAX : (int)v));
+}
+
+FloatImage int2FloatImg(IntImage image) {
+  FloatImage result = allocateFloatImageGridDomain(image.domain, image.minRange, image.maxRange);
+  convertIntsToFloats(image.pixels[0], result.pixels[0], numPixels(image.domain));
+  return result;
+}
+
+IntImage float2IntImg(FloatImage image) {
+  IntImage result = allocateIntImageGridDomain(image.domain, floatRangeToInt(image.minRange),
+                                               floatRangeToInt(image.maxRange));
+  convertFloatsToInts(image.pixels[0], result.pixels[0], numPixels(image.domain), result.minRange,
+                      result.maxRange);
+  return result;
+}
+
+FloatImage double2FloatImg(DoubleImage image) {
+  float minRange = (image.minRange < -FLT_MAX ? -FLT_MAX : (float)image.minRange);
+  float maxRange = (image.maxRange > FLT_MAX ? FLT_MAX : (float)image.maxRange);
+  FloatImage result = allocateFloatImageGridDomain(image.domain, minRange, maxRange);
+  convertDoublesToFloats(image.pixels[0], result.pixels[0], numPixels(image.domain));
+  return result;
+}
+
+DoubleImage float2DoubleImg(FloatImage image) {
+  DoubleImage result = allocateDoubleImageGridDomain(image.domain, image.minRange, image.maxRange);
+  convertFloatsToDoubles(image.pixels[0], result.pixels[0], numPixels(image.domain));
+  return result;
+}
+
+ComplexFloatImage complex2ComplexFloatImg(ComplexImage image) {
+  ComplexFloatImage result = allocateComplexFloatImageGridDomain(image.domain);
+  // a complex value is a pair of reals, so the real conversion applies to twice as many values
+  convertDoublesToFloats((const double *)image.pixels[0], (float *)result.pixels[0], 2 * numPixels(image.domain));
+  return result;
+}
+
+ComplexImage complexFloat2ComplexImg(ComplexFloatImage image) {
+  ComplexImage result = allocateComplexImageGridDomain(image.domain);
+  convertFloatsToDoubles((const float *)image.pixels[0], (double *)result.pixels[0], 2 * numPixels(image.domain));
+  return result;
+}
+
+/** Float FFT ********************************************/
+
+/*
+ * Iterative radix-2 FFT on float complex rows. Bit reversal indices and twiddle factors are computed once per length,
+ * with the twiddles of each butterfly span stored contiguously, so the SIMD butterflies load them without gathers.
+ * With SSE2, a register holds two float complex values, twice as many as for double complex. Columns are transformed
+ * as rows of the transposed image. The inverse transform uses ifft(x) = conj(fft(conj(x))) / n.
+ */
+
+typedef struct FloatFFTPlan {
+  int n;
+  int *bitReverse;
+  float complex *twiddles;  // twiddles[half - 1 + k] = exp(-2 pi i k / (2 half)) for k < half
+} FloatFFTPlan;
+
+/**
+ * Returns the table i -> i with its log2(n) bits reversed, for a power of two n.
+ */
+static int *createBitReversalTable(int n) {
+  int *table = safeMalloc(n * sizeof(int));
+  int bits = 0;
+  while ((1 << bits) < n) {
+    bits++;
+  }
+  for (int i = 0; i < n; i++) {
+    int r = 0;
+    for (int b = 0; b < bits; b++) {
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    table[i] = r;
+  }
+  return table;
+}
+
+static FloatFFTPlan createFloatFFTPlan(int n) {
+  FloatFFTPlan plan;
+  plan.n = n;
+  plan.bitReverse = createBitReversalTable(n);
+  plan.twiddles = safeMalloc((n > 1 ? n - 1 : 1) * sizeof(float complex));
+  for (int half = 1; half < n; half *= 2) {
+    for (int k = 0; k < half; k++) {
+      // computed in double precision, so that every twiddle is correctly rounded
+      plan.twiddles[half - 1 + k] = (float complex)cexp(-PI * I * k / half);
+    }
+  }
+  return plan;
+}
+
+static void freeFloatFFTPlan(FloatFFTPlan plan) {
+  free(plan.bitReverse);
+  free(plan.twiddles);
+}
+
+#ifdef __SSE2__
+/**
+ * Multiplies the two float complex values in a by those in b.
+ */
+static inline __m128 multiplyComplexFloat2(__m128 a, __m128 b) {
+  __m128 bRe = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+  __m128 bIm = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+  __m128 aSwapped = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+  __m128 negateReal = _mm_castsi128_ps(_mm_set_epi32(0, (int)0x80000000, 0, (int)0x80000000));
+  return _mm_add_ps(_mm_mul_ps(a, bRe), _mm_xor_ps(_mm_mul_ps(aSwapped, bIm), negateReal));
+}
+#endif
+
+static void fftFloatRow(float complex *a, const FloatFFTPlan *plan) {
+  int n = plan->n;
+  for (int i = 0; i < n; i++) {
+    int j = plan->bitReverse[i];
+    if (j > i) {
+      float complex t = a[i];
+      a[i] = a[j];
+      a[j] = t;
+    }
+  }
+  for (int half = 1; half < n; half *= 2) {
+    const float complex *w = plan->twiddles + half - 1;
+    for (int i = 0; i < n; i += 2 * half) {
+      float complex *lo = a + i, *hi = a + i + half;
+      int k = 0;
+#ifdef __SSE2__
+      for (; k + 2 <= half; k += 2) {
+        __m128 u = _mm_loadu_ps((const float *)(lo + k));
+        __m128 v = multiplyComplexFloat2(_mm_loadu_ps((const float *)(hi + k)), _mm_loadu_ps((const float *)(w + k)));
+        _mm_storeu_ps((float *)(lo + k), _mm_add_ps(u, v));
+        _mm_storeu_ps((float *)(hi + k), _mm_sub_ps(u, v));
+      }
+#endif
+      for (; k < half; k++) {
+        float complex u = lo[k], v = hi[k] * w[k];
+        lo[k] = u + v;
+        hi[k] = u - v;
+      }
+    }
+  }
+}
+
+typedef struct FloatFFTJob {
+  float complex **rows;
+  const FloatFFTPlan *plan;
+  int inverse;
+} FloatFFTJob;
+
+static void fftFloatRows(void *arg, int begin, int end) {
+  FloatFFTJob *job = arg;
+  int n = job->plan->n;
+  float scale = 1.0f / n;
+  for (int y = begin; y < end; y++) {
+    float complex *row = job->rows[y];
+    if (job->inverse) {
+      for (int x = 0; x < n; x++) {
+        row[x] = conjf(row[x]);
+      }
+      fftFloatRow(row, job->plan);
+      for (int x = 0; x < n; x++) {
+        row[x] = conjf(row[x]) * scale;
+      }
+    } else {
+      fftFloatRow(row, job->plan);
+    }
+  }
+}
+
+/**
+ * Transforms the rows and then the columns of a width x height image in place.
+ */
+static void fft2DFloatInPlace(float complex **pixels, int width, int height, int inverse) {
+  FloatFFTPlan rowPlan = createFloatFFTPlan(width);
+  FloatFFTPlan colPlan = createFloatFFTPlan(height);
+  // chunks of at least ~64K butterflies
+  FloatFFTJob rowJob = {pixels, &rowPlan, inverse};
+  parallelFor(height, 1 + 65536 / width, fftFloatRows, &rowJob);
+  // a float complex is 8 bytes, so the double transpose kernel moves it unchanged
+  float complex **transposed = allocComplexFloatMatrix(height, width);
+  transposePixels(transposeDoubleStrips, (void **)pixels, (void **)transposed, width, height, 0, 0);
+  FloatFFTJob colJob = {transposed, &colPlan, inverse};
+  parallelFor(width, 1 + 65536 / height, fftFloatRows, &colJob);
+  transposePixels(transposeDoubleStrips, (void **)transposed, (void **)pixels, height, width, 0, 0);
+  free(transposed);
+  freeFloatFFTPlan(rowPlan);
+  freeFloatFFTPlan(colPlan);
+}
+
+static void checkFFTSize(ImageDomain domain, const char *function) {
+  int width, height;
+  getWidthHeight(domain, &width, &height);
+  if (!(isPowerOfTwo(width) && isPowerOfTwo(height))) {
+    fatalError("%s: image width and height need to be powers of two. (width=%d, height=%d)\n", function, width,
+               height);
+  }
+}
+
+ComplexFloatImage fft2DFloat(FloatImage image) {
+  checkFFTSize(image.domain, "fft2DFloat");
+  ComplexFloatImage ft = allocateComplexFloatImageGridDomain(image.domain);
+  size_t n = numPixels(image.domain);
+  const float *src = image.pixels[0];
+  float complex *dst = ft.pixels[0];
+  for (size_t i = 0; i < n; i++) {
+    dst[i] = src[i];
+  }
+  fft2DFloatInPlace(ft.pixels, getWidth(image.domain), getHeight(image.domain), 0);
+  return ft;
+}
+
+ComplexFloatImage fft2DComplexFloat(ComplexFloatImage image) {
+  checkFFTSize(image.domain, "fft2DComplexFloat");
+  ComplexFloatImage ft = copyComplexFloatImage(image);
+  fft2DFloatInPlace(ft.pixels, getWidth(image.domain), getHeight(image.domain), 0);
+  return ft;
+}
+
+ComplexFloatImage ifft2DComplexFloat(ComplexFloatImage image) {
+  checkFFTSize(image.domain, "ifft2DComplexFloat");
+  ComplexFloatImage ift = copyComplexFloatImage(image);
+  fft2DFloatInPlace(ift.pixels, getWidth(image.domain), getHeight(image.domain), 1);
+  return ift;
+}
+
+FloatImage ifft2DFloat(ComplexFloatImage image) {
+  checkFFTSize(image.domain, "ifft2DFloat");
+  ComplexFloatImage ift = ifft2DComplexFloat(image);
+  FloatImage result = allocateFloatImageGridDomain(image.domain, -FLT_MAX, FLT_MAX);
+  size_t n = numPixels(image.domain);
+  for (size_t i = 0; i < n; i++) {
+    result.pixels[0][i] = crealf(ift.pixels[0][i]);
+  }
+  freeComplexFloatImage(ift);
+  return result;
+}
+
+ComplexFloatImage multiplyComplexFloatImage(ComplexFloatImage imageA, ComplexFloatImage imageB) {
+  if (memcmp(&imageA.domain, &imageB.domain, sizeof(ImageDomain)) != 0) {
+    fatalError("multiplyComplexFloatImage: images do not have the same domain.\n");
+  }
+  ComplexFloatImage result = allocateFromComplexFloatImage(imageA);
+  size_t n = numPixels(imageA.domain), i = 0;
+  const float complex *a = imageA.pixels[0], *b = imageB.pixels[0];
+  float complex *dst = result.pixels[0];
+#ifdef __SSE2__
+  for (; i + 2 <= n; i += 2) {
+    __m128 product = multiplyComplexFloat2(_mm_loadu_ps((const float *)(a + i)), _mm_loadu_ps((const float *)(b + i)));
+    _mm_storeu_ps((float *)(dst + i), product);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = a[i] * b[i];
+  }
+  return result;
+}
+
+/** Split complex images ********************************************/
+
+SplitComplexImage allocateSplitComplexImage(int width, int height) {
+  return allocateSplitComplexImageGrid(0, width - 1, 0, height - 1);
+}
+
+SplitComplexImage allocateSplitComplexImageGrid(int minX, int maxX, int minY, int maxY) {
+  SplitComplexImage image;
+  image.domain = initImageDomain(minX, maxX, minY, maxY);
+  image.re = allocDoubleMatrix(getWidth(image.domain), getHeight(image.domain));
+  image.im = allocDoubleMatrix(getWidth(image.domain), getHeight(image.domain));
+  return image;
+}
+
+SplitComplexImage allocateSplitComplexImageGridDomain(ImageDomain domain) {
+  return allocateSplitComplexImageGrid(domain.minX, domain.maxX, domain.minY, domain.maxY);
+}
+
+SplitComplexImage copySplitComplexImage(SplitComplexImage image) {
+  SplitComplexImage copy = allocateSplitComplexImageGridDomain(image.domain);
+  size_t planeSize = numPixels(image.domain) * sizeof(double);
+  memcpy(copy.re[0], image.re[0], planeSize);
+  memcpy(copy.im[0], image.im[0], planeSize);
+  return copy;
+}
+
+void freeSplitComplexImage(SplitComplexImage image) {
+  free(image.re);
+  free(image.im);
+}
+
+ImageDomain getSplitComplexImageDomain(SplitComplexImage image) { return image.domain; }
+
+SplitComplexImage complex2SplitComplexImg(ComplexImage image) {
+  SplitComplexImage result = allocateSplitComplexImageGridDomain(image.domain);
+  size_t n = numPixels(image.domain);
+  const double complex *src = image.pixels[0];
+  double *re = result.re[0], *im = result.im[0];
+  for (size_t i = 0; i < n; i++) {
+    re[i] = creal(src[i]);
+    im[i] = cimag(src[i]);
+  }
+  return result;
+}
+
+ComplexImage splitComplex2ComplexImg(SplitComplexImage image) {
+  ComplexImage result = allocateComplexImageGridDomain(image.domain);
+  size_t n = numPixels(image.domain);
+  double complex *dst = result.pixels[0];
+  const double *re = image.re[0], *im = image.im[0];
+  for (size_t i = 0; i < n; i++) {
+    dst[i] = re[i] + im[i] * I;
+  }
+  return result;
+}
+
+static void checkSplitDomains(SplitComplexImage imageA, SplitComplexImage imageB, const char *function) {
+  if (memcmp(&imageA.domain, &imageB.domain, sizeof(ImageDomain)) != 0) {
+    fatalError("%s: images do not have the same domain.\n", function);
+  }
+}
+
+/**
+ * (aRe + i aIm) * (bRe + i bIm), with b conjugated when conjugate is set. In split form this is four multiplies and
+ * two adds per value, with no shuffles.
+ */
+static SplitComplexImage multiplySplit(SplitComplexImage imageA, SplitComplexImage imageB, int conjugate) {
+  SplitComplexImage result = allocateSplitComplexImageGridDomain(imageA.domain);
+  size_t n = numPixels(imageA.domain), i = 0;
+  const double *aRe = imageA.re[0], *aIm = imageA.im[0], *bRe = imageB.re[0], *bIm = imageB.im[0];
+  double *re = result.re[0], *im = result.im[0];
+  double sign = (conjugate ? -1.0 : 1.0);
+#ifdef __SSE2__
+  __m128d signV = _mm_set1_pd(sign);
+  for (; i + 2 <= n; i += 2) {
+    __m128d ar = _mm_loadu_pd(aRe + i), ai = _mm_loadu_pd(aIm + i);
+    __m128d br = _mm_loadu_pd(bRe + i), bi = _mm_mul_pd(_mm_loadu_pd(bIm + i), signV);
+    _mm_storeu_pd(re + i, _mm_sub_pd(_mm_mul_pd(ar, br), _mm_mul_pd(ai, bi)));
+    _mm_storeu_pd(im + i, _mm_add_pd(_mm_mul_pd(ar, bi), _mm_mul_pd(ai, br)));
+  }
+#endif
+  for (; i < n; i++) {
+    double bi = sign * bIm[i];
+    re[i] = aRe[i] * bRe[i] - aIm[i] * bi;
+    im[i] = aRe[i] * bi + aIm[i] * bRe[i];
+  }
+  return result;
+}
+
+SplitComplexImage multiplySplitComplexImage(SplitComplexImage imageA, SplitComplexImage imageB) {
+  checkSplitDomains(imageA, imageB, "multiplySplitComplexImage");
+  return multiplySplit(imageA, imageB, 0);
+}
+
+SplitComplexImage conjugateMultiplySplitComplexImage(SplitComplexImage imageA, SplitComplexImage imageB) {
+  checkSplitDomains(imageA, imageB, "conjugateMultiplySplitComplexImage");
+  return multiplySplit(imageA, imageB, 1);
+}
+
+DoubleImage splitComplexMagnitude(SplitComplexImage image) {
+  DoubleImage result = allocateDoubleImageGridDomain(image.domain, 0, DBL_MAX);
+  size_t n = numPixels(image.domain), i = 0;
+  const double *re = image.re[0], *im = image.im[0];
+  double *dst = result.pixels[0];
+#ifdef __SSE2__
+  for (; i + 2 <= n; i += 2) {
+    __m128d r = _mm_loadu_pd(re + i), m = _mm_loadu_pd(im + i);
+    _mm_storeu_pd(dst + i, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(r, r), _mm_mul_pd(m, m))));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = sqrt(re[i] * re[i] + im[i] * im[i]);
+  }
+  return result;
+}
+
+DoubleImage splitComplexLogMagnitude(SplitComplexImage image) {
+  DoubleImage result = splitComplexMagnitude(image);
+  size_t n = numPixels(image.domain);
+  double *dst = result.pixels[0];
+  for (size_t i = 0; i < n; i++) {
+    dst[i] = log1p(dst[i]);
+  }
+  return result;
+}
+
+/*
+ * The split FFT is the radix-2 algorithm of the float FFT on separate real and imaginary rows. Real and imaginary
+ * twiddles are separate arrays too, so a butterfly is plain multiplies and adds on whole registers. Swapping the real
+ * and imaginary rows conjugates and swaps at the same time, so the inverse transform is the forward transform on
+ * (im, re), scaled by 1/n.
+ */
+
+typedef struct SplitFFTPlan {
+  int n;
+  int *bitReverse;
+  double *twiddleRe, *twiddleIm;  // twiddle[half - 1 + k] = exp(-2 pi i k / (2 half)) for k < half
+} SplitFFTPlan;
+
+static SplitFFTPlan createSplitFFTPlan(int n) {
+  SplitFFTPlan plan;
+  plan.n = n;
+  plan.bitReverse = createBitReversalTable(n);
+  plan.twiddleRe = safeMalloc((n > 1 ? n - 1 : 1) * sizeof(double));
+  plan.twiddleIm = safeMalloc((n > 1 ? n - 1 : 1) * sizeof(double));
+  for (int half = 1; half < n; half *= 2) {
+    for (int k = 0; k < half; k++) {
+      plan.twiddleRe[half - 1 + k] = cos(PI * k / half);
+      plan.twiddleIm[half - 1 + k] = -sin(PI * k / half);
+    }
+  }
+  return plan;
+}
+
+static void freeSplitFFTPlan(SplitFFTPlan plan) {
+  free(plan.bitReverse);
+  free(plan.twiddleRe);
+  free(plan.twiddleIm);
+}
+
+static void fftSplitRow(double *re, double *im, const SplitFFTPlan *plan) {
+  int n = plan->n;
+  for (int i = 0; i < n; i++) {
+    int j = plan->bitReverse[i];
+    if (j > i) {
+      double t = re[i];
+      re[i] = re[j];
+      re[j] = t;
+      t = im[i];
+      im[i] = im[j];
+      im[j] = t;
+    }
+  }
+  for (int half = 1; half < n; half *= 2) {
+    const double *wRe = plan->twiddleRe + half - 1, *wIm = plan->twiddleIm + half - 1;
+    for (int i = 0; i < n; i += 2 * half) {
+      double *loRe = re + i, *loIm = im + i, *hiRe = re + i + half, *hiIm = im + i + half;
+      int k = 0;
+#ifdef __SSE2__
+      for (; k + 2 <= half; k += 2) {
+        __m128d wr = _mm_loadu_pd(wRe + k), wi = _mm_loadu_pd(wIm + k);
+        __m128d hr = _mm_loadu_pd(hiRe + k), hi = _mm_loadu_pd(hiIm + k);
+        __m128d vr = _mm_sub_pd(_mm_mul_pd(hr, wr), _mm_mul_pd(hi, wi));
+        __m128d vi = _mm_add_pd(_mm_mul_pd(hr, wi), _mm_mul_pd(hi, wr));
+        __m128d ur = _mm_loadu_pd(loRe + k), ui = _mm_loadu_pd(loIm + k);
+        _mm_storeu_pd(loRe + k, _mm_add_pd(ur, vr));
+        _mm_storeu_pd(loIm + k, _mm_add_pd(ui, vi));
+        _mm_storeu_pd(hiRe + k, _mm_sub_pd(ur, vr));
+        _mm_storeu_pd(hiIm + k, _mm_sub_pd(ui, vi));
+      }
+#endif
+      for (; k < half; k++) {
+        double vr = hiRe[k] * wRe[k] - hiIm[k] * wIm[k];
+        double vi = hiRe[k] * wIm[k] + hiIm[k] * wRe[k];
+        double ur = loRe[k], ui = loIm[k];
+        loRe[k] = ur + vr;
+        loIm[k] = ui + vi;
+        hiRe[k] = ur - vr;
+        hiIm[k] = ui - vi;
+      }
+    }
+  }
+}
+
+typedef struct SplitFFTJob {
+  double **re, **im;
+  const SplitFFTPlan *plan;
+  int inverse;
+} SplitFFTJob;
+
+static void fftSplitRows(void *arg, int begin, int end) {
+  SplitFFTJob *job = arg;
+  int n = job->plan->n;
+  double scale = 1.0 / n;
+  for (int y = begin; y < end; y++) {
+    if (job->inverse) {
+      fftSplitRow(job->im[y], job->re[y], job->plan);
+      for (int x = 0; x < n; x++) {
+        job->re[y][x] *= scale;
+        job->im[y][x] *= scale;
+      }
+    } else {
+      fftSplitRow(job->re[y], job->im[y], job->plan);
+    }
+  }
+}
+
+// the row and column plans of a 2D transform, plus the buffers for the transposed planes
+typedef struct SplitFFT2D {
+  int width, height;
+  SplitFFTPlan rowPlan, colPlan;
+  double **re, **im;
+} SplitFFT2D;
+
+static SplitFFT2D createSplitFFT2D(int width, int height) {
+  SplitFFT2D fft;
+  fft.width = width;
+  fft.height = height;
+  fft.rowPlan = createSplitFFTPlan(width);
+  fft.colPlan = createSplitFFTPlan(height);
+  fft.re = allocDoubleMatrix(height, width);
+  fft.im = allocDoubleMatrix(height, width);
+  return fft;
+}
+
+static void freeSplitFFT2D(SplitFFT2D fft) {
+  freeSplitFFTPlan(fft.rowPlan);
+  freeSplitFFTPlan(fft.colPlan);
+  free(fft.re);
+  free(fft.im);
+}
+
+static void runSplitFFT2D(const SplitFFT2D *fft, double **re, double **im, int inverse) {
+  int width = fft->width, height = fft->height;
+  SplitFFTJob rowJob = {re, im, &fft->rowPlan, inverse};
+  parallelFor(height, 1 + 65536 / width, fftSplitRows, &rowJob);
+  transposePixels(transposeDoubleStrips, (void **)re, (void **)fft->re, width, height, 0, 0);
+  transposePixels(transposeDoubleStrips, (void **)im, (void **)fft->im, width, height, 0, 0);
+  SplitFFTJob colJob = {fft->re, fft->im, &fft->colPlan, inverse};
+  parallelFor(width, 1 + 65536 / height, fftSplitRows, &colJob);
+  transposePixels(transposeDoubleStrips, (void **)fft->re, (void **)re, height, width, 0, 0);
+  transposePixels(transposeDoubleStrips, (void **)fft->im, (void **)im, height, width, 0, 0);
+}
+
+static void fft2DSplitInPlace(SplitComplexImage image, int inverse) {
+  int width, height;
+  getWidthHeight(image.domain, &width, &height);
+  SplitFFT2D fft = createSplitFFT2D(width, height);
+  runSplitFFT2D(&fft, image.re, image.im, inverse);
+  freeSplitFFT2D(fft);
+}
+
+SplitComplexImage fft2DSplit(DoubleImage image) {
+  checkFFTSize(image.domain, "fft2DSplit");
+  SplitComplexImage ft = allocateSplitComplexImageGridDomain(image.domain);
+  size_t planeSize = numPixels(image.domain) * sizeof(double);
+  memcpy(ft.re[0], image.pixels[0], planeSize);
+  memset(ft.im[0], 0, planeSize);
+  fft2DSplitInPlace(ft, 0);
+  return ft;
+}
+
+SplitComplexImage fft2DSplitComplex(SplitComplexImage image) {
+  checkFFTSize(image.domain, "fft2DSplitComplex");
+  SplitComplexImage ft = copySplitComplexImage(image);
+  fft2DSplitInPlace(ft, 0);
+  return ft;
+}
+
+SplitComplexImage ifft2DSplitComplex(SplitComplexImage image) {
+  checkFFTSize(image.domain, "ifft2DSplitComplex");
+  SplitComplexImage ift = copySplitComplexImage(image);
+  fft2DSplitInPlace(ift, 1);
+  return ift;
+}
+
+DoubleImage ifft2DSplit(SplitComplexImage image) {
+  SplitComplexImage ift = ifft2DSplitComplex(image);
+  DoubleImage result = allocateDoubleImageGridDomain(image.domain, -DBL_MAX, DBL_MAX);
+  memcpy(result.pixels[0], ift.re[0], numPixels(image.domain) * sizeof(double));
+  freeSplitComplexImage(ift);
+  return result;
+}
+
+/** Frequency filters ********************************************/
+
+/*
+ * The transfer functions only depend on the distance to the DC component, so a row of the filter only depends on
+ * |v| and a pixel within the row only on |u|. A FrequencyFilter stores one real-valued row per distinct |v|; each of
+ * those is computed for the distinct |u| values only and then laid out to match the pixel order of the spectrum.
+ */
+struct FrequencyFilter {
+  int width, height;
+  double **rows;  // (height / 2 + 1) rows of width transfer values
+  int *rowIndex;  // for every y, the row of the table to use
+};
+
+// the distance to the DC component along an axis of the given length
+static int frequencyDistance(int index, int length, int centered) {
+  int dist = centered ? index - length / 2 : (index <= length / 2 ? index : index - length);
+  return dist < 0 ? -dist : dist;
+}
+
+static double frequencyTransfer(double dist, int type, FilterParams params) {
+  double pass;
+  if (params.band != FILTER_BANDPASS) {
+    double ratio = dist / params.cutoff;
+    switch (type) {
+      case FILTER_IDEAL:
+        pass = (dist <= params.cutoff);
+        break;
+      case FILTER_BUTTERWORTH:
+        pass = 1.0 / (1.0 + pow(ratio * ratio, params.order));
+        break;
+      default:
+        pass = exp(-0.5 * ratio * ratio);
+        break;
+    }
+    return params.band == FILTER_HIGHPASS ? 1.0 - pass : pass;
+  }
+  // band-pass around the frequency cutoff with width bandWidth
+  if (type == FILTER_IDEAL) {
+    return fabs(dist - params.cutoff) <= params.bandWidth / 2;
+  }
+  if (dist == 0) {
+    return params.cutoff == 0;
+  }
+  double ratio = (dist * dist - params.cutoff * params.cutoff) / (dist * params.bandWidth);
+  if (type == FILTER_BUTTERWORTH) {
+    return 1.0 / (1.0 + pow(ratio * ratio, params.order));
+  }
+  return exp(-ratio * ratio);
+}
+
+static void checkFilterParams(int type, FilterParams params) {
+  if (type < FILTER_IDEAL || type > FILTER_GAUSSIAN) {
+    fatalError("createFrequencyFilter: unknown filter type %d.\n", type);
+  }
+  if (params.band < FILTER_LOWPASS || params.band > FILTER_BANDPASS) {
+    fatalError("createFrequencyFilter: unknown filter band %d.\n", params.band);
+  }
+  if (params.cutoff < 0 || (params.band != FILTER_BANDPASS && params.cutoff == 0)) {
+    fatalError("createFrequencyFilter: invalid cutoff frequency %f.\n", params.cutoff);
+  }
+  if (params.band == FILTER_BANDPASS && params.bandWidth <= 0) {
+    fatalError("createFrequencyFilter: invalid band width %f.\n", params.bandWidth);
+  }
+  if (type == FILTER_BUTTERWORTH && params.order < 1) {
+    fatalError("createFrequencyFilter: Butterworth order must be at least 1 (order=%d).\n", params.order);
+  }
+}
+
+FrequencyFilter *createFrequencyFilter(int width, int height, int type, FilterParams params) {
+  checkFilterParams(type, params);
+  if (width < 1 || height < 1) {
+    fatalError("createFrequencyFilter: invalid size %dx%d.\n", width, height);
+  }
+  FrequencyFilter *filter = safeMalloc(sizeof(FrequencyFilter));
+  filter->width = width;
+  filter->height = height;
+  int numRows = height / 2 + 1;
+  int numCols = width / 2 + 1;
+  filter->rows = allocDoubleMatrix(width, numRows);
+  filter->rowIndex = safeMalloc(height * sizeof(int));
+  for (int y = 0; y < height; y++) {
+    filter->rowIndex[y] = frequencyDistance(y, height, params.centered);
+  }
+  int *colIndex = safeMalloc(width * sizeof(int));
+  for (int x = 0; x < width; x++) {
+    colIndex[x] = frequencyDistance(x, width, params.centered);
+  }
+  double *quadrantRow = safeMalloc(numCols * sizeof(double));
+  for (int v = 0; v < numRows; v++) {
+    for (int u = 0; u < numCols; u++) {
+      quadrantRow[u] = frequencyTransfer(sqrt((double)u * u + (double)v * v), type, params);
+    }
+    double *row = filter->rows[v];
+    for (int x = 0; x < width; x++) {
+      row[x] = quadrantRow[colIndex[x]];
+    }
+  }
+  free(quadrantRow);
+  free(colIndex);
+  return filter;
+}
+
+void freeFrequencyFilter(FrequencyFilter *filter) {
+  free(filter->rows);
+  free(filter->rowIndex);
+  free(filter);
+}
+
+typedef struct FilterJob {
+  const FrequencyFilter *filter;
+  double complex **pixels;
+} FilterJob;
+
+static void filterRows(void *arg, int begin, int end) {
+  FilterJob *job = arg;
+  int width = job->filter->width;
+  for (int y = begin; y < end; y++) {
+    const double *transfer = job->filter->rows[job->filter->rowIndex[y]];
+    double *row = (double *)job->pixels[y];
+    for (int x = 0; x < width; x++) {
+      row[2 * x] *= transfer[x];
+      row[2 * x + 1] *= transfer[x];
+    }
+  }
+}
+
+void applyFrequencyFilterTo(ComplexImage *image, const FrequencyFilter *filter) {
+  int width, height;
+  getWidthHeight(getComplexImageDomain(*image), &width, &height);
+  if (width != filter->width || height != filter->height) {
+    fatalError("applyFrequencyFilterTo: filter of size %dx%d does not match image of size %dx%d.\n", filter->width,
+               filter->height, width, height);
+  }
+  FilterJob job = {filter, image->pixels};
+  parallelFor(height, 1 + 65536 / width, filterRows, &job);
+}
+
+void applyFrequencyFilter(ComplexImage *image, int type, FilterParams params) {
+  int width, height;
+  getWidthHeight(getComplexImageDomain(*image), &width, &height);
+  FrequencyFilter *filter = createFrequencyFilter(width, height, type, params);
+  applyFrequencyFilterTo(image, filter);
+  freeFrequencyFilter(filter);
+}
+
+/** Phase correlation ********************************************/
+
+/*
+ * Both (real) frames are windowed and packed into a single complex image, a in the real plane and b in the imaginary
+ * plane, so that one complex FFT yields both spectra: with Z the transform and Z' = conj(Z(-u, -v)), the spectra are
+ * A = (Z + Z') / 2 and B = (Z - Z') / 2i. The plans, window and planes are kept in the correlator, so registering a
+ * sequence of frames does not allocate.
+ */
+struct PhaseCorrelator {
+  int width, height;
+  SplitFFT2D fft;
+  double *windowX, *windowY;
+  double **re, **im;
+  double **crossRe, **crossIm;
+};
+
+static double *createHannWindow(int n) {
+  double *window = safeMalloc(n * sizeof(double));
+  for (int i = 0; i < n; i++) {
+    window[i] = (n == 1 ? 1.0 : 0.5 - 0.5 * cos(2 * PI * i / (n - 1)));
+  }
+  return window;
+}
+
+PhaseCorrelator *createPhaseCorrelator(int width, int height) {
+  checkFFTSize(initImageDomain(0, width - 1, 0, height - 1), "createPhaseCorrelator");
+  PhaseCorrelator *correlator = safeMalloc(sizeof(PhaseCorrelator));
+  correlator->width = width;
+  correlator->height = height;
+  correlator->fft = createSplitFFT2D(width, height);
+  correlator->windowX = createHannWindow(width);
+  correlator->windowY = createHannWindow(height);
+  correlator->re = allocDoubleMatrix(width, height);
+  correlator->im = allocDoubleMatrix(width, height);
+  correlator->crossRe = allocDoubleMatrix(width, height);
+  correlator->crossIm = allocDoubleMatrix(width, height);
+  return correlator;
+}
+
+void freePhaseCorrelator(PhaseCorrelator *correlator) {
+  freeSplitFFT2D(correlator->fft);
+  free(correlator->windowX);
+  free(correlator->windowY);
+  free(correlator->re);
+  free(correlator->im);
+  free(correlator->crossRe);
+  free(correlator->crossIm);
+  free(correlator);
+}
+
+typedef struct CrossSpectrumJob {
+  double **re, **im;        // transform of the packed pair a + ib
+  double **outRe, **outIm;  // B conj(A)
+  int width, height;
+  int normalize;  // if set, the result is divided by its magnitude (the cross-power spectrum)
+} CrossSpectrumJob;
+
+// computes the cross spectrum B conj(A) of two real images a and b from the transform of a + ib
+static void crossSpectrumRows(void *arg, int begin, int end) {
+  CrossSpectrumJob *job = arg;
+  int width = job->width, height = job->height;
+  for (int y = begin; y < end; y++) {
+    int my = (height - y) & (height - 1);
+    const double *zRe = job->re[y], *zIm = job->im[y], *mRe = job->re[my], *mIm = job->im[my];
+    double *outRe = job->outRe[y], *outIm = job->outIm[y];
+    for (int x = 0; x < width; x++) {
+      int mx = (width - x) & (width - 1);
+      // P = Z - Z' = 2i B and Q = Z + Z' = 2 A, so B conj(A) = -i P conj(Q) / 4
+      double pRe = zRe[x] - mRe[mx], pIm = zIm[x] + mIm[mx];
+      double qRe = zRe[x] + mRe[mx], qIm = zIm[x] - mIm[mx];
+      double crossRe = 0.25 * (pIm * qRe - pRe * qIm);
+      double crossIm = -0.25 * (pRe * qRe + pIm * qIm);
+      if (job->normalize) {
+        double magnitude = sqrt(crossRe * crossRe + crossIm * crossIm);
+        if (magnitude > 1e-12) {
+          crossRe /= magnitude;
+          crossIm /= magnitude;
+        } else {
+          crossRe = crossIm = 0;
+        }
+      }
+      outRe[x] = crossRe;
+      outIm[x] = crossIm;
+    }
+  }
+}
+
+// offset of the top of a parabola through (-1, left), (0, centre), (1, right)
+static double parabolicPeakOffset(double left, double centre, double right) {
+  double denominator = left - 2 * centre + right;
+  if (denominator >= 0) {
+    return 0;
+  }
+  double offset = 0.5 * (left - right) / denominator;
+  return offset < -0.5 ? -0.5 : (offset > 0.5 ? 0.5 : offset);
+}
+
+void phaseCorrelateWith(PhaseCorrelator *correlator, DoubleImage a, DoubleImage b, double *dx, double *dy,
+                        double *peak) {
+  int width = correlator->width, height = correlator->height;
+  int widthA, heightA, widthB, heightB;
+  getWidthHeight(getDoubleImageDomain(a), &widthA, &heightA);
+  getWidthHeight(getDoubleImageDomain(b), &widthB, &heightB);
+  if (widthA != width || heightA != height || widthB != width || heightB != height) {
+    fatalError("phaseCorrelate: images of size %dx%d and %dx%d do not match the correlator size %dx%d.\n", widthA,
+               heightA, widthB, heightB, width, height);
+  }
+  // the means are removed first, otherwise the window itself would dominate the correlation at zero translation
+  double meanA = 0, meanB = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      meanA += a.pixels[y][x];
+      meanB += b.pixels[y][x];
+    }
+  }
+  meanA /= (double)width * height;
+  meanB /= (double)width * height;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      double weight = correlator->windowX[x] * correlator->windowY[y];
+      correlator->re[y][x] = weight * (a.pixels[y][x] - meanA);
+      correlator->im[y][x] = weight * (b.pixels[y][x] - meanB);
+    }
+  }
+  runSplitFFT2D(&correlator->fft, correlator->re, correlator->im, 0);
+  CrossSpectrumJob job = {correlator->re, correlator->im, correlator->crossRe, correlator->crossIm, width, height, 1};
+  parallelFor(height, 1 + 65536 / width, crossSpectrumRows, &job);
+  runSplitFFT2D(&correlator->fft, correlator->crossRe, correlator->crossIm, 1);
+
+  // the correlation surface is real; its maximum lies at the translation
+  double **surface = correlator->crossRe;
+  int peakX = 0, peakY = 0;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      if (surface[y][x] > surface[peakY][peakX]) {
+        peakX = x;
+        peakY = y;
+      }
+    }
+  }
+  double centre = surface[peakY][peakX];
+  double offsetX = parabolicPeakOffset(surface[peakY][(peakX + width - 1) % width], centre,
+                                       surface[peakY][(peakX + 1) % width]);
+  double offsetY = parabolicPeakOffset(surface[(peakY + height - 1) % height][peakX], centre,
+                                       surface[(peakY + 1) % height][peakX]);
+  // translations beyond half the image wrap around to negative ones
+  *dx = (peakX > width / 2 ? peakX - width : peakX) + offsetX;
+  *dy = (peakY > height / 2 ? peakY - height : peakY) + offsetY;
+  if (peak != NULL) {
+    *peak = centre;
+  }
+}
+
+void phaseCorrelate(DoubleImage a, DoubleImage b, double *dx, double *dy, double *peak) {
+  int width, height;
+  getWidthHeight(getDoubleImageDomain(a), &width, &height);
+  PhaseCorrelator *correlator = createPhaseCorrelator(width, height);
+  phaseCorrelateWith(correlator, a, b, dx, dy, peak);
+  freePhaseCorrelator(correlator);
+}
+
+/** Template matching ********************************************/
+
+typedef struct TemplateJob {
+  double **image;     // the image as doubles
+  double *templ;      // the template with its mean removed
+  double **scores;    // the correlations, later the normalized scores
+  double **sums;      // summed-area table of the image
+  double **sumsSq;    // summed-area table of the squared image
+  int templWidth, templHeight;
+  int scoreWidth;
+  double templEnergy;  // sum of the squared zero-mean template
+} TemplateJob;
+
+// correlates rows [begin, end) of the score map directly: every template pixel adds a scaled image row segment
+static void correlateTemplateRows(void *arg, int begin, int end) {
+  TemplateJob *job = arg;
+  int width = job->scoreWidth;
+  for (int y = begin; y < end; y++) {
+    double *out = job->scores[y];
+    memset(out, 0, width * sizeof(double));
+    for (int j = 0; j < job->templHeight; j++) {
+      const double *templRow = job->templ + (size_t)j * job->templWidth;
+      for (int i = 0; i < job->templWidth; i++) {
+        const double *in = job->image[y + j] + i;
+        double t = templRow[i];
+        int x = 0;
+#ifdef __SSE2__
+        __m128d tt = _mm_set1_pd(t);
+        for (; x + 4 <= width; x += 4) {
+          __m128d a = _mm_add_pd(_mm_loadu_pd(out + x), _mm_mul_pd(tt, _mm_loadu_pd(in + x)));
+          __m128d b = _mm_add_pd(_mm_loadu_pd(out + x + 2), _mm_mul_pd(tt, _mm_loadu_pd(in + x + 2)));
+          _mm_storeu_pd(out + x, a);
+          _mm_storeu_pd(out + x + 2, b);
+        }
+#endif
+        for (; x < width; x++) {
+          out[x] += t * in[x];
+        }
+      }
+    }
+  }
+}
+
+// divides the correlations by the energies of the template and of the image window below it
+static void normalizeTemplateRows(void *arg, int begin, int end) {
+  TemplateJob *job = arg;
+  int w = job->templWidth, h = job->templHeight;
+  double n = (double)w * h;
+  for (int y = begin; y < end; y++) {
+    const double *top = job->sums[y], *bottom = job->sums[y + h];
+    const double *topSq = job->sumsSq[y], *bottomSq = job->sumsSq[y + h];
+    double *out = job->scores[y];
+    for (int x = 0; x < job->scoreWidth; x++) {
+      double sum = bottom[x + w] - bottom[x] - top[x + w] + top[x];
+      double sumSq = bottomSq[x + w] - bottomSq[x] - topSq[x + w] + topSq[x];
+      double energy = sumSq - sum * sum / n;
+      if (energy <= 1e-12 * (sumSq + 1) || job->templEnergy <= 0) {
+        // a flat window (or template) does not correlate with anything
+        out[x] = 0;
+        continue;
+      }
+      double score = out[x] / sqrt(energy * job->templEnergy);
+      out[x] = (score > 1 ? 1 : (score < -1 ? -1 : score));
+    }
+  }
+}
+
+static int nextPowerOfTwo(int n) {
+  int p = 1;
+  while (p < n) {
+    p *= 2;
+  }
+  return p;
+}
+
+static int log2OfPowerOfTwo(int n) {
+  int log = 0;
+  while ((1 << log) < n) {
+    log++;
+  }
+  return log;
+}
+
+/*
+ * Correlates via the FFT. The template is packed in the real plane and the image in the imaginary plane of a single
+ * complex transform, so that one forward and one inverse transform suffice (see crossSpectrumRows). Both are zero
+ * padded to powers of two of at least the image size, so the valid part of the circular correlation is not wrapped.
+ */
+static void correlateTemplateFFT(TemplateJob *job, int width, int height) {
+  int fftWidth = nextPowerOfTwo(width), fftHeight = nextPowerOfTwo(height);
+  double **re = allocDoubleMatrix(fftWidth, fftHeight);
+  double **im = allocDoubleMatrix(fftWidth, fftHeight);
+  memset(re[0], 0, (size_t)fftWidth * fftHeight * sizeof(double));
+  memset(im[0], 0, (size_t)fftWidth * fftHeight * sizeof(double));
+  for (int y = 0; y < job->templHeight; y++) {
+    memcpy(re[y], job->templ + (size_t)y * job->templWidth, job->templWidth * sizeof(double));
+  }
+  for (int y = 0; y < height; y++) {
+    memcpy(im[y], job->image[y], width * sizeof(double));
+  }
+  SplitFFT2D fft = createSplitFFT2D(fftWidth, fftHeight);
+  runSplitFFT2D(&fft, re, im, 0);
+  double **crossRe = allocDoubleMatrix(fftWidth, fftHeight);
+  double **crossIm = allocDoubleMatrix(fftWidth, fftHeight);
+  CrossSpectrumJob crossJob = {re, im, crossRe, crossIm, fftWidth, fftHeight, 0};
+  parallelFor(fftHeight, 1 + 65536 / fftWidth, crossSpectrumRows, &crossJob);
+  runSplitFFT2D(&fft, crossRe, crossIm, 1);
+  int scoreHeight = height - job->templHeight + 1;
+  for (int y = 0; y < scoreHeight; y++) {
+    memcpy(job->scores[y], crossRe[y], job->scoreWidth * sizeof(double));
+  }
+  freeSplitFFT2D(fft);
+  free(re);
+  free(im);
+  free(crossRe);
+  free(crossIm);
+}
+
+// summed-area table with a leading row and column of zeros; squared selects the table of the squared values
+static double **summedAreaTable(double **image, int width, int height, int squared) {
+  double **table = allocDoubleMatrix(width + 1, height + 1);
+  memset(table[0], 0, (width + 1) * sizeof(double));
+  for (int y = 0; y < height; y++) {
+    double rowSum = 0;
+    table[y + 1][0] = 0;
+    for (int x = 0; x < width; x++) {
+      double val = image[y][x];
+      rowSum += squared ? val * val : val;
+      table[y + 1][x + 1] = table[y][x + 1] + rowSum;
+    }
+  }
+  return table;
+}
+
+DoubleImage matchTemplateNCC(IntImage image, IntImage templ) {
+  int width, height, templWidth, templHeight;
+  getWidthHeight(getIntImageDomain(image), &width, &height);
+  getWidthHeight(getIntImageDomain(templ), &templWidth, &templHeight);
+  if (templWidth > width || templHeight > height) {
+    fatalError("matchTemplateNCC: template of size %dx%d is larger than the image of size %dx%d.\n", templWidth,
+               templHeight, width, height);
+  }
+  int scoreWidth = width - templWidth + 1, scoreHeight = height - templHeight + 1;
+  int minX, maxX, minY, maxY;
+  getImageDomainValues(getIntImageDomain(image), &minX, &maxX, &minY, &maxY);
+  DoubleImage scores = allocateDoubleImageGrid(minX, minX + scoreWidth - 1, minY, minY + scoreHeight - 1, -1, 1);
+
+  TemplateJob job;
+  job.image = allocDoubleMatrix(width, height);
+  for (int i = 0; i < width * height; i++) {
+    job.image[0][i] = image.pixels[0][i];
+  }
+  int templSize = templWidth * templHeight;
+  job.templ = safeMalloc(templSize * sizeof(double));
+  double templMean = 0;
+  for (int i = 0; i < templSize; i++) {
+    templMean += templ.pixels[0][i];
+  }
+  templMean /= templSize;
+  job.templEnergy = 0;
+  for (int i = 0; i < templSize; i++) {
+    job.templ[i] = templ.pixels[0][i] - templMean;
+    job.templEnergy += job.templ[i] * job.templ[i];
+  }
+  job.scores = scores.pixels;
+  job.templWidth = templWidth;
+  job.templHeight = templHeight;
+  job.scoreWidth = scoreWidth;
+
+  // the template is zero-mean, so the correlation with the image equals the covariance up to a factor
+  int fftWidth = nextPowerOfTwo(width), fftHeight = nextPowerOfTwo(height);
+  double directCost = (double)scoreWidth * scoreHeight * templSize;
+  double fftCost = 12.0 * fftWidth * fftHeight * (log2OfPowerOfTwo(fftWidth) + log2OfPowerOfTwo(fftHeight) + 1);
+  if (directCost <= fftCost) {
+    parallelFor(scoreHeight, 1 + 65536 / (scoreWidth * templSize + 1), correlateTemplateRows, &job);
+  } else {
+    correlateTemplateFFT(&job, width, height);
+  }
+
+  job.sums = summedAreaTable(job.image, width, height, 0);
+  job.sumsSq = summedAreaTable(job.image, width, height, 1);
+  parallelFor(scoreHeight, 1 + 65536 / scoreWidth, normalizeTemplateRows, &job);
+
+  free(job.image);
+  free(job.templ);
+  free(job.sums);
+  free(job.sumsSq);
+  return scores;
+}
+
+static int compareScorePeaks(const void *a, const void *b) {
+  double scoreA = ((const ScorePeak *)a)->score, scoreB = ((const ScorePeak *)b)->score;
+  return (scoreA < scoreB) - (scoreA > scoreB);
+}
+
+int findScorePeaks(DoubleImage scores, int maxPeaks, int radius, double threshold, ScorePeak *peaks) {
+  int width, height, minX, maxX, minY, maxY;
+  getWidthHeight(getDoubleImageDomain(scores), &width, &height);
+  getImageDomainValues(getDoubleImageDomain(scores), &minX, &maxX, &minY, &maxY);
+  // candidates are the local maxima above the threshold. A plateau of equal scores is flooded as a whole: it is a
+  // maximum if none of the pixels around it is higher, and then yields a single candidate at its first pixel in scan
+  // order.
+  int numCandidates = 0, capacity = 64;
+  ScorePeak *candidates = safeMalloc(capacity * sizeof(ScorePeak));
+  unsigned char *visited = safeCalloc(width * height);
+  int *memory = safeMalloc(width * height * sizeof(int));
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      double val = scores.pixels[y][x];
+      if (val < threshold || visited[y * width + x]) {
+        continue;
+      }
+      int isMaximum = 1;
+      Quack stack = createNewQuackWithMemory(width * height, memory);
+      visited[y * width + x] = 1;
+      quackPushBack(&stack, y * width + x);
+      while (!quackIsEmpty(&stack)) {
+        int index = quackPopBack(&stack);
+        int px = index % width, py = index / width;
+        for (int j = (py > 0 ? -1 : 0); j <= (py < height - 1 ? 1 : 0); j++) {
+          for (int i = (px > 0 ? -1 : 0); i <= (px < width - 1 ? 1 : 0); i++) {
+            double neighbour = scores.pixels[py + j][px + i];
+            int neighbourIndex = index + j * width + i;
+            if (neighbour > val) {
+              isMaximum = 0;
+            } else if (neighbour == val && !visited[neighbourIndex]) {
+              visited[neighbourIndex] = 1;
+              quackPushBack(&stack, neighbourIndex);
+            }
+          }
+        }
+      }
+      if (!isMaximum) {
+        continue;
+      }
+      if (numCandidates == capacity) {
+        capacity *= 2;
+        candidates = realloc(candidates, capacity * sizeof(ScorePeak));
+        if (candidates == NULL) {
+          fatalError("findScorePeaks: out of memory.\n");
+        }
+      }
+      candidates[numCandidates++] = (ScorePeak){minX + x, minY + y, val};
+    }
+  }
+  free(visited);
+  free(memory);
+  qsort(candidates, numCandidates, sizeof(ScorePeak), compareScorePeaks);
+  // greedy non-maximum suppression: keep the best peaks that are more than radius apart
+  int numPeaks = 0;
+  for (int c = 0; c < numCandidates && numPeaks < maxPeaks; c++) {
+    int suppressed = 0;
+    for (int p = 0; p < numPeaks && !suppressed; p++) {
+      suppressed = abs(candidates[c].x - peaks[p].x) <= radius && abs(candidates[c].y - peaks[p].y) <= radius;
+    }
+    if (!suppressed) {
+      peaks[numPeaks++] = candidates[c];
+    }
+  }
+  free(candidates);
+  return numPeaks;
+}
+
+/** Edge detection ********************************************/
+
+/*
+ * The derivative kernels are separable: the x derivative is a vertical smoothing [a b a]^T followed by a horizontal
+ * central difference [-1 0 1], the y derivative the other way around. Sobel uses (a, b) = (1, 2) and Scharr
+ * (3, 10). Both passes are fused per row: the three input rows are combined into a smoothed row and a difference row,
+ * from which the corresponding output rows of gx and gy are computed while they are still in cache. Borders are
+ * replicated.
+ */
+typedef struct GradientJob {
+  int **src, **gx, **gy;
+  int width, height;
+  int scharr;
+} GradientJob;
+
+#ifdef __SSE2__
+// a * v for the smoothing weights a = 1 (Sobel) or a = 3 (Scharr)
+static inline __m128i gradientOuterWeight(__m128i v, int scharr) {
+  return scharr ? _mm_add_epi32(_mm_slli_epi32(v, 1), v) : v;
+}
+
+// b * v for the smoothing weights b = 2 (Sobel) or b = 10 (Scharr)
+static inline __m128i gradientCentreWeight(__m128i v, int scharr) {
+  __m128i twice = _mm_slli_epi32(v, 1);
+  return scharr ? _mm_add_epi32(_mm_slli_epi32(v, 3), twice) : twice;
+}
+#endif
+
+static void gradientRows(void *arg, int begin, int end) {
+  GradientJob *job = arg;
+  int width = job->width, height = job->height, scharr = job->scharr;
+  int outer = scharr ? 3 : 1, centre = scharr ? 10 : 2;
+  // both rows have a replicated border pixel on either side
+  int *smooth = safeMalloc((width + 2) * sizeof(int));
+  int *diff = safeMalloc((width + 2) * sizeof(int));
+  for (int y = begin; y < end; y++) {
+    const int *up = job->src[y > 0 ? y - 1 : 0];
+    const int *mid = job->src[y];
+    const int *down = job->src[y < height - 1 ? y + 1 : height - 1];
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= width; x += 4) {
+      __m128i u = _mm_loadu_si128((const __m128i *)(up + x));
+      __m128i m = _mm_loadu_si128((const __m128i *)(mid + x));
+      __m128i d = _mm_loadu_si128((const __m128i *)(down + x));
+      __m128i s = _mm_add_epi32(gradientOuterWeight(_mm_add_epi32(u, d), scharr), gradientCentreWeight(m, scharr));
+      _mm_storeu_si128((__m128i *)(smooth + x + 1), s);
+      _mm_storeu_si128((__m128i *)(diff + x + 1), _mm_sub_epi32(d, u));
+    }
+#endif
+    for (; x < width; x++) {
+      smooth[x + 1] = outer * (up[x] + down[x]) + centre * mid[x];
+      diff[x + 1] = down[x] - up[x];
+    }
+    smooth[0] = smooth[1];
+    smooth[width + 1] = smooth[width];
+    diff[0] = diff[1];
+    diff[width + 1] = diff[width];
+
+    int *gx = job->gx[y], *gy = job->gy[y];
+    x = 0;
+#ifdef __SSE2__
+    for (; x + 4 <= width; x += 4) {
+      __m128i left = _mm_loadu_si128((const __m128i *)(smooth + x));
+      __m128i right = _mm_loadu_si128((const __m128i *)(smooth + x + 2));
+      _mm_storeu_si128((__m128i *)(gx + x), _mm_sub_epi32(right, left));
+      __m128i dl = _mm_loadu_si128((const __m128i *)(diff + x));
+      __m128i dm = _mm_loadu_si128((const __m128i *)(diff + x + 1));
+      __m128i dr = _mm_loadu_si128((const __m128i *)(diff + x + 2));
+      __m128i g = _mm_add_epi32(gradientOuterWeight(_mm_add_epi32(dl, dr), scharr), gradientCentreWeight(dm, scharr));
+      _mm_storeu_si128((__m128i *)(gy + x), g);
+    }
+#endif
+    for (; x < width; x++) {
+      gx[x] = smooth[x + 2] - smooth[x];
+      gy[x] = outer * (diff[x] + diff[x + 2]) + centre * diff[x + 1];
+    }
+  }
+  free(smooth);
+  free(diff);
+}
+
+static void computeGradients(IntImage image, int **gx, int **gy, int scharr) {
+  int width, height;
+  getWidthHeight(getIntImageDomain(image), &width, &height);
+  GradientJob job = {image.pixels, gx, gy, width, height, scharr};
+  parallelFor(height, 1 + 65536 / width, gradientRows, &job);
+}
+
+static void gradientIntImage(IntImage image, IntImage *gx, IntImage *gy, int scharr) {
+  ImageDomain domain = getIntImageDomain(image);
+  // the kernels sum to zero and their positive weights to 4 (Sobel) or 16 (Scharr)
+  int gain = scharr ? 16 : 4;
+  int range = image.maxRange - image.minRange;
+  *gx = allocateIntImageGridDomain(domain, -gain * range, gain * range);
+  *gy = allocateIntImageGridDomain(domain, -gain * range, gain * range);
+  computeGradients(image, gx->pixels, gy->pixels, scharr);
+}
+
+void sobelIntImage(IntImage image, IntImage *gx, IntImage *gy) { gradientIntImage(image, gx, gy, 0); }
+
+void scharrIntImage(IntImage image, IntImage *gx, IntImage *gy) { gradientIntImage(image, gx, gy, 1); }
+
+static void compareGradientDomains(IntImage gx, IntImage gy, const char *function) {
+  ImageDomain a = getIntImageDomain(gx), b = getIntImageDomain(gy);
+  if (a.minX != b.minX || a.maxX != b.maxX || a.minY != b.minY || a.maxY != b.maxY) {
+    fatalError("%s: gx and gy do not have the same domain.\n", function);
+  }
+}
+
+DoubleImage gradientMagnitude(IntImage gx, IntImage gy) {
+  compareGradientDomains(gx, gy, "gradientMagnitude");
+  ImageDomain domain = getIntImageDomain(gx);
+  int numPixel = numPixels(domain);
+  double maxComponent = fmax(fmax(abs(gx.minRange), abs(gx.maxRange)), fmax(abs(gy.minRange), abs(gy.maxRange)));
+  DoubleImage magnitude = allocateDoubleImageGridDomain(domain, 0, maxComponent * sqrt(2.0));
+  const int *x = gx.pixels[0], *y = gy.pixels[0];
+  double *out = magnitude.pixels[0];
+  int i = 0;
+#ifdef __SSE2__
+  for (; i + 2 <= numPixel; i += 2) {
+    __m128d dx = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)(x + i)));
+    __m128d dy = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)(y + i)));
+    _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy))));
+  }
+#endif
+  for (; i < numPixel; i++) {
+    out[i] = sqrt((double)x[i] * x[i] + (double)y[i] * y[i]);
+  }
+  return magnitude;
+}
+
+DoubleImage gradientOrientation(IntImage gx, IntImage gy) {
+  compareGradientDomains(gx, gy, "gradientOrientation");
+  ImageDomain domain = getIntImageDomain(gx);
+  int numPixel = numPixels(domain);
+  DoubleImage orientation = allocateDoubleImageGridDomain(domain, -PI, PI);
+  const int *x = gx.pixels[0], *y = gy.pixels[0];
+  double *out = orientation.pixels[0];
+  for (int i = 0; i < numPixel; i++) {
+    out[i] = atan2(y[i], x[i]);
+  }
+  return orientation;
+}
+
+/*
+ * Canny works on a copy of the magnitude with a border of zeros, so the neighbour lookups of the non-maximum
+ * suppression and the hysteresis need no bounds checks. Every pixel ends up in one of three states; strong edges are
+ * pushed on a Quack used as a stack and grow into the connected weak edges.
+ */
+#define CANNY_NONE 0
+#define CANNY_WEAK 1
+#define CANNY_STRONG 2
+
+typedef struct CannyJob {
+  int **gx, **gy;
+  float *magnitude;  // padded, (width + 2) x (height + 2)
+  unsigned char *state;
+  int width, height;
+  double lowThreshold, highThreshold;
+} CannyJob;
+
+static void cannyMagnitudeRows(void *arg, int begin, int end) {
+  CannyJob *job = arg;
+  int stride = job->width + 2;
+  for (int y = begin; y < end; y++) {
+    float *out = job->magnitude + (size_t)(y + 1) * stride + 1;
+    const int *x = job->gx[y], *yy = job->gy[y];
+    for (int i = 0; i < job->width; i++) {
+      out[i] = sqrtf((float)x[i] * x[i] + (float)yy[i] * yy[i]);
+    }
+  }
+}
+
+static void cannySuppressRows(void *arg, int begin, int end) {
+  CannyJob *job = arg;
+  int stride = job->width + 2;
+  // tan(22.5 degrees) and tan(67.5 degrees) in 15-bit fixed point
+  const long long tan22 = 13573, tan67 = 79109;
+  for (int y = begin; y < end; y++) {
+    size_t rowStart = (size_t)(y + 1) * stride + 1;
+    const float *m = job->magnitude + rowStart;
+    unsigned char *state = job->state + rowStart;
+    for (int x = 0; x < job->width; x++) {
+      float val = m[x];
+      if (val <= job->lowThreshold) {
+        state[x] = CANNY_NONE;
+        continue;
+      }
+      long long dx = job->gx[y][x], dy = job->gy[y][x];
+      long long ax = llabs(dx), ay = llabs(dy) << 15;
+      float before, after;
+      if (ay <= ax * tan22) {
+        before = m[x - 1];
+        after = m[x + 1];
+      } else if (ay >= ax * tan67) {
+        before = m[x - stride];
+        after = m[x + stride];
+      } else {
+        // y grows downwards, so equal signs mean the gradient points to the bottom right
+        int diagonal = ((dx < 0) == (dy < 0)) ? stride + 1 : stride - 1;
+        before = m[x - diagonal];
+        after = m[x + diagonal];
+      }
+      // the asymmetric comparison keeps a single pixel of a plateau
+      int isMaximum = val > before && val >= after;
+      state[x] = !isMaximum ? CANNY_NONE : (val > job->highThreshold ? CANNY_STRONG : CANNY_WEAK);
+    }
+  }
+}
+
+IntImage cannyIntImage(IntImage image, double lowThreshold, double highThreshold) {
+  if (lowThreshold > highThreshold) {
+    fatalError("cannyIntImage: low threshold %f exceeds high threshold %f.\n", lowThreshold, highThreshold);
+  }
+  ImageDomain domain = getIntImageDomain(image);
+  int width, height;
+  getWidthHeight(domain, &width, &height);
+  int **gx = allocIntMatrix(width, height);
+  int **gy = allocIntMatrix(width, height);
+  computeGradients(image, gx, gy, 0);
+
+  int stride = width + 2;
+  size_t paddedSize = (size_t)stride * (height + 2);
+  CannyJob job = {gx, gy, safeCalloc(paddedSize * sizeof(float)), safeCalloc(paddedSize), width, height,
+                  lowThreshold, highThreshold};
+  parallelFor(height, 1 + 65536 / width, cannyMagnitudeRows, &job);
+  parallelFor(height, 1 + 65536 / width, cannySuppressRows, &job);
+  free(gx);
+  free(gy);
+  free(job.magnitude);
+
+  // hysteresis: every pixel is pushed at most once, since it is marked strong before it is pushed
+  int *memory = safeMalloc(paddedSize * sizeof(int));
+  Quack stack = createNewQuackWithMemory(paddedSize, memory);
+  unsigned char *state = job.state;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      int index = (y + 1) * stride + x + 1;
+      if (state[index] == CANNY_STRONG) {
+        quackPushBack(&stack, index);
+      }
+    }
+  }
+  const int neighbours[8] = {-stride - 1, -stride, -stride + 1, -1, 1, stride - 1, stride, stride + 1};
+  while (!quackIsEmpty(&stack)) {
+    int index = quackPopBack(&stack);
+    for (int n = 0; n < 8; n++) {
+      int neighbour = index + neighbours[n];
+      if (state[neighbour] == CANNY_WEAK) {
+        state[neighbour] = CANNY_STRONG;
+        quackPushBack(&stack, neighbour);
+      }
+    }
+  }
+  free(memory);
+
+  IntImage edges = allocateIntImageGridDomain(domain, 0, 1);
+  for (int y = 0; y < height; y++) {
+    const unsigned char *row = state + (size_t)(y + 1) * stride + 1;
+    for (int x = 0; x < width; x++) {
+      edges.pixels[y][x] = (row[x] == CANNY_STRONG);
+    }
+  }
+  free(state);
+  return edges;
+}
@@ -26,7 +26,42 @@
 #define MANHATTAN 2
 #define CHESSBOARD 3
 
+// Pixel types of tiled image files
+#define INT_PIXELS 0
+#define RGB_PIXELS 1
+#define DOUBLE_PIXELS 2
+#define COMPLEX_PIXELS 3
+
+// Tile compression of tiled image files
+#define TILE_UNCOMPRESSED 0
+#define TILE_DELTA_RLE 1
+
+// Resampling filters
+#define RESIZE_AREA 0
+#define RESIZE_BILINEAR 1
+#define RESIZE_BICUBIC 2
+#define RESIZE_LANCZOS 3
+
+// Interpolation methods of warping
+#define INTERP_NEAREST 0
+#define INTERP_BILINEAR 1
+
+// Luma standards of rgb2GreyImg
+#define GREY_BT601 0
+#define GREY_BT709 1
+
+// Frequency filter types
+#define FILTER_IDEAL 0
+#define FILTER_BUTTERWORTH 1
+#define FILTER_GAUSSIAN 2
+
+// Frequency filter bands
+#define FILTER_LOWPASS 0
+#define FILTER_HIGHPASS 1
+#define FILTER_BANDPASS 2
+
 #include <complex.h>
+#include <stdint.h>
 #include <stdio.h>
 
 typedef struct ImageDomain {
@@ -59,6 +94,34 @@ typedef struct DoubleImage {
   double minRange, maxRange;
 } DoubleImage;
 
+typedef struct FloatImage {
+  ImageDomain domain;
+  float **pixels;
+  float minRange, maxRange;
+} FloatImage;
+
+typedef struct ComplexFloatImage {
+  ImageDomain domain;
+  float complex **pixels;
+} ComplexFloatImage;
+
+typedef struct SplitComplexImage {
+  ImageDomain domain;
+  double **re;  // real parts
+  double **im;  // imaginary parts
+} SplitComplexImage;
+
+typedef struct BitImage {
+  ImageDomain domain;
+  uint64_t **rows;  // one bit per pixel, 64 pixels per word, most significant bit first
+  int wordsPerRow;
+} BitImage;
+
+typedef struct ImagePyramid {
+  int numLevels;
+  DoubleImage *levels;  // level 0 has the full resolution; the pixels of all levels share one allocation
+} ImagePyramid;
+
 typedef struct Histogram {
   int *frequencies;
   int minRange, maxRange;
@@ -304,7 +367,8 @@ void displayIntImage(IntImage image, const char *windowTitle);
 /* ----------------------------- Image Loading + Saving ----------------------------- */
 
 /**
- * @brief Loads an image from the provided file. Supported extensions: .pbm, .pgm, .ppm.
+ * @brief Loads an image from the provided file. Supported extensions: .pbm, .pgm, .pam. A .pam file must have a single
+ * channel.
  *
  * @param path The path of the image to load.
  * @return IntImage An integer image represtation of the provided file.
@@ -312,14 +376,45 @@ void displayIntImage(IntImage image, const char *windowTitle);
 IntImage loadIntImage(const char *path);
 
 /**
- * @brief Saves an image at the provided location. Supported extensions: .pbm, .pgm, .ppm. This will save the netpbm
- * files as their binary formats.
+ * @brief Saves an image at the provided location. Supported extensions: .pbm, .pgm, .pam. This will save the netpbm
+ * files as their binary formats. A .pam file is saved with the GRAYSCALE tuple type.
  *
  * @param image The images to save.
  * @param path The location to save the image at.
  */
 void saveIntImage(IntImage image, const char *path);
 
+/**
+ * @brief Loads all channels of a PAM (.pam) file, e.g. GRAYSCALE_ALPHA, RGB_ALPHA or an arbitrary number of bands.
+ * Every channel has the dynamic range [0..MAXVAL] of the file.
+ *
+ * @param path The path of the file to load.
+ * @param depth Will contain the number of channels.
+ * @param tupleType Buffer that will contain the tuple type of the file (empty if it has none). Can be NULL.
+ * @param tupleTypeSize The size of the tupleType buffer.
+ * @return IntImage* Array of depth channels. Should be freed with freeIntImageChannels.
+ */
+IntImage *loadIntImageChannels(const char *path, int *depth, char *tupleType, int tupleTypeSize);
+
+/**
+ * @brief Saves a number of channels of the same size as a single PAM (.pam) file. Values are clamped to [0..65535];
+ * channels are stored with 2 bytes per sample if any value exceeds 255.
+ *
+ * @param channels The channels to save.
+ * @param depth The number of channels.
+ * @param tupleType The tuple type to store in the file (e.g. "GRAYSCALE_ALPHA"). Can be NULL.
+ * @param path The location to save the file at.
+ */
+void saveIntImageChannels(const IntImage *channels, int depth, const char *tupleType, const char *path);
+
+/**
+ * @brief Frees the channels returned by loadIntImageChannels.
+ *
+ * @param channels The channels to free.
+ * @param depth The number of channels.
+ */
+void freeIntImageChannels(IntImage *channels, int depth);
+
 /**
  * @brief Saves an image at the provided location. The location must be a .pgm file. Pixels values are stored as raw
  * bytes in the file.
@@ -470,6 +565,52 @@ void flipIntImageHorizontal(IntImage *image);
  */
 void flipIntImageVertical(IntImage *image);
 
+/**
+ * @brief Transposes an image: pixel (x, y) of the input ends up at (y, x) in the result, so the domain [minX..maxX] x
+ * [minY..maxY] becomes [minY..maxY] x [minX..maxX]. Uses a cache-blocked SIMD kernel and multiple threads for large
+ * images.
+ *
+ * @param image The image to transpose.
+ * @return IntImage The transposed image.
+ */
+IntImage transposeIntImage(IntImage image);
+
+/**
+ * @brief Rotates an image by a number of quarter turns counter-clockwise (as displayed) around the origin, without any
+ * resampling. Pixel (x, y) ends up at (y, -x) for a single turn. Negative turns rotate clockwise.
+ *
+ * @param image The image to rotate.
+ * @param turns The number of quarter turns.
+ * @return IntImage The rotated image.
+ */
+IntImage rotate90IntImage(IntImage image, int turns);
+
+/**
+ * @brief Applies the affine transformation x' = m[0]*x + m[1]*y + m[2], y' = m[3]*x + m[4]*y + m[5] to an image. The
+ * matrix works on domain coordinates and the result has the same domain and dynamic range as the input. Pixels of the
+ * result that map outside of the input get the background value. Large images are processed on multiple threads.
+ *
+ * @param image The image to transform.
+ * @param matrix The 2x3 transformation matrix in row-major order.
+ * @param interpolation Either INTERP_NEAREST or INTERP_BILINEAR.
+ * @param background Grey value of the pixels that have no source pixel.
+ * @return IntImage The transformed image.
+ */
+IntImage warpAffineIntImage(IntImage image, const double matrix[6], int interpolation, int background);
+
+/**
+ * @brief Rotates an image counter-clockwise (as displayed) around the origin. The domain of the result is the smallest
+ * rectangle that contains the rotated domain; uncovered pixels get the background value. Multiples of 90 degrees are
+ * exact and do not interpolate. Translate the image first to rotate it around another point.
+ *
+ * @param image The image to rotate.
+ * @param angle The rotation angle in degrees.
+ * @param interpolation Either INTERP_NEAREST or INTERP_BILINEAR.
+ * @param background Grey value of the pixels that have no source pixel.
+ * @return IntImage The rotated image.
+ */
+IntImage rotateIntImage(IntImage image, double angle, int interpolation, int background);
+
 /**
 * @brief Perform a grayscale dilation on the input image. The structuring element (kernel) that will be used will be a
 * rectangle of width `kw` and height `kh`.
@@ -505,7 +646,8 @@ Histogram createHistogram(IntImage image);
 
 /**
  * @brief Creates a histogram for the channels red, green and blue from the provided image. Note that this will allocate
- * a lot of memory when the dynamic range is large, since each bin of the histogram is a single pixel value.
+ * a lot of memory when the dynamic range is large, since each bin of the histogram is a single pixel value. The
+ * channels are processed concurrently.
  *
  * @param image The image to create the histogram of.
  * @param redHist Histogram of the red channel.
@@ -640,6 +782,18 @@ RgbImage allocateRgbImageGridDomain(ImageDomain domain, int minValue, int maxVal
  */
 void freeRgbImage(RgbImage image);
 
+/**
+ * @brief Combines three grey images into an RGB image without copying any pixels: the RGB image takes over the pixel
+ * matrices of the channels. The channels must have the same domain; the dynamic range of the result spans the ranges
+ * of all three. Afterwards, only the RGB image should be freed, not the channels.
+ *
+ * @param red The red channel.
+ * @param green The green channel.
+ * @param blue The blue channel.
+ * @return RgbImage The RGB image that owns the three channels.
+ */
+RgbImage mergeIntImagesToRgb(IntImage red, IntImage green, IntImage blue);
+
 /* ----------------------------- Image Getters ----------------------------- */
 
 /**
@@ -650,6 +804,32 @@ void freeRgbImage(RgbImage image);
  */
 ImageDomain getRgbImageDomain(RgbImage image);
 
+/**
+ * @brief Retrieve the red channel as a grey image without copying it. The view shares its pixels with the RGB image,
+ * so changes to either are visible in both, and any IntImage operation can be applied to a single channel. The view
+ * has the domain and dynamic range of the RGB image and must not be freed; it is freed along with the RGB image.
+ *
+ * @param image The image from which to retrieve the channel.
+ * @return IntImage A view on the red channel.
+ */
+IntImage getRedChannelView(RgbImage image);
+
+/**
+ * @brief Retrieve the green channel as a grey image without copying it. See getRedChannelView.
+ *
+ * @param image The image from which to retrieve the channel.
+ * @return IntImage A view on the green channel.
+ */
+IntImage getGreenChannelView(RgbImage image);
+
+/**
+ * @brief Retrieve the blue channel as a grey image without copying it. See getRedChannelView.
+ *
+ * @param image The image from which to retrieve the channel.
+ * @return IntImage A view on the blue channel.
+ */
+IntImage getBlueChannelView(RgbImage image);
+
 /**
  * @brief Retrieve the dynamic range of the provided image.
  *
@@ -763,7 +943,8 @@ void displayRgbImage(RgbImage image, const char *windowTitle);
 /* ----------------------------- Image Loading + Saving ----------------------------- */
 
 /**
- * @brief Loads an image from the provided file. Supported extensions: .ppm.
+ * @brief Loads an image from the provided file. Supported extensions: .ppm, .pam. A .pam file must have 3 channels or
+ * be of tuple type RGB_ALPHA, in which case the alpha channel is ignored.
  *
  * @param path The path of the image to load.
  * @return RgbImage An integer image represtation of the provided file.
@@ -771,8 +952,8 @@ void displayRgbImage(RgbImage image, const char *windowTitle);
 RgbImage loadRgbImage(const char *path);
 
 /**
- * @brief Saves an image at the provided location. Supported extensions: .ppm. This will save the netpbm
- * file in its binary format.
+ * @brief Saves an image at the provided location. Supported extensions: .ppm, .pam. This will save the netpbm
+ * file in its binary format. A .pam file is saved with the RGB tuple type.
  *
  * @param image The images to save.
  * @param path The location to save the image at.
@@ -862,6 +1043,40 @@ RgbImage multiplyRgbImage(RgbImage imageA, RgbImage imageB);
  */
 RgbImage applyLutRgbImage(RgbImage image, int **LUT, int LUTsize);
 
+/**
+ * @brief Performs a grayscale dilation on every channel of the input image, using a rectangle of width `kw` and height
+ * `kh` as structuring element. The channels are processed concurrently.
+ *
+ * @param image The image that the dilation will be applied on.
+ * @param kw The width of the rectangular structuring element (kernel)
+ * @param kh The heigth of the rectangular structuring element (kernel)
+ * @return RgbImage The dilated input image
+ */
+RgbImage dilateRgbImageRect(RgbImage image, int kw, int kh);
+
+/**
+ * @brief Performs a grayscale erosion on every channel of the input image, using a rectangle of width `kw` and height
+ * `kh` as structuring element. The channels are processed concurrently.
+ *
+ * @param image The image that the erosion will be applied on.
+ * @param kw The width of the rectangular structuring element (kernel)
+ * @param kh The heigth of the rectangular structuring element (kernel)
+ * @return RgbImage The eroded input image
+ */
+RgbImage erodeRgbImageRect(RgbImage image, int kw, int kh);
+
+/**
+ * @brief Performs a distance transform on every channel of the provided image, see distanceTransform. The channels
+ * are processed concurrently.
+ *
+ * @param image The image to perform the distance transform on.
+ * @param metric The metric to use for the distance transform. Should be one of the constants: MANHATTAN, CHESSBOARD,
+ * EUCLID or SQEUCLID.
+ * @param foreground Pixels with this value in a channel are assumed to be foreground pixels of that channel.
+ * @return RgbImage An image containing the distances of every channel.
+ */
+RgbImage distanceTransformRgb(RgbImage image, int metric, int foreground);
+
 /* ----------------------------- Image Transformations ----------------------------- */
 
 /**
@@ -932,6 +1147,14 @@ ComplexImage allocateFromComplexImage(ComplexImage image);
  */
 ComplexImage copyComplexImage(ComplexImage image);
 
+/**
+ * @brief Transposes an image: pixel (x, y) of the input ends up at (y, x) in the result. See transposeIntImage.
+ *
+ * @param image The image to transpose.
+ * @return ComplexImage The transposed image.
+ */
+ComplexImage transposeComplexImage(ComplexImage image);
+
 /**
  * @brief Allocates an empty complex image in the domain [minX...maxX] x [minY..maxY] with the specified parameters.
  *
@@ -1068,17 +1291,25 @@ void printComplexLatexTableToFile(FILE *out, ComplexImage image);
  */
 void displayComplexImage(ComplexImage image, const char *windowTitle);
 
-/* ----------------------------- Image Saving ----------------------------- */
+/* ----------------------------- Image Loading + Saving ----------------------------- */
 
 /**
- * @brief Saves an image at the provided location. Supported extension: .pgm. This will save the netpbm
- * files as their binary formats. Note that only (rounded) real values are stored.
+ * @brief Saves an image at the provided location. Supported extensions: .pgm, .cfm. A .pgm file is saved in its binary
+ * format and only contains the (rounded) real values. A .cfm file stores the complex values and the domain losslessly.
  *
  * @param image The images to save.
  * @param path The location to save the image at.
  */
 void saveComplexImage(ComplexImage image, const char *path);
 
+/**
+ * @brief Loads an image that was saved as a .cfm file by saveComplexImage.
+ *
+ * @param path The path of the image to load.
+ * @return ComplexImage The image with the domain it was saved with.
+ */
+ComplexImage loadComplexImage(const char *path);
+
 /**
  * @brief Saves an image at the provided location. The location must be a .pgm file. Pixels values are stored as raw
  * bytes in the file. Note that only (rounded) real values are stored.
@@ -1108,6 +1339,17 @@ void saveComplexImagePGMAscii(ComplexImage image, const char *path);
  */
 ComplexImage fft2D(IntImage image);
 
+/**
+ * @brief Performs the Fast Fourier Transform on every channel of the provided input image. The channels are processed
+ * concurrently. Note that the image dimensions must be a power of 2.
+ *
+ * @param image The input image.
+ * @param red The fourier transform of the red channel.
+ * @param green The fourier transform of the green channel.
+ * @param blue The fourier transform of the blue channel.
+ */
+void fft2DRgb(RgbImage image, ComplexImage *red, ComplexImage *green, ComplexImage *blue);
+
 /**
  * @brief Performs the Fast Fourier Transform on the provided input image. Note that the image dimensions must be a
  * power of 2.
@@ -1146,19 +1388,40 @@ DoubleImage ifft2DDouble(ComplexImage image);
 ComplexImage multiplyComplexImage(ComplexImage imageA, ComplexImage imageB);
 
 /**
- * @brief Swaps quadrants 1 & 3 and 2 & 4 to center the DC component in the image.
+ * @brief Swaps quadrants 1 & 3 and 2 & 4 to center the DC component in the image. For odd dimensions the DC component
+ * ends up at (width / 2, height / 2). The image is shifted in place.
  *
  * @param image The input complex image.
  */
 void fft2Dshift(ComplexImage *image);
 
 /**
- * @brief Reverses the centering of the DC component.
+ * @brief Reverses the centering of the DC component. This is the exact inverse of fft2Dshift, also for odd dimensions.
  *
  * @param image The input complex image.
  */
 void ifft2Dshift(ComplexImage *image);
 
+/**
+ * @brief Performs the Fast Fourier Transform on the provided input image and returns a spectrum with the DC component
+ * centered, as if fft2Dshift had been applied. The shift is folded into the transform by multiplying the input with
+ * (-1)^(x+y), where x and y are relative to the top-left corner of the domain. Note that the image dimensions must be
+ * a power of 2.
+ *
+ * @param image The input image.
+ * @return ComplexImage The centered fourier transform of the input image.
+ */
+ComplexImage fft2DDoubleCentered(DoubleImage image);
+
+/**
+ * @brief Performs the inverse Fast Fourier Transform on a spectrum with a centered DC component, such as the one
+ * produced by fft2DDoubleCentered. Note that the image dimensions must be a power of 2.
+ *
+ * @param image The input complex image.
+ * @return DoubleImage The inverse fourier transform of the input complex image.
+ */
+DoubleImage ifft2DDoubleCentered(ComplexImage image);
+
 /* ----------------------------- Double Images ----------------------------- */
 
 /**
@@ -1179,6 +1442,14 @@ DoubleImage allocateDoubleImage(int width, int height, double minValue, double m
  */
 DoubleImage copyDoubleImage(DoubleImage image);
 
+/**
+ * @brief Transposes an image: pixel (x, y) of the input ends up at (y, x) in the result. See transposeIntImage.
+ *
+ * @param image The image to transpose.
+ * @return DoubleImage The transposed image.
+ */
+DoubleImage transposeDoubleImage(DoubleImage image);
+
 /**
  * @brief Allocates an empty double image in the domain [minX...maxX] x [minY..maxY] with the specified parameters.
  *
@@ -1332,6 +1603,25 @@ void printDoubleImageLatexTable(DoubleImage image);
  */
 void printDoubleLatexTableToFile(FILE *out, DoubleImage image);
 
+/* ----------------------------- Image Loading + Saving ----------------------------- */
+
+/**
+ * @brief Saves an image losslessly at the provided location. The location must be a .dfm file, which stores the
+ * domain, the dynamic range and the raw double values of the image.
+ *
+ * @param image The images to save.
+ * @param path The location to save the image at.
+ */
+void saveDoubleImage(DoubleImage image, const char *path);
+
+/**
+ * @brief Loads an image that was saved as a .dfm file by saveDoubleImage.
+ *
+ * @param path The path of the image to load.
+ * @return DoubleImage The image with the domain and dynamic range it was saved with.
+ */
+DoubleImage loadDoubleImage(const char *path);
+
 /* ----------------------------- Image Conversion ----------------------------- */
 
 /**
@@ -1349,4 +1639,1388 @@ DoubleImage int2DoubleImg(IntImage image);
  * @return IntImage The double version of the DoubleImage
  */
 IntImage double2IntImg(DoubleImage image);
+
+/* ----------------------------- Float Images ----------------------------- */
+
+/**
+ * @brief Allocates an empty float image in the domain [0...width) x [0..height) with the specified parameters. Float
+ * images take half the memory of double images, which halves the bandwidth of every pass over them.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @param minValue The minimum value in the dynamic range.
+ * @param maxValue The maximum value in the dynamic range.
+ * @return FloatImage A newly allocated FloatImage. Note that you should free the resulting image when you are done
+ * with it.
+ */
+FloatImage allocateFloatImage(int width, int height, float minValue, float maxValue);
+
+/**
+ * @brief Allocates an empty float image in the domain [minX...maxX] x [minY..maxY] with the specified parameters.
+ *
+ * @param minX The start of the image domain in the x direction.
+ * @param maxX The end of the image domain in the x direction.
+ * @param minY The start of the image domain in the y direction.
+ * @param maxY The end of the image domain in the y direction.
+ * @param minValue The minimum value in the dynamic range.
+ * @param maxValue The maximum value in the dynamic range.
+ * @return FloatImage A newly allocated FloatImage.
+ */
+FloatImage allocateFloatImageGrid(int minX, int maxX, int minY, int maxY, float minValue, float maxValue);
+
+/**
+ * @brief Allocates an empty float image with the provided domain and dynamic range.
+ *
+ * @param domain The domain of the image.
+ * @param minValue The minimum value in the dynamic range.
+ * @param maxValue The maximum value in the dynamic range.
+ * @return FloatImage A newly allocated FloatImage.
+ */
+FloatImage allocateFloatImageGridDomain(ImageDomain domain, float minValue, float maxValue);
+
+/**
+ * @brief Allocates an empty float image in the domain [0...width) x [0..height) whose dynamic range spans all floats.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @return FloatImage A newly allocated FloatImage.
+ */
+FloatImage allocateDefaultFloatImage(int width, int height);
+
+/**
+ * @brief Allocates an empty float image with the same domain and dynamic range as the provided image.
+ *
+ * @param image The image to take the domain and dynamic range from.
+ * @return FloatImage A newly allocated FloatImage.
+ */
+FloatImage allocateFromFloatImage(FloatImage image);
+
+/**
+ * @brief Creates a copy of the provided image.
+ *
+ * @param image The image to copy.
+ * @return FloatImage A copy of the provided image.
+ */
+FloatImage copyFloatImage(FloatImage image);
+
+/**
+ * @brief Frees the provided image.
+ *
+ * @param image The image to free.
+ */
+void freeFloatImage(FloatImage image);
+
+/**
+ * @brief Retrieve the dynamic range of the provided image.
+ *
+ * @param image The image from which to retrieve the dynamic range.
+ * @param minRange The minimum value of the dynamic range.
+ * @param maxRange The maximum value of the dynamic range.
+ */
+void getFloatDynamicRange(FloatImage image, float *minRange, float *maxRange);
+
+/**
+ * @brief Retrieve the domain information of the provided image.
+ *
+ * @param image The image from which to retrieve the domain.
+ * @return ImageDomain The domain of the image.
+ */
+ImageDomain getFloatImageDomain(FloatImage image);
+
+/**
+ * @brief Retrieves the minimum and maximum values in the image.
+ *
+ * @param image The image.
+ * @param minimalValue The smallest value in the image.
+ * @param maximalValue The largest value in the image.
+ */
+void getFloatMinMax(FloatImage image, float *minimalValue, float *maximalValue);
+
+/**
+ * @brief Retrieves the pixel value at position (x,y) in the image domain.
+ *
+ * @param image The image.
+ * @param x The x coordinate in the domain.
+ * @param y The y coordinate in the domain.
+ * @return float The value of the pixel.
+ */
+float getFloatPixel(FloatImage image, int x, int y);
+
+/**
+ * @brief Retrieves the pixel value at index (x,y) of the pixel matrix, ignoring the domain.
+ *
+ * @param image The image.
+ * @param x The column index.
+ * @param y The row index.
+ * @return float The value of the pixel.
+ */
+float getFloatPixelI(FloatImage image, int x, int y);
+
+/**
+ * @brief Sets the pixel at position (x,y) in the image domain. The value is clamped to the dynamic range.
+ *
+ * @param image The image.
+ * @param x The x coordinate in the domain.
+ * @param y The y coordinate in the domain.
+ * @param val The new value of the pixel.
+ */
+void setFloatPixel(FloatImage *image, int x, int y, float val);
+
+/**
+ * @brief Sets the pixel at index (x,y) of the pixel matrix, ignoring the domain. The value is clamped to the dynamic
+ * range.
+ *
+ * @param image The image.
+ * @param x The column index.
+ * @param y The row index.
+ * @param val The new value of the pixel.
+ */
+void setFloatPixelI(FloatImage *image, int x, int y, float val);
+
+/**
+ * @brief Sets all pixels of the image to the provided value.
+ *
+ * @param image The image.
+ * @param val The new value of the pixels.
+ */
+void setAllFloatPixels(FloatImage *image, float val);
+
+/**
+ * @brief Prints the pixel values of the image to stdout.
+ *
+ * @param image The image to print.
+ */
+void printFloatBuffer(FloatImage image);
+
+/**
+ * @brief Produces a new FloatImage from the provided IntImage. The conversion is vectorized.
+ *
+ * @param image The IntImage to convert.
+ * @return FloatImage The float version of the IntImage.
+ */
+FloatImage int2FloatImg(IntImage image);
+
+/**
+ * @brief Produces a new IntImage from the provided FloatImage. Values are rounded and clamped to the dynamic range.
+ * The conversion is vectorized.
+ *
+ * @param image The FloatImage to convert.
+ * @return IntImage The int version of the FloatImage.
+ */
+IntImage float2IntImg(FloatImage image);
+
+/**
+ * @brief Produces a new FloatImage from the provided DoubleImage. The conversion is vectorized.
+ *
+ * @param image The DoubleImage to convert.
+ * @return FloatImage The float version of the DoubleImage.
+ */
+FloatImage double2FloatImg(DoubleImage image);
+
+/**
+ * @brief Produces a new DoubleImage from the provided FloatImage. The conversion is vectorized.
+ *
+ * @param image The FloatImage to convert.
+ * @return DoubleImage The double version of the FloatImage.
+ */
+DoubleImage float2DoubleImg(FloatImage image);
+
+/* ----------------------------- Complex Float Images ----------------------------- */
+
+/**
+ * @brief Allocates an empty single precision complex image in the domain [0...width) x [0..height). A pixel takes 8
+ * bytes instead of the 16 bytes of a ComplexImage.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @return ComplexFloatImage A newly allocated ComplexFloatImage.
+ */
+ComplexFloatImage allocateComplexFloatImage(int width, int height);
+
+/**
+ * @brief Allocates an empty single precision complex image in the domain [minX...maxX] x [minY..maxY].
+ *
+ * @param minX The start of the image domain in the x direction.
+ * @param maxX The end of the image domain in the x direction.
+ * @param minY The start of the image domain in the y direction.
+ * @param maxY The end of the image domain in the y direction.
+ * @return ComplexFloatImage A newly allocated ComplexFloatImage.
+ */
+ComplexFloatImage allocateComplexFloatImageGrid(int minX, int maxX, int minY, int maxY);
+
+/**
+ * @brief Allocates an empty single precision complex image with the provided domain.
+ *
+ * @param domain The domain of the image.
+ * @return ComplexFloatImage A newly allocated ComplexFloatImage.
+ */
+ComplexFloatImage allocateComplexFloatImageGridDomain(ImageDomain domain);
+
+/**
+ * @brief Allocates an empty single precision complex image with the same domain as the provided image.
+ *
+ * @param image The image to take the domain from.
+ * @return ComplexFloatImage A newly allocated ComplexFloatImage.
+ */
+ComplexFloatImage allocateFromComplexFloatImage(ComplexFloatImage image);
+
+/**
+ * @brief Creates a copy of the provided image.
+ *
+ * @param image The image to copy.
+ * @return ComplexFloatImage A copy of the provided image.
+ */
+ComplexFloatImage copyComplexFloatImage(ComplexFloatImage image);
+
+/**
+ * @brief Frees the provided image.
+ *
+ * @param image The image to free.
+ */
+void freeComplexFloatImage(ComplexFloatImage image);
+
+/**
+ * @brief Retrieve the domain information of the provided image.
+ *
+ * @param image The image from which to retrieve the domain.
+ * @return ImageDomain The domain of the image.
+ */
+ImageDomain getComplexFloatImageDomain(ComplexFloatImage image);
+
+/**
+ * @brief Retrieves the pixel value at position (x,y) in the image domain.
+ *
+ * @param image The image.
+ * @param x The x coordinate in the domain.
+ * @param y The y coordinate in the domain.
+ * @return float complex The value of the pixel.
+ */
+float complex getComplexFloatPixel(ComplexFloatImage image, int x, int y);
+
+/**
+ * @brief Retrieves the pixel value at index (x,y) of the pixel matrix, ignoring the domain.
+ *
+ * @param image The image.
+ * @param x The column index.
+ * @param y The row index.
+ * @return float complex The value of the pixel.
+ */
+float complex getComplexFloatPixelI(ComplexFloatImage image, int x, int y);
+
+/**
+ * @brief Sets the pixel at position (x,y) in the image domain.
+ *
+ * @param image The image.
+ * @param x The x coordinate in the domain.
+ * @param y The y coordinate in the domain.
+ * @param complexValue The new value of the pixel.
+ */
+void setComplexFloatPixel(ComplexFloatImage *image, int x, int y, float complex complexValue);
+
+/**
+ * @brief Sets the pixel at index (x,y) of the pixel matrix, ignoring the domain.
+ *
+ * @param image The image.
+ * @param x The column index.
+ * @param y The row index.
+ * @param complexValue The new value of the pixel.
+ */
+void setComplexFloatPixelI(ComplexFloatImage *image, int x, int y, float complex complexValue);
+
+/**
+ * @brief Sets all pixels of the image to the provided value.
+ *
+ * @param image The image.
+ * @param complexValue The new value of the pixels.
+ */
+void setAllComplexFloatPixels(ComplexFloatImage *image, float complex complexValue);
+
+/**
+ * @brief Prints the pixel values of the image to stdout.
+ *
+ * @param image The image to print.
+ */
+void printComplexFloatBuffer(ComplexFloatImage image);
+
+/**
+ * @brief Produces a new ComplexFloatImage from the provided ComplexImage. The conversion is vectorized.
+ *
+ * @param image The ComplexImage to convert.
+ * @return ComplexFloatImage The single precision version of the image.
+ */
+ComplexFloatImage complex2ComplexFloatImg(ComplexImage image);
+
+/**
+ * @brief Produces a new ComplexImage from the provided ComplexFloatImage. The conversion is vectorized.
+ *
+ * @param image The ComplexFloatImage to convert.
+ * @return ComplexImage The double precision version of the image.
+ */
+ComplexImage complexFloat2ComplexImg(ComplexFloatImage image);
+
+/**
+ * @brief Performs the Fast Fourier Transform on the provided input image in single precision. The butterflies process
+ * two complex values per SSE register and the rows are transformed on multiple threads. Note that the image dimensions
+ * must be a power of 2.
+ *
+ * @param image The input image.
+ * @return ComplexFloatImage The fourier transform of the input image.
+ */
+ComplexFloatImage fft2DFloat(FloatImage image);
+
+/**
+ * @brief Performs the Fast Fourier Transform on the provided complex input image in single precision. Note that the
+ * image dimensions must be a power of 2.
+ *
+ * @param image The input image.
+ * @return ComplexFloatImage The fourier transform of the input image.
+ */
+ComplexFloatImage fft2DComplexFloat(ComplexFloatImage image);
+
+/**
+ * @brief Performs the inverse Fast Fourier Transform on the provided complex image in single precision and returns
+ * the real part of the result. Note that the image dimensions must be a power of 2.
+ *
+ * @param image The input image.
+ * @return FloatImage The real part of the inverse fourier transform.
+ */
+FloatImage ifft2DFloat(ComplexFloatImage image);
+
+/**
+ * @brief Performs the inverse Fast Fourier Transform on the provided complex image in single precision. Note that the
+ * image dimensions must be a power of 2.
+ *
+ * @param image The input image.
+ * @return ComplexFloatImage The inverse fourier transform of the input image.
+ */
+ComplexFloatImage ifft2DComplexFloat(ComplexFloatImage image);
+
+/**
+ * @brief Multiplies two complex images pixel by pixel. Both images must have the same domain.
+ *
+ * @param imageA The first image.
+ * @param imageB The second image.
+ * @return ComplexFloatImage The product of both images.
+ */
+ComplexFloatImage multiplyComplexFloatImage(ComplexFloatImage imageA, ComplexFloatImage imageB);
+
+/* ----------------------------- Split Complex Images ----------------------------- */
+
+/**
+ * @brief Allocates an empty split complex image in the domain [0...width) x [0..height). A split complex image stores
+ * the real and imaginary parts in two separate planes, so that SIMD kernels work on whole registers of real or
+ * imaginary parts instead of shuffling interleaved pairs.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @return SplitComplexImage A newly allocated SplitComplexImage.
+ */
+SplitComplexImage allocateSplitComplexImage(int width, int height);
+
+/**
+ * @brief Allocates an empty split complex image in the domain [minX...maxX] x [minY..maxY].
+ *
+ * @param minX The start of the image domain in the x direction.
+ * @param maxX The end of the image domain in the x direction.
+ * @param minY The start of the image domain in the y direction.
+ * @param maxY The end of the image domain in the y direction.
+ * @return SplitComplexImage A newly allocated SplitComplexImage.
+ */
+SplitComplexImage allocateSplitComplexImageGrid(int minX, int maxX, int minY, int maxY);
+
+/**
+ * @brief Allocates an empty split complex image with the provided domain.
+ *
+ * @param domain The domain of the image.
+ * @return SplitComplexImage A newly allocated SplitComplexImage.
+ */
+SplitComplexImage allocateSplitComplexImageGridDomain(ImageDomain domain);
+
+/**
+ * @brief Creates a copy of the provided image.
+ *
+ * @param image The image to copy.
+ * @return SplitComplexImage A copy of the provided image.
+ */
+SplitComplexImage copySplitComplexImage(SplitComplexImage image);
+
+/**
+ * @brief Frees the provided image.
+ *
+ * @param image The image to free.
+ */
+void freeSplitComplexImage(SplitComplexImage image);
+
+/**
+ * @brief Retrieve the domain information of the provided image.
+ *
+ * @param image The image from which to retrieve the domain.
+ * @return ImageDomain The domain of the image.
+ */
+ImageDomain getSplitComplexImageDomain(SplitComplexImage image);
+
+/**
+ * @brief Produces a split complex image from an interleaved complex image.
+ *
+ * @param image The image to convert.
+ * @return SplitComplexImage The split version of the image.
+ */
+SplitComplexImage complex2SplitComplexImg(ComplexImage image);
+
+/**
+ * @brief Produces an interleaved complex image from a split complex image.
+ *
+ * @param image The image to convert.
+ * @return ComplexImage The interleaved version of the image.
+ */
+ComplexImage splitComplex2ComplexImg(SplitComplexImage image);
+
+/**
+ * @brief Multiplies two split complex images pixel by pixel. Both images must have the same domain.
+ *
+ * @param imageA The first image.
+ * @param imageB The second image.
+ * @return SplitComplexImage The product of both images.
+ */
+SplitComplexImage multiplySplitComplexImage(SplitComplexImage imageA, SplitComplexImage imageB);
+
+/**
+ * @brief Multiplies every pixel of imageA by the complex conjugate of the corresponding pixel of imageB, as needed for
+ * cross-correlation. Both images must have the same domain.
+ *
+ * @param imageA The first image.
+ * @param imageB The image that is conjugated.
+ * @return SplitComplexImage The product imageA * conj(imageB).
+ */
+SplitComplexImage conjugateMultiplySplitComplexImage(SplitComplexImage imageA, SplitComplexImage imageB);
+
+/**
+ * @brief Computes the magnitude of every pixel.
+ *
+ * @param image The image.
+ * @return DoubleImage The magnitudes.
+ */
+DoubleImage splitComplexMagnitude(SplitComplexImage image);
+
+/**
+ * @brief Computes log(1 + magnitude) of every pixel, which compresses the range of a spectrum for display.
+ *
+ * @param image The image.
+ * @return DoubleImage The log magnitudes.
+ */
+DoubleImage splitComplexLogMagnitude(SplitComplexImage image);
+
+/**
+ * @brief Performs the Fast Fourier Transform on the provided input image, directly into split form. The rows are
+ * transformed on multiple threads. Note that the image dimensions must be a power of 2.
+ *
+ * @param image The input image.
+ * @return SplitComplexImage The fourier transform of the input image.
+ */
+SplitComplexImage fft2DSplit(DoubleImage image);
+
+/**
+ * @brief Performs the Fast Fourier Transform on the provided split complex image. Note that the image dimensions must
+ * be a power of 2.
+ *
+ * @param image The input image.
+ * @return SplitComplexImage The fourier transform of the input image.
+ */
+SplitComplexImage fft2DSplitComplex(SplitComplexImage image);
+
+/**
+ * @brief Performs the inverse Fast Fourier Transform on the provided split complex image and returns the real part of
+ * the result. Note that the image dimensions must be a power of 2.
+ *
+ * @param image The input image.
+ * @return DoubleImage The real part of the inverse fourier transform.
+ */
+DoubleImage ifft2DSplit(SplitComplexImage image);
+
+/**
+ * @brief Performs the inverse Fast Fourier Transform on the provided split complex image. Note that the image
+ * dimensions must be a power of 2.
+ *
+ * @param image The input image.
+ * @return SplitComplexImage The inverse fourier transform of the input image.
+ */
+SplitComplexImage ifft2DSplitComplex(SplitComplexImage image);
+
+/* ----------------------------- Frequency Filtering ----------------------------- */
+
+typedef struct FrequencyFilter FrequencyFilter;
+
+typedef struct FilterParams {
+  int band;          // FILTER_LOWPASS, FILTER_HIGHPASS or FILTER_BANDPASS
+  double cutoff;     // cutoff frequency, or the centre frequency of a band-pass filter
+  double bandWidth;  // width of the pass band of a band-pass filter
+  int order;         // order of a Butterworth filter
+  int centered;      // non-zero if the DC component of the spectrum has been centered with fft2Dshift
+} FilterParams;
+
+/**
+ * @brief Creates a radially symmetric filter for spectra of the given size, which can be applied to any number of
+ * spectra with applyFrequencyFilterTo. Frequencies are measured in cycles per image, i.e. as the distance in pixels to
+ * the DC component. The filter stores one real row for every distinct vertical frequency, so it takes roughly a
+ * quarter of the memory of a ComplexImage of the same size.
+ *
+ * @param width The width of the spectra the filter is applied to.
+ * @param height The height of the spectra the filter is applied to.
+ * @param type The type of filter: FILTER_IDEAL, FILTER_BUTTERWORTH or FILTER_GAUSSIAN.
+ * @param params The band, frequencies and Butterworth order of the filter.
+ * @return FrequencyFilter* The filter. Must be freed with freeFrequencyFilter.
+ */
+FrequencyFilter *createFrequencyFilter(int width, int height, int type, FilterParams params);
+
+/**
+ * @brief Frees the provided filter.
+ *
+ * @param filter The filter to free.
+ */
+void freeFrequencyFilter(FrequencyFilter *filter);
+
+/**
+ * @brief Multiplies the provided spectrum in place with a filter created by createFrequencyFilter. The size of the
+ * spectrum must match the size of the filter.
+ *
+ * @param image The spectrum to filter.
+ * @param filter The filter.
+ */
+void applyFrequencyFilterTo(ComplexImage *image, const FrequencyFilter *filter);
+
+/**
+ * @brief Multiplies the provided spectrum in place with an ideal, Butterworth or Gaussian low-, high- or band-pass
+ * filter. When the same filter is applied to many spectra, use createFrequencyFilter and applyFrequencyFilterTo
+ * instead.
+ *
+ * @param image The spectrum to filter.
+ * @param type The type of filter: FILTER_IDEAL, FILTER_BUTTERWORTH or FILTER_GAUSSIAN.
+ * @param params The band, frequencies and Butterworth order of the filter.
+ */
+void applyFrequencyFilter(ComplexImage *image, int type, FilterParams params);
+
+/* ----------------------------- Phase Correlation ----------------------------- */
+
+typedef struct PhaseCorrelator PhaseCorrelator;
+
+/**
+ * @brief Creates a phase correlator for images of the given size. It holds the FFT plans and buffers, so that
+ * registering many image pairs of the same size does not allocate. A correlator must not be used by multiple threads
+ * at the same time. Note that the dimensions must be a power of 2.
+ *
+ * @param width The width of the images.
+ * @param height The height of the images.
+ * @return PhaseCorrelator* The correlator. Must be freed with freePhaseCorrelator.
+ */
+PhaseCorrelator *createPhaseCorrelator(int width, int height);
+
+/**
+ * @brief Frees the provided phase correlator.
+ *
+ * @param correlator The correlator to free.
+ */
+void freePhaseCorrelator(PhaseCorrelator *correlator);
+
+/**
+ * @brief Estimates the translation between two images of the size of the correlator with phase correlation. Both images
+ * are multiplied with a Hann window first and the translation is refined to sub-pixel precision. The translation is
+ * such that b(x, y) ≈ a(x - dx, y - dy). Translations are found modulo the image size, in the range (-size/2, size/2].
+ *
+ * @param correlator The correlator.
+ * @param a The reference image.
+ * @param b The translated image.
+ * @param dx The horizontal translation.
+ * @param dy The vertical translation.
+ * @param peak The height of the correlation peak, at most 1. Low values indicate an unreliable estimate. May be NULL.
+ */
+void phaseCorrelateWith(PhaseCorrelator *correlator, DoubleImage a, DoubleImage b, double *dx, double *dy,
+                        double *peak);
+
+/**
+ * @brief Estimates the translation between two images of the same size with phase correlation. See
+ * phaseCorrelateWith. When many image pairs of the same size are registered, use a PhaseCorrelator instead. Note that
+ * the image dimensions must be a power of 2.
+ *
+ * @param a The reference image.
+ * @param b The translated image.
+ * @param dx The horizontal translation.
+ * @param dy The vertical translation.
+ * @param peak The height of the correlation peak, at most 1. May be NULL.
+ */
+void phaseCorrelate(DoubleImage a, DoubleImage b, double *dx, double *dy, double *peak);
+
+/* ----------------------------- Template Matching ----------------------------- */
+
+typedef struct ScorePeak {
+  int x, y;
+  double score;
+} ScorePeak;
+
+/**
+ * @brief Matches a template against every position of the image using zero-mean normalized cross-correlation. The
+ * score at (x, y) compares the template with the image window whose top-left corner is at (x, y), so the domain of the
+ * result runs from the top-left corner of the image domain to the last position where the template fits. Scores lie
+ * in [-1, 1]; windows without any variation score 0. Small templates are correlated directly, large ones via the FFT.
+ *
+ * @param image The image to search in.
+ * @param templ The template to search for. Must not be larger than the image.
+ * @return DoubleImage The score map.
+ */
+DoubleImage matchTemplateNCC(IntImage image, IntImage templ);
+
+/**
+ * @brief Finds the highest local maxima of a score map, e.g. one produced by matchTemplateNCC. A connected plateau of
+ * equal scores counts as a single maximum, located at its first pixel in scan order. Peaks are selected from high to
+ * low and any peak within radius pixels (in both x and y) of an already selected peak is suppressed.
+ *
+ * @param scores The score map.
+ * @param maxPeaks The maximum number of peaks to find.
+ * @param radius The suppression radius.
+ * @param threshold The minimal score of a peak.
+ * @param peaks Array of at least maxPeaks elements that receives the peaks, sorted from high to low score.
+ * @return int The number of peaks found.
+ */
+int findScorePeaks(DoubleImage scores, int maxPeaks, int radius, double threshold, ScorePeak *peaks);
+
+/* ----------------------------- Edge Detection ----------------------------- */
+
+/**
+ * @brief Computes the horizontal and vertical derivatives of an image with the 3x3 Sobel operator. Both derivatives
+ * are computed in a single separable pass. Pixels outside of the image are replicated from the border. Positive values
+ * of gx and gy mean that the image gets brighter to the right and to the bottom respectively.
+ *
+ * @param image The input image.
+ * @param gx Receives the horizontal derivative. Its dynamic range is 4 times the dynamic range of the input, both ways.
+ * @param gy Receives the vertical derivative. Its dynamic range is 4 times the dynamic range of the input, both ways.
+ */
+void sobelIntImage(IntImage image, IntImage *gx, IntImage *gy);
+
+/**
+ * @brief Computes the horizontal and vertical derivatives of an image with the 3x3 Scharr operator, which is more
+ * rotationally symmetric than Sobel. See sobelIntImage.
+ *
+ * @param image The input image.
+ * @param gx Receives the horizontal derivative. Its dynamic range is 16 times the dynamic range of the input, both
+ * ways.
+ * @param gy Receives the vertical derivative. Its dynamic range is 16 times the dynamic range of the input, both
+ * ways.
+ */
+void scharrIntImage(IntImage image, IntImage *gx, IntImage *gy);
+
+/**
+ * @brief Computes the gradient magnitude sqrt(gx^2 + gy^2) of every pixel.
+ *
+ * @param gx The horizontal derivative.
+ * @param gy The vertical derivative. Must have the same domain as gx.
+ * @return DoubleImage The gradient magnitudes.
+ */
+DoubleImage gradientMagnitude(IntImage gx, IntImage gy);
+
+/**
+ * @brief Computes the gradient orientation atan2(gy, gx) of every pixel, in radians in the range [-pi, pi].
+ *
+ * @param gx The horizontal derivative.
+ * @param gy The vertical derivative. Must have the same domain as gx.
+ * @return DoubleImage The gradient orientations.
+ */
+DoubleImage gradientOrientation(IntImage gx, IntImage gy);
+
+/**
+ * @brief Detects edges with the Canny edge detector: Sobel gradients, non-maximum suppression along the gradient
+ * direction and hysteresis thresholding. Pixels whose gradient magnitude exceeds highThreshold are edges, as are the
+ * pixels above lowThreshold that are (8-)connected to them. The image is not smoothed first; noisy images should be
+ * smoothed beforehand.
+ *
+ * @param image The input image.
+ * @param lowThreshold The lower threshold on the Sobel gradient magnitude.
+ * @param highThreshold The upper threshold on the Sobel gradient magnitude.
+ * @return IntImage An image with dynamic range [0..1] in which edge pixels are 1.
+ */
+IntImage cannyIntImage(IntImage image, double lowThreshold, double highThreshold);
+
+/* ----------------------------- Image Sequences ----------------------------- */
+
+/**
+ * An image sequence reader decodes the frames of a sequence of image files on background threads, so that the next
+ * frames are already loaded by the time they are requested. The frames are decoded into a fixed number of buffers
+ * that are recycled once the consumer releases them. Do not access the internals of this struct directly.
+ */
+typedef struct ImageSequenceReader ImageSequenceReader;
+
+/**
+ * @brief Opens a sequence of grey value images. Supported extensions: .pbm, .pgm. Decoding of the first frames starts
+ * immediately in the background.
+ *
+ * @param paths The paths of the images in the order in which they should be delivered.
+ * @param numPaths The number of paths.
+ * @param numBuffers The number of frames that can be decoded ahead/held by the consumer at the same time. Should be
+ * at least 2 to overlap decoding with processing.
+ * @return ImageSequenceReader* A new reader. Note that you should close it when you are done with it.
+ */
+ImageSequenceReader *openIntImageSequence(const char **paths, int numPaths, int numBuffers);
+
+/**
+ * @brief Opens a sequence of rgb images. Supported extensions: .ppm. Decoding of the first frames starts immediately
+ * in the background.
+ *
+ * @param paths The paths of the images in the order in which they should be delivered.
+ * @param numPaths The number of paths.
+ * @param numBuffers The number of frames that can be decoded ahead/held by the consumer at the same time. Should be
+ * at least 2 to overlap decoding with processing.
+ * @return ImageSequenceReader* A new reader. Note that you should close it when you are done with it.
+ */
+ImageSequenceReader *openRgbImageSequence(const char **paths, int numPaths, int numBuffers);
+
+/**
+ * @brief Retrieves the next frame of a grey value image sequence. Blocks until the frame has been decoded. The image
+ * is owned by the reader: do not free it, but release it with releaseIntImage once you are done with it.
+ *
+ * @param reader The image sequence reader.
+ * @param image The next frame will be put here.
+ * @return int 1 if a frame was retrieved. 0 if the end of the sequence was reached.
+ */
+int nextIntImage(ImageSequenceReader *reader, IntImage *image);
+
+/**
+ * @brief Retrieves the next frame of an rgb image sequence. Blocks until the frame has been decoded. The image is
+ * owned by the reader: do not free it, but release it with releaseRgbImage once you are done with it.
+ *
+ * @param reader The image sequence reader.
+ * @param image The next frame will be put here.
+ * @return int 1 if a frame was retrieved. 0 if the end of the sequence was reached.
+ */
+int nextRgbImage(ImageSequenceReader *reader, RgbImage *image);
+
+/**
+ * @brief Hands a frame obtained with nextIntImage back to the reader, so that its buffer can be reused for an upcoming
+ * frame. The image should not be used after this call.
+ *
+ * @param reader The image sequence reader.
+ * @param image The frame to release.
+ */
+void releaseIntImage(ImageSequenceReader *reader, IntImage image);
+
+/**
+ * @brief Hands a frame obtained with nextRgbImage back to the reader, so that its buffer can be reused for an upcoming
+ * frame. The image should not be used after this call.
+ *
+ * @param reader The image sequence reader.
+ * @param image The frame to release.
+ */
+void releaseRgbImage(ImageSequenceReader *reader, RgbImage image);
+
+/**
+ * @brief Stops the background decoding and frees all memory used by the reader, including the frame buffers. Frames
+ * that have not been released yet become invalid.
+ *
+ * @param reader The image sequence reader to close.
+ */
+void closeImageSequence(ImageSequenceReader *reader);
+
+/* ----------------------------- Asynchronous Saving ----------------------------- */
+
+/**
+ * An image saver writes images to disk on a background thread, in the order in which they were queued. Do not access
+ * the internals of this struct directly.
+ */
+typedef struct ImageSaver ImageSaver;
+
+/**
+ * @brief Creates a new image saver with its own writer thread.
+ *
+ * @param maxQueued The maximum number of images that can wait to be written. Queueing more images blocks until the
+ * writer has caught up.
+ * @return ImageSaver* A new image saver. Note that you should close it when you are done with it.
+ */
+ImageSaver *createImageSaver(int maxQueued);
+
+/**
+ * @brief Queues an image to be saved at the provided location. Supported extensions: .pbm, .pgm, .pam. The files are
+ * written in the same binary formats as saveIntImage. The saver takes ownership of the image: it is freed once it has
+ * been written, so it should not be used or freed by the caller afterwards.
+ *
+ * @param saver The image saver.
+ * @param image The image to save.
+ * @param path The location to save the image at.
+ */
+void queueIntImageSave(ImageSaver *saver, IntImage image, const char *path);
+
+/**
+ * @brief Queues an image to be saved at the provided location. Supported extensions: .ppm, .pam. The file is written
+ * in the same binary format as saveRgbImage. The saver takes ownership of the image: it is freed once it has been
+ * written, so it should not be used or freed by the caller afterwards.
+ *
+ * @param saver The image saver.
+ * @param image The image to save.
+ * @param path The location to save the image at.
+ */
+void queueRgbImageSave(ImageSaver *saver, RgbImage image, const char *path);
+
+/**
+ * @brief Blocks until all images queued so far have been written.
+ *
+ * @param saver The image saver.
+ */
+void flushImageSaver(ImageSaver *saver);
+
+/**
+ * @brief Writes all remaining queued images, stops the writer thread and frees the memory used by the saver.
+ *
+ * @param saver The image saver to close.
+ */
+void closeImageSaver(ImageSaver *saver);
+
+/* ----------------------------- Tiled Image Files ----------------------------- */
+
+/**
+ * A tiled image file stores an image of any type (see the *_PIXELS constants) losslessly, together with its domain and
+ * dynamic range. The pixels are split into fixed-size tiles that are located through an index, so that a single tile
+ * can be read without decoding the rest of the file. Tiles can optionally be compressed with a delta + run-length
+ * codec (TILE_DELTA_RLE), which works well for images with flat or smooth regions. Do not access the internals of
+ * this struct directly.
+ */
+typedef struct TiledImageFile TiledImageFile;
+
+typedef struct TiledImageInfo {
+  int pixelType;
+  ImageDomain domain;
+  double minRange, maxRange;
+  int tileWidth, tileHeight;
+  int tilesX, tilesY;
+  int compression;
+} TiledImageInfo;
+
+/**
+ * @brief Saves an image as a tiled image file.
+ *
+ * @param image The image to save.
+ * @param path The location to save the image at.
+ * @param tileSize The width and height of the tiles. Tiles at the right and bottom border can be smaller.
+ * @param compression Either TILE_UNCOMPRESSED or TILE_DELTA_RLE.
+ */
+void saveIntImageTiled(IntImage image, const char *path, int tileSize, int compression);
+
+/**
+ * @brief Saves an image as a tiled image file.
+ *
+ * @param image The image to save.
+ * @param path The location to save the image at.
+ * @param tileSize The width and height of the tiles. Tiles at the right and bottom border can be smaller.
+ * @param compression Either TILE_UNCOMPRESSED or TILE_DELTA_RLE.
+ */
+void saveRgbImageTiled(RgbImage image, const char *path, int tileSize, int compression);
+
+/**
+ * @brief Saves an image as a tiled image file.
+ *
+ * @param image The image to save.
+ * @param path The location to save the image at.
+ * @param tileSize The width and height of the tiles. Tiles at the right and bottom border can be smaller.
+ * @param compression Either TILE_UNCOMPRESSED or TILE_DELTA_RLE.
+ */
+void saveDoubleImageTiled(DoubleImage image, const char *path, int tileSize, int compression);
+
+/**
+ * @brief Saves an image as a tiled image file.
+ *
+ * @param image The image to save.
+ * @param path The location to save the image at.
+ * @param tileSize The width and height of the tiles. Tiles at the right and bottom border can be smaller.
+ * @param compression Either TILE_UNCOMPRESSED or TILE_DELTA_RLE.
+ */
+void saveComplexImageTiled(ComplexImage image, const char *path, int tileSize, int compression);
+
+/**
+ * @brief Loads an image from a tiled image file. The file must contain INT_PIXELS.
+ *
+ * @param path The path of the file to load.
+ * @return IntImage The image with the domain and dynamic range it was saved with.
+ */
+IntImage loadIntImageTiled(const char *path);
+
+/**
+ * @brief Loads an image from a tiled image file. The file must contain RGB_PIXELS.
+ *
+ * @param path The path of the file to load.
+ * @return RgbImage The image with the domain and dynamic range it was saved with.
+ */
+RgbImage loadRgbImageTiled(const char *path);
+
+/**
+ * @brief Loads an image from a tiled image file. The file must contain DOUBLE_PIXELS.
+ *
+ * @param path The path of the file to load.
+ * @return DoubleImage The image with the domain and dynamic range it was saved with.
+ */
+DoubleImage loadDoubleImageTiled(const char *path);
+
+/**
+ * @brief Loads an image from a tiled image file. The file must contain COMPLEX_PIXELS.
+ *
+ * @param path The path of the file to load.
+ * @return ComplexImage The image with the domain it was saved with.
+ */
+ComplexImage loadComplexImageTiled(const char *path);
+
+/**
+ * @brief Opens a tiled image file for random access to its tiles. The file is memory mapped, so only the tiles that
+ * are read are actually loaded from disk.
+ *
+ * @param path The path of the file to open.
+ * @return TiledImageFile* The opened file. Note that you should close it when you are done with it.
+ */
+TiledImageFile *openTiledImage(const char *path);
+
+/**
+ * @brief Retrieves the pixel type, domain, dynamic range and tile layout of an opened tiled image file.
+ *
+ * @param file The opened file.
+ * @return TiledImageInfo The properties of the file.
+ */
+TiledImageInfo getTiledImageInfo(TiledImageFile *file);
+
+/**
+ * @brief Reads a single tile of a file that contains INT_PIXELS.
+ *
+ * @param file The opened file.
+ * @param tileX The column of the tile, in the range [0..tilesX).
+ * @param tileY The row of the tile, in the range [0..tilesY).
+ * @return IntImage The tile. Its domain is the part of the domain of the full image that the tile covers.
+ */
+IntImage readIntImageTile(TiledImageFile *file, int tileX, int tileY);
+
+/**
+ * @brief Reads a single tile of a file that contains RGB_PIXELS.
+ *
+ * @param file The opened file.
+ * @param tileX The column of the tile, in the range [0..tilesX).
+ * @param tileY The row of the tile, in the range [0..tilesY).
+ * @return RgbImage The tile. Its domain is the part of the domain of the full image that the tile covers.
+ */
+RgbImage readRgbImageTile(TiledImageFile *file, int tileX, int tileY);
+
+/**
+ * @brief Reads a single tile of a file that contains DOUBLE_PIXELS.
+ *
+ * @param file The opened file.
+ * @param tileX The column of the tile, in the range [0..tilesX).
+ * @param tileY The row of the tile, in the range [0..tilesY).
+ * @return DoubleImage The tile. Its domain is the part of the domain of the full image that the tile covers.
+ */
+DoubleImage readDoubleImageTile(TiledImageFile *file, int tileX, int tileY);
+
+/**
+ * @brief Reads a single tile of a file that contains COMPLEX_PIXELS.
+ *
+ * @param file The opened file.
+ * @param tileX The column of the tile, in the range [0..tilesX).
+ * @param tileY The row of the tile, in the range [0..tilesY).
+ * @return ComplexImage The tile. Its domain is the part of the domain of the full image that the tile covers.
+ */
+ComplexImage readComplexImageTile(TiledImageFile *file, int tileX, int tileY);
+
+/**
+ * @brief Unmaps and closes a tiled image file.
+ *
+ * @param file The file to close.
+ */
+void closeTiledImage(TiledImageFile *file);
+
+/* ----------------------------- Image Probing ----------------------------- */
+
+typedef struct ImageInfo {
+  int width, height;
+  int channels;     // 1 for pbm/pgm, 3 for ppm, the depth for pam
+  int maxVal;       // 1 for pbm
+  int bitDepth;     // bits per sample in the raw formats: 1, 8 or 16
+  int magicNumber;  // the N of the PN magic number
+  long dataOffset;  // offset in bytes of the pixel data in the file
+} ImageInfo;
+
+/**
+ * @brief Retrieves the properties of a netpbm (.pbm, .pgm, .ppm, .pam) file by parsing only its header, without
+ * decoding any pixels.
+ *
+ * @param path The path of the image to probe.
+ * @param info Will contain the properties of the image.
+ */
+void probeImage(const char *path, ImageInfo *info);
+
+/* ----------------------------- Bit Images ----------------------------- */
+
+/**
+ * @brief Allocates an empty (all 0) bit image in the domain [0...width) x [0..height). Bit images store binary masks
+ * with one bit per pixel, which allows them to be combined and filtered 64 pixels at a time.
+ *
+ * @param width The width of the image in pixels.
+ * @param height The height of the image in pixels.
+ * @return BitImage A newly allocated BitImage. Note that you should free the resulting image when you are done with it.
+ */
+BitImage allocateBitImage(int width, int height);
+
+/**
+ * @brief Allocates an empty (all 0) bit image in the domain [minX...maxX] x [minY..maxY].
+ *
+ * @param minX The start of the image domain in the x direction.
+ * @param maxX The end of the image domain in the x direction.
+ * @param minY The start of the image domain in the y direction.
+ * @param maxY The end of the image domain in the y direction.
+ * @return BitImage A newly allocated BitImage. Note that you should free the resulting image when you are done with it.
+ */
+BitImage allocateBitImageGrid(int minX, int maxX, int minY, int maxY);
+
+/**
+ * @brief Allocates an empty (all 0) bit image with the domain of the provided image.
+ *
+ * @param image The image whose domain to copy.
+ * @return BitImage A newly allocated BitImage.
+ */
+BitImage allocateFromBitImage(BitImage image);
+
+/**
+ * @brief Creates a copy of the provided image.
+ *
+ * @param image The image to copy.
+ * @return BitImage A copy of the provided image.
+ */
+BitImage copyBitImage(BitImage image);
+
+/**
+ * @brief Frees the memory used by the provided image.
+ *
+ * @param image The image to free.
+ */
+void freeBitImage(BitImage image);
+
+/**
+ * @brief Retrieves the domain of the provided image.
+ *
+ * @param image The image.
+ * @return ImageDomain The domain of the image.
+ */
+ImageDomain getBitImageDomain(BitImage image);
+
+/**
+ * @brief Retrieves the pixel value (0 or 1) at the provided coordinates in the image domain.
+ *
+ * @param image The image.
+ * @param x The x-coordinate in the image domain.
+ * @param y The y-coordinate in the image domain.
+ * @return int The pixel value.
+ */
+int getBitPixel(BitImage image, int x, int y);
+
+/**
+ * @brief Retrieves the pixel value (0 or 1) at the provided index. Indexing starts at 0, regardless of the domain.
+ *
+ * @param image The image.
+ * @param x The x-index.
+ * @param y The y-index.
+ * @return int The pixel value.
+ */
+int getBitPixelI(BitImage image, int x, int y);
+
+/**
+ * @brief Sets the pixel at the provided coordinates in the image domain to 1 if val is non-zero and to 0 otherwise.
+ *
+ * @param image The image.
+ * @param x The x-coordinate in the image domain.
+ * @param y The y-coordinate in the image domain.
+ * @param val The new pixel value.
+ */
+void setBitPixel(BitImage *image, int x, int y, int val);
+
+/**
+ * @brief Sets the pixel at the provided index to 1 if val is non-zero and to 0 otherwise. Indexing starts at 0,
+ * regardless of the domain.
+ *
+ * @param image The image.
+ * @param x The x-index.
+ * @param y The y-index.
+ * @param val The new pixel value.
+ */
+void setBitPixelI(BitImage *image, int x, int y, int val);
+
+/**
+ * @brief Counts the number of pixels that are 1, i.e. the area of the mask.
+ *
+ * @param image The image.
+ * @return long The number of pixels with value 1.
+ */
+long countBitPixels(BitImage image);
+
+/**
+ * @brief Converts an integer image to a bit image. Non-zero pixels become 1.
+ *
+ * @param image The image to convert.
+ * @return BitImage A bit image with the domain of the input.
+ */
+BitImage int2BitImg(IntImage image);
+
+/**
+ * @brief Converts a bit image to an integer image with dynamic range [0..1].
+ *
+ * @param image The image to convert.
+ * @return IntImage An integer image with the domain of the input.
+ */
+IntImage bit2IntImg(BitImage image);
+
+/**
+ * @brief Computes the pixelwise AND of two images. Both images must have the same domain.
+ *
+ * @param imageA The first image.
+ * @param imageB The second image.
+ * @return BitImage A new image containing the result.
+ */
+BitImage andBitImage(BitImage imageA, BitImage imageB);
+
+/**
+ * @brief Computes the pixelwise OR of two images. Both images must have the same domain.
+ *
+ * @param imageA The first image.
+ * @param imageB The second image.
+ * @return BitImage A new image containing the result.
+ */
+BitImage orBitImage(BitImage imageA, BitImage imageB);
+
+/**
+ * @brief Computes the pixelwise XOR of two images. Both images must have the same domain.
+ *
+ * @param imageA The first image.
+ * @param imageB The second image.
+ * @return BitImage A new image containing the result.
+ */
+BitImage xorBitImage(BitImage imageA, BitImage imageB);
+
+/**
+ * @brief Computes the pixelwise NOT of an image.
+ *
+ * @param image The image.
+ * @return BitImage A new image containing the result.
+ */
+BitImage notBitImage(BitImage image);
+
+/**
+ * @brief Performs a binary dilation with a rectangle of width kw and height kh. The result is the same as that of
+ * dilateIntImageRect on the corresponding 0/1 integer image.
+ *
+ * @param image The image to dilate.
+ * @param kw The width of the rectangular structuring element (kernel).
+ * @param kh The height of the rectangular structuring element (kernel).
+ * @return BitImage The dilated image.
+ */
+BitImage dilateBitImageRect(BitImage image, int kw, int kh);
+
+/**
+ * @brief Performs a binary erosion with a rectangle of width kw and height kh. The result is the same as that of
+ * erodeIntImageRect on the corresponding 0/1 integer image.
+ *
+ * @param image The image to erode.
+ * @param kw The width of the rectangular structuring element (kernel).
+ * @param kh The height of the rectangular structuring element (kernel).
+ * @return BitImage The eroded image.
+ */
+BitImage erodeBitImageRect(BitImage image, int kw, int kh);
+
+/**
+ * @brief Loads a .pbm file as a bit image. Pixel values are the same as those of loadIntImage (black is 0). Raw (P4)
+ * rows are loaded word by word.
+ *
+ * @param path The path of the image to load.
+ * @return BitImage The loaded image.
+ */
+BitImage loadBitImage(const char *path);
+
+/**
+ * @brief Saves a bit image as a raw (P4) .pbm file.
+ *
+ * @param image The image to save.
+ * @param path The location to save the image at.
+ */
+void saveBitImage(BitImage image, const char *path);
+
+/* ----------------------------- Resampling ----------------------------- */
+
+/**
+ * @brief Resizes an image to newWidth x newHeight pixels. The filter is applied separably with precomputed weights and
+ * is widened when downsampling, so that the result is free of aliasing. RESIZE_AREA averages the covered pixels, which
+ * is the best choice for thumbnails; integer reduction factors take a dedicated fast path. The result has the domain
+ * [0..newWidth) x [0..newHeight) and the dynamic range of the input; values are rounded and clamped to that range.
+ * Large images are processed on multiple threads.
+ *
+ * @param image The image to resize.
+ * @param newWidth The width of the result.
+ * @param newHeight The height of the result.
+ * @param filter One of RESIZE_AREA, RESIZE_BILINEAR, RESIZE_BICUBIC and RESIZE_LANCZOS.
+ * @return IntImage The resized image.
+ */
+IntImage resizeIntImage(IntImage image, int newWidth, int newHeight, int filter);
+
+/**
+ * @brief Resizes an image to newWidth x newHeight pixels. See resizeIntImage for details.
+ *
+ * @param image The image to resize.
+ * @param newWidth The width of the result.
+ * @param newHeight The height of the result.
+ * @param filter One of RESIZE_AREA, RESIZE_BILINEAR, RESIZE_BICUBIC and RESIZE_LANCZOS.
+ * @return RgbImage The resized image.
+ */
+RgbImage resizeRgbImage(RgbImage image, int newWidth, int newHeight, int filter);
+
+/**
+ * @brief Resizes an image to newWidth x newHeight pixels. See resizeIntImage for details; values are clamped to the
+ * dynamic range of the input, but not rounded.
+ *
+ * @param image The image to resize.
+ * @param newWidth The width of the result.
+ * @param newHeight The height of the result.
+ * @param filter One of RESIZE_AREA, RESIZE_BILINEAR, RESIZE_BICUBIC and RESIZE_LANCZOS.
+ * @return DoubleImage The resized image.
+ */
+DoubleImage resizeDoubleImage(DoubleImage image, int newWidth, int newHeight, int filter);
+
+/* ----------------------------- Image Pyramids ----------------------------- */
+
+/**
+ * @brief Allocates a pyramid for images of width x height. Every level is half the size of the previous one (rounded
+ * up). The pixels of all levels share a single allocation, so the levels should not be freed individually. The
+ * pyramid can be reused for any number of images of the same size.
+ *
+ * @param width The width of the full resolution level.
+ * @param height The height of the full resolution level.
+ * @param levels The number of levels. Limited to the number of levels it takes to reach a single pixel.
+ * @return ImagePyramid A newly allocated pyramid. Note that you should free it when you are done with it.
+ */
+ImagePyramid allocateImagePyramid(int width, int height, int levels);
+
+/**
+ * @brief Frees the memory used by a pyramid, including all its levels.
+ *
+ * @param pyramid The pyramid to free.
+ */
+void freeImagePyramid(ImagePyramid pyramid);
+
+/**
+ * @brief Fills a pyramid with the Gaussian pyramid of an image: level 0 is the image itself and every next level is
+ * the previous level blurred with a 5x5 binomial kernel and subsampled by 2. The blur is only evaluated at the pixels
+ * that are kept.
+ *
+ * @param image The image. Must have the size of level 0 of the pyramid.
+ * @param pyramid The pyramid to fill.
+ */
+void computeGaussianPyramid(DoubleImage image, ImagePyramid *pyramid);
+
+/**
+ * @brief Fills a pyramid with the Laplacian pyramid of an image: every level is the difference between the Gaussian
+ * level and the upsampled next Gaussian level. The last level is the smallest Gaussian level.
+ *
+ * @param image The image. Must have the size of level 0 of the pyramid.
+ * @param pyramid The pyramid to fill.
+ */
+void computeLaplacianPyramid(DoubleImage image, ImagePyramid *pyramid);
+
+/**
+ * @brief Allocates and computes the Gaussian pyramid of an image. Use int2DoubleImg to build a pyramid of an IntImage.
+ *
+ * @param image The image.
+ * @param levels The number of levels.
+ * @return ImagePyramid The Gaussian pyramid. Note that you should free it when you are done with it.
+ */
+ImagePyramid buildGaussianPyramid(DoubleImage image, int levels);
+
+/**
+ * @brief Allocates and computes the Laplacian pyramid of an image.
+ *
+ * @param image The image.
+ * @param levels The number of levels.
+ * @return ImagePyramid The Laplacian pyramid. Note that you should free it when you are done with it.
+ */
+ImagePyramid buildLaplacianPyramid(DoubleImage image, int levels);
+
+/**
+ * @brief Reconstructs an image from its Laplacian pyramid by upsampling and adding the levels from coarse to fine. The
+ * reconstruction of an unmodified pyramid equals the original image (up to rounding errors).
+ *
+ * @param pyramid The Laplacian pyramid.
+ * @return DoubleImage The reconstructed image.
+ */
+DoubleImage collapseLaplacianPyramid(ImagePyramid pyramid);
+
+/* ----------------------------- Colour Conversion ----------------------------- */
+
+/**
+ * @brief Converts an RGB image to grey values using the luma weights of BT.601 or BT.709. The weights are applied in
+ * fixed point, 4 pixels at a time when the dynamic range fits in 15 bits, and on multiple threads for large images.
+ *
+ * @param image The image to convert.
+ * @param grey The image to store the grey values in. Must have the same size as the input.
+ * @param standard Either GREY_BT601 or GREY_BT709.
+ */
+void rgb2GreyImg(RgbImage image, IntImage *grey, int standard);
+
+/**
+ * @brief Converts an RGB image to full range YCbCr (BT.601, as used by JPEG). The chroma channels are centred on the
+ * middle of the dynamic range, e.g. 128 for 8-bit images.
+ *
+ * @param image The image to convert.
+ * @param lum The image to store the luma (Y) in. Must have the same size as the input.
+ * @param cb The image to store the blue-difference chroma in. Must have the same size as the input.
+ * @param cr The image to store the red-difference chroma in. Must have the same size as the input.
+ */
+void rgb2YCbCrImg(RgbImage image, IntImage *lum, IntImage *cb, IntImage *cr);
+
+/**
+ * @brief Converts full range YCbCr back to RGB. The chroma channels are expected to be centred on the middle of the
+ * dynamic range of the result, whose values are clamped to that range.
+ *
+ * @param lum The luma (Y) values.
+ * @param cb The blue-difference chroma values.
+ * @param cr The red-difference chroma values.
+ * @param image The image to store the result in. Must have the same size as the inputs.
+ */
+void yCbCr2RgbImg(IntImage lum, IntImage cb, IntImage cr, RgbImage *image);
+
+/**
+ * @brief Converts an RGB image to HSV. The hue is in degrees [0..360); saturation and value are in [0..1], where the
+ * value is relative to the dynamic range of the input.
+ *
+ * @param image The image to convert.
+ * @param hue The image to store the hue in. Must have the same size as the input.
+ * @param saturation The image to store the saturation in. Must have the same size as the input.
+ * @param value The image to store the value in. Must have the same size as the input.
+ */
+void rgb2HsvImg(RgbImage image, DoubleImage *hue, DoubleImage *saturation, DoubleImage *value);
+
+/**
+ * @brief Converts HSV back to RGB. See rgb2HsvImg for the ranges of the channels. The result is rounded to the dynamic
+ * range of the output image.
+ *
+ * @param hue The hue in degrees.
+ * @param saturation The saturation in [0..1].
+ * @param value The value in [0..1].
+ * @param image The image to store the result in. Must have the same size as the inputs.
+ */
+void hsv2RgbImg(DoubleImage hue, DoubleImage saturation, DoubleImage value, RgbImage *image);
+
+/**
+ * @brief Converts an RGB image to CIE L*a*b*. The channels are interpreted as sRGB scaled to the dynamic range of the
+ * input, with a D65 white point. The lightness is in [0..100].
+ *
+ * @param image The image to convert.
+ * @param lightness The image to store L* in. Must have the same size as the input.
+ * @param a The image to store a* in. Must have the same size as the input.
+ * @param b The image to store b* in. Must have the same size as the input.
+ */
+void rgb2LabImg(RgbImage image, DoubleImage *lightness, DoubleImage *a, DoubleImage *b);
+
+/**
+ * @brief Converts CIE L*a*b* back to sRGB. Colours outside of the sRGB gamut are clamped to the dynamic range of the
+ * output image.
+ *
+ * @param lightness The L* values.
+ * @param a The a* values.
+ * @param b The b* values.
+ * @param image The image to store the result in. Must have the same size as the inputs.
+ */
+void lab2RgbImg(DoubleImage lightness, DoubleImage a, DoubleImage b, RgbImage *image);
 #endif  // IMPROC_H
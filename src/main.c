@@ -1,43 +1,486 @@
+#include <glob.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "improc.h"
 
-void thresholdDemo(const char *path) {
-  IntImage image = loadIntImage(path);
-  ImageDomain domain = getIntImageDomain(image);
-  displayIntImage(image, "Source Image");
-	int width, height;
-	getWidthHeight(domain, &width, &height);
-  IntImage thresholdedImage = allocateIntImage(width, height, 0, 255);
-  for (int threshold = 64; threshold < 256; threshold += 64) {
-    for (int y = 0; y < height; y++) {
-      for (int x = 0; x < width; x++) {
-        if (getIntPixelI(image, x, y) < threshold) {
-          setIntPixelI(&thresholdedImage, x, y, 0);
-        } else {
-          setIntPixelI(&thresholdedImage, x, y, 255);
+/*
+ * Batch driver. Every input file is pushed through the same pipeline of operations. The work is split over three
+ * stages that run concurrently:
+ *
+ *   loader thread --(bounded queue)--> compute workers --(bounded queue)--> saver thread
+ *
+ * This way the I/O of file N+1 overlaps with the computations on file N, while the bounded queues make sure that no
+ * more than a handful of images are in memory at any point in time.
+ */
+
+#define MAX_OPS 32
+
+enum { OP_LOAD, OP_THRESHOLD, OP_DILATE, OP_ERODE, OP_DT, OP_INVERT, OP_SAVE, NUM_OP_TYPES };
+
+static const char *opNames[NUM_OP_TYPES] = {"load", "threshold", "dilate", "erode", "dt", "invert", "save"};
+
+typedef struct Operation {
+  int type;
+  int a, b;             // integer arguments (threshold value, kernel width/height, metric)
+  const char *pattern;  // output pattern of a save operation
+} Operation;
+
+typedef struct Pipeline {
+  Operation ops[MAX_OPS];
+  int numOps;
+} Pipeline;
+
+typedef struct Job {
+  int index;
+  IntImage image;
+} Job;
+
+typedef struct JobQueue {
+  Job *jobs;
+  int capacity, head, count;
+  int closed;
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty, notFull;
+} JobQueue;
+
+typedef struct StageStats {
+  long items;
+  long long bytes;
+  double busy;  // seconds, summed over all threads working in this stage
+} StageStats;
+
+typedef struct Batch {
+  Pipeline pipeline;
+  char **paths;
+  int numPaths;
+  JobQueue loaded, computed;
+  pthread_mutex_t statsLock;
+  StageStats stats[NUM_OP_TYPES];
+} Batch;
+
+/** Util ****************************************************/
+
+static void fatalError(const char *format, ...) {
+  fprintf(stderr, "Fatal error: ");
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  exit(EXIT_FAILURE);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static long long fileSize(const char *path) {
+  struct stat st;
+  return (stat(path, &st) == 0 ? (long long)st.st_size : 0);
+}
+
+static void addStats(Batch *batch, int op, double seconds, long long bytes) {
+  pthread_mutex_lock(&batch->statsLock);
+  batch->stats[op].items++;
+  batch->stats[op].busy += seconds;
+  batch->stats[op].bytes += bytes;
+  pthread_mutex_unlock(&batch->statsLock);
+}
+
+/** Job queue ****************************************************/
+
+static void initJobQueue(JobQueue *queue, int capacity) {
+  queue->jobs = malloc(capacity * sizeof(Job));
+  if (queue->jobs == NULL) {
+    fatalError("initJobQueue: out of memory.\n");
+  }
+  queue->capacity = capacity;
+  queue->head = queue->count = 0;
+  queue->closed = 0;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->notEmpty, NULL);
+  pthread_cond_init(&queue->notFull, NULL);
+}
+
+static void destroyJobQueue(JobQueue *queue) {
+  pthread_cond_destroy(&queue->notFull);
+  pthread_cond_destroy(&queue->notEmpty);
+  pthread_mutex_destroy(&queue->lock);
+  free(queue->jobs);
+}
+
+static void pushJob(JobQueue *queue, Job job) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == queue->capacity) {
+    pthread_cond_wait(&queue->notFull, &queue->lock);
+  }
+  queue->jobs[(queue->head + queue->count) % queue->capacity] = job;
+  queue->count++;
+  pthread_cond_signal(&queue->notEmpty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// returns 0 when the queue is closed and drained
+static int popJob(JobQueue *queue, Job *job) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == 0 && !queue->closed) {
+    pthread_cond_wait(&queue->notEmpty, &queue->lock);
+  }
+  if (queue->count == 0) {
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+  }
+  *job = queue->jobs[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+  pthread_cond_signal(&queue->notFull);
+  pthread_mutex_unlock(&queue->lock);
+  return 1;
+}
+
+static void closeJobQueue(JobQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  queue->closed = 1;
+  pthread_cond_broadcast(&queue->notEmpty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+/** Pipeline ****************************************************/
+
+static int parseMetric(const char *name) {
+  if (strcmp(name, "euclid") == 0) return EUCLID;
+  if (strcmp(name, "sqeuclid") == 0) return SQEUCLID;
+  if (strcmp(name, "manhattan") == 0) return MANHATTAN;
+  if (strcmp(name, "chessboard") == 0) return CHESSBOARD;
+  fatalError("unknown distance metric '%s' (must be euclid, sqeuclid, manhattan or chessboard).\n", name);
+  return -1;
+}
+
+static void parseKernelSize(const char *arg, Operation *op) {
+  if (arg == NULL || sscanf(arg, "%dx%d", &op->a, &op->b) != 2 || op->a < 1 || op->b < 1) {
+    fatalError("%s expects a kernel size of the form WxH.\n", opNames[op->type]);
+  }
+}
+
+// Parses a comma separated list of operations, e.g. "load,threshold:128,dilate:3x3,dt:euclid,save:out/%s.pgm"
+static Pipeline parsePipeline(char *spec) {
+  Pipeline pipeline;
+  pipeline.numOps = 0;
+  for (char *token = strtok(spec, ","); token != NULL; token = strtok(NULL, ",")) {
+    if (pipeline.numOps == MAX_OPS) {
+      fatalError("pipeline has more than %d operations.\n", MAX_OPS);
+    }
+    char *arg = strchr(token, ':');
+    if (arg != NULL) {
+      *arg++ = '\0';
+    }
+    Operation *op = &pipeline.ops[pipeline.numOps++];
+    op->type = -1;
+    for (int t = 0; t < NUM_OP_TYPES; t++) {
+      if (strcmp(token, opNames[t]) == 0) {
+        op->type = t;
+      }
+    }
+    switch (op->type) {
+      case OP_LOAD:
+      case OP_INVERT:
+        break;
+      case OP_THRESHOLD:
+        if (arg == NULL || sscanf(arg, "%d", &op->a) != 1) {
+          fatalError("threshold expects a grey value, e.g. threshold:128.\n");
+        }
+        break;
+      case OP_DILATE:
+      case OP_ERODE:
+        parseKernelSize(arg, op);
+        break;
+      case OP_DT:
+        op->a = parseMetric(arg == NULL ? "euclid" : arg);
+        break;
+      case OP_SAVE:
+        if (arg == NULL || strstr(arg, "%s") == NULL) {
+          fatalError("save expects an output pattern containing %%s, e.g. save:out/%%s.pgm.\n");
         }
+        op->pattern = arg;
+        break;
+      default:
+        fatalError("unknown operation '%s'.\n", token);
+    }
+  }
+  if (pipeline.numOps == 0 || pipeline.ops[0].type != OP_LOAD) {
+    fatalError("a pipeline must start with 'load'.\n");
+  }
+  for (int i = 1; i < pipeline.numOps; i++) {
+    if (pipeline.ops[i].type == OP_LOAD) {
+      fatalError("'load' can only be the first operation of a pipeline.\n");
+    }
+  }
+  return pipeline;
+}
+
+// Builds the output path by replacing the first %s in the pattern by the file name (without directory and extension)
+static void outputPath(const char *pattern, const char *inputPath, char *out, int outSize) {
+  const char *base = strrchr(inputPath, '/');
+  base = (base == NULL ? inputPath : base + 1);
+  const char *dot = strrchr(base, '.');
+  int baseLength = (dot == NULL ? (int)strlen(base) : (int)(dot - base));
+  const char *marker = strstr(pattern, "%s");
+  int prefixLength = marker - pattern;
+  if (snprintf(out, outSize, "%.*s%.*s%s", prefixLength, pattern, baseLength, base, marker + 2) >= outSize) {
+    fatalError("output path for '%s' is too long.\n", inputPath);
+  }
+}
+
+static void saveJob(Batch *batch, const Operation *op, Job job) {
+  char path[4096];
+  outputPath(op->pattern, batch->paths[job.index], path, sizeof(path));
+  double start = now();
+  saveIntImage(job.image, path);
+  addStats(batch, OP_SAVE, now() - start, fileSize(path));
+}
+
+static IntImage thresholdImage(IntImage image, int threshold) {
+  ImageDomain domain = getIntImageDomain(image);
+  int width, height;
+  getWidthHeight(domain, &width, &height);
+  IntImage result = allocateIntImageGridDomain(domain, 0, 1);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      setIntPixelI(&result, x, y, getIntPixelI(image, x, y) >= threshold);
+    }
+  }
+  return result;
+}
+
+static IntImage invertImage(IntImage image) {
+  ImageDomain domain = getIntImageDomain(image);
+  int width, height, minRange, maxRange;
+  getWidthHeight(domain, &width, &height);
+  getDynamicRange(image, &minRange, &maxRange);
+  IntImage result = allocateFromIntImage(image);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      setIntPixelI(&result, x, y, minRange + maxRange - getIntPixelI(image, x, y));
+    }
+  }
+  return result;
+}
+
+static IntImage applyOperation(const Operation *op, IntImage image) {
+  switch (op->type) {
+    case OP_THRESHOLD:
+      return thresholdImage(image, op->a);
+    case OP_DILATE:
+      return dilateIntImageRect(image, op->a, op->b);
+    case OP_ERODE:
+      return erodeIntImageRect(image, op->a, op->b);
+    case OP_DT:
+      return distanceTransform(image, op->a, 1);
+    case OP_INVERT:
+      return invertImage(image);
+  }
+  fatalError("applyOperation: operation %s cannot be applied here.\n", opNames[op->type]);
+  return image;
+}
+
+/** Stages ****************************************************/
+
+static void *loaderThread(void *arg) {
+  Batch *batch = arg;
+  for (int i = 0; i < batch->numPaths; i++) {
+    Job job;
+    job.index = i;
+    double start = now();
+    job.image = loadIntImage(batch->paths[i]);
+    addStats(batch, OP_LOAD, now() - start, fileSize(batch->paths[i]));
+    pushJob(&batch->loaded, job);
+  }
+  closeJobQueue(&batch->loaded);
+  return NULL;
+}
+
+static void *computeThread(void *arg) {
+  Batch *batch = arg;
+  Pipeline *pipeline = &batch->pipeline;
+  // a trailing save is handed over to the saver thread, every other operation is done here
+  int lastOp = pipeline->numOps - (pipeline->ops[pipeline->numOps - 1].type == OP_SAVE ? 1 : 0);
+  Job job;
+  while (popJob(&batch->loaded, &job)) {
+    for (int i = 1; i < lastOp; i++) {
+      const Operation *op = &pipeline->ops[i];
+      if (op->type == OP_SAVE) {
+        saveJob(batch, op, job);
+        continue;
       }
+      double start = now();
+      IntImage result = applyOperation(op, job.image);
+      addStats(batch, op->type, now() - start, 0);
+      freeIntImage(job.image);
+      job.image = result;
     }
-    char filename[20];
-    sprintf(filename, "threshold%d.pbm", threshold);
-    displayIntImage(thresholdedImage, filename);  // filename is used as window title
-    saveIntImage(thresholdedImage, filename);
+    pushJob(&batch->computed, job);
+  }
+  return NULL;
+}
+
+static void *saverThread(void *arg) {
+  Batch *batch = arg;
+  const Operation *last = &batch->pipeline.ops[batch->pipeline.numOps - 1];
+  Job job;
+  while (popJob(&batch->computed, &job)) {
+    if (last->type == OP_SAVE) {
+      saveJob(batch, last, job);
+    }
+    freeIntImage(job.image);
+  }
+  return NULL;
+}
+
+static void printStats(Batch *batch, double wallTime) {
+  printf("%-10s %8s %10s %12s %10s\n", "stage", "images", "busy (s)", "images/s", "MB/s");
+  for (int t = 0; t < NUM_OP_TYPES; t++) {
+    StageStats *s = &batch->stats[t];
+    if (s->items == 0) {
+      continue;
+    }
+    double rate = (s->busy > 0 ? s->items / s->busy : 0);
+    double mbRate = (s->busy > 0 ? s->bytes / (1e6 * s->busy) : 0);
+    if (s->bytes > 0) {
+      printf("%-10s %8ld %10.3f %12.1f %10.1f\n", opNames[t], s->items, s->busy, rate, mbRate);
+    } else {
+      printf("%-10s %8ld %10.3f %12.1f %10s\n", opNames[t], s->items, s->busy, rate, "-");
+    }
+  }
+  printf("total: %d images in %.3f s (%.1f images/s)\n", batch->numPaths, wallTime,
+         (wallTime > 0 ? batch->numPaths / wallTime : 0));
+}
+
+/** Command line ****************************************************/
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [-j workers] [-q queue size] -p <pipeline> <files or globs...>\n"
+          "\n"
+          "The pipeline is a comma separated list of operations, starting with load:\n"
+          "  load                  load a .pgm or .pbm image\n"
+          "  threshold:T           pixels >= T become 1, all others 0\n"
+          "  dilate:WxH            grey value dilation with a WxH rectangle\n"
+          "  erode:WxH             grey value erosion with a WxH rectangle\n"
+          "  dt[:metric]           distance transform of the pixels with value 1 (euclid, sqeuclid, manhattan,\n"
+          "                        chessboard)\n"
+          "  invert                mirror the grey values within the dynamic range\n"
+          "  save:PATTERN          save the image; %%s in PATTERN is replaced by the input file name\n"
+          "\n"
+          "Example: %s -j 4 -p \"load,threshold:128,dt:euclid,save:out/%%s_dt.pgm\" \"images/*.pgm\"\n",
+          program, program);
+  exit(EXIT_FAILURE);
+}
+
+static void addPath(char ***paths, int *numPaths, int *capacity, const char *path) {
+  if (*numPaths == *capacity) {
+    *capacity = (*capacity == 0 ? 64 : 2 * *capacity);
+    *paths = realloc(*paths, *capacity * sizeof(char *));
+    if (*paths == NULL) {
+      fatalError("addPath: out of memory.\n");
+    }
+  }
+  (*paths)[(*numPaths)++] = strdup(path);
+}
+
+// Arguments containing wildcards are expanded here, so that globs also work when the shell did not expand them
+static void collectPaths(int argc, char *argv[], char ***paths, int *numPaths) {
+  int capacity = 0;
+  *paths = NULL;
+  *numPaths = 0;
+  for (int i = 0; i < argc; i++) {
+    if (strpbrk(argv[i], "*?[") == NULL) {
+      addPath(paths, numPaths, &capacity, argv[i]);
+      continue;
+    }
+    glob_t matches;
+    if (glob(argv[i], 0, NULL, &matches) == 0) {
+      for (size_t m = 0; m < matches.gl_pathc; m++) {
+        addPath(paths, numPaths, &capacity, matches.gl_pathv[m]);
+      }
+    } else {
+      fprintf(stderr, "Warning: pattern '%s' does not match any file.\n", argv[i]);
+    }
+    globfree(&matches);
   }
-  // Clean up
-  freeIntImage(thresholdedImage);
-  freeIntImage(image);
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 2) {
-    fprintf(stderr, "Fatal error: Please provide an image file as arugment.\n");
-    exit(EXIT_FAILURE);
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int numWorkers = (cpus > 0 ? cpus : 1);
+  int queueSize = 0;
+  char *spec = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:q:p:h")) != -1) {
+    switch (opt) {
+      case 'j':
+        numWorkers = atoi(optarg);
+        break;
+      case 'q':
+        queueSize = atoi(optarg);
+        break;
+      case 'p':
+        spec = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (spec == NULL || optind == argc || numWorkers < 1) {
+    usage(argv[0]);
+  }
+  if (queueSize < 1) {
+    queueSize = 2 * numWorkers;
+  }
+
+  Batch batch;
+  memset(&batch, 0, sizeof(batch));
+  batch.pipeline = parsePipeline(spec);
+  collectPaths(argc - optind, argv + optind, &batch.paths, &batch.numPaths);
+  if (batch.numPaths == 0) {
+    fatalError("no input files.\n");
+  }
+  initJobQueue(&batch.loaded, queueSize);
+  initJobQueue(&batch.computed, queueSize);
+  pthread_mutex_init(&batch.statsLock, NULL);
+
+  double start = now();
+  pthread_t loader, saver;
+  pthread_t *workers = malloc(numWorkers * sizeof(pthread_t));
+  pthread_create(&loader, NULL, loaderThread, &batch);
+  pthread_create(&saver, NULL, saverThread, &batch);
+  for (int i = 0; i < numWorkers; i++) {
+    pthread_create(&workers[i], NULL, computeThread, &batch);
+  }
+  pthread_join(loader, NULL);
+  for (int i = 0; i < numWorkers; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  closeJobQueue(&batch.computed);
+  pthread_join(saver, NULL);
+  printStats(&batch, now() - start);
+
+  // Clean up
+  free(workers);
+  pthread_mutex_destroy(&batch.statsLock);
+  destroyJobQueue(&batch.computed);
+  destroyJobQueue(&batch.loaded);
+  for (int i = 0; i < batch.numPaths; i++) {
+    free(batch.paths[i]);
   }
-  thresholdDemo(argv[1]);
+  free(batch.paths);
   return EXIT_SUCCESS;
 }